@@ -32,6 +32,116 @@
 
 namespace VulkanAbstractionLayer
 {
+    vk::PipelineStageFlags BufferUsageToPipelineStage(BufferUsage::Bits layout)
+    {
+        switch (layout)
+        {
+        case BufferUsage::UNKNOWN:
+            return vk::PipelineStageFlagBits::eTopOfPipe;
+        case BufferUsage::TRANSFER_SOURCE:
+            return vk::PipelineStageFlagBits::eTransfer;
+        case BufferUsage::TRANSFER_DESTINATION:
+            return vk::PipelineStageFlagBits::eTransfer;
+        case BufferUsage::UNIFORM_TEXEL_BUFFER:
+            return vk::PipelineStageFlagBits::eVertexShader; // TODO: from other shader stages?
+        case BufferUsage::STORAGE_TEXEL_BUFFER:
+            return vk::PipelineStageFlagBits::eComputeShader;
+        case BufferUsage::UNIFORM_BUFFER:
+            return vk::PipelineStageFlagBits::eVertexShader;
+        case BufferUsage::STORAGE_BUFFER:
+            return vk::PipelineStageFlagBits::eComputeShader;
+        case BufferUsage::INDEX_BUFFER:
+            return vk::PipelineStageFlagBits::eVertexInput;
+        case BufferUsage::VERTEX_BUFFER:
+            return vk::PipelineStageFlagBits::eVertexInput;
+        case BufferUsage::INDIRECT_BUFFER:
+            return vk::PipelineStageFlagBits::eDrawIndirect;
+        case BufferUsage::SHADER_DEVICE_ADDRESS:
+            return vk::PipelineStageFlagBits::eFragmentShader; // TODO: what should be here?
+        case BufferUsage::TRANSFORM_FEEDBACK_BUFFER:
+            return vk::PipelineStageFlagBits::eTransformFeedbackEXT;
+        case BufferUsage::TRANSFORM_FEEDBACK_COUNTER_BUFFER:
+            return vk::PipelineStageFlagBits::eTransformFeedbackEXT;
+        case BufferUsage::CONDITIONAL_RENDERING:
+            return vk::PipelineStageFlagBits::eConditionalRenderingEXT;
+        case BufferUsage::ACCELERATION_STRUCTURE_BUILD_INPUT_READONLY:
+            return vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR;
+        case BufferUsage::ACCELERATION_STRUCTURE_STORAGE:
+            return vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR; // TODO: what should be here?
+        case BufferUsage::SHADER_BINDING_TABLE:
+            return vk::PipelineStageFlagBits::eFragmentShader; // TODO: what should be here?
+        default:
+            assert(false);
+            return vk::PipelineStageFlags{ };
+        }
+    }
+
+    vk::AccessFlags BufferUsageToAccessFlags(BufferUsage::Bits layout)
+    {
+        switch (layout)
+        {
+        case BufferUsage::UNKNOWN:
+            return vk::AccessFlags{ };
+        case BufferUsage::TRANSFER_SOURCE:
+            return vk::AccessFlagBits::eTransferRead;
+        case BufferUsage::TRANSFER_DESTINATION:
+            return vk::AccessFlagBits::eTransferWrite;
+        case BufferUsage::UNIFORM_TEXEL_BUFFER:
+            return vk::AccessFlagBits::eShaderRead;
+        case BufferUsage::STORAGE_TEXEL_BUFFER:
+            return vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead;
+        case BufferUsage::UNIFORM_BUFFER:
+            return vk::AccessFlagBits::eShaderRead;
+        case BufferUsage::STORAGE_BUFFER:
+            return vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead;
+        case BufferUsage::INDEX_BUFFER:
+            return vk::AccessFlagBits::eIndexRead;
+        case BufferUsage::VERTEX_BUFFER:
+            return vk::AccessFlagBits::eVertexAttributeRead;
+        case BufferUsage::INDIRECT_BUFFER:
+            return vk::AccessFlagBits::eIndirectCommandRead;
+        case BufferUsage::SHADER_DEVICE_ADDRESS:
+            return vk::AccessFlagBits::eShaderRead;
+        case BufferUsage::TRANSFORM_FEEDBACK_BUFFER:
+            return vk::AccessFlagBits::eTransformFeedbackWriteEXT;
+        case BufferUsage::TRANSFORM_FEEDBACK_COUNTER_BUFFER:
+            return vk::AccessFlagBits::eTransformFeedbackCounterWriteEXT;
+        case BufferUsage::CONDITIONAL_RENDERING:
+            return vk::AccessFlagBits::eConditionalRenderingReadEXT;
+        case BufferUsage::ACCELERATION_STRUCTURE_BUILD_INPUT_READONLY:
+            return vk::AccessFlagBits::eAccelerationStructureReadKHR;
+        case BufferUsage::ACCELERATION_STRUCTURE_STORAGE:
+            return vk::AccessFlagBits::eAccelerationStructureReadKHR;
+        case BufferUsage::SHADER_BINDING_TABLE:
+            return vk::AccessFlagBits::eShaderRead;
+        default:
+            assert(false);
+            return vk::AccessFlags{ };
+        }
+    }
+
+    // synchronization2 distinguishes shader accesses by descriptor type, other bits are shared with legacy flags
+    vk::AccessFlags2KHR BufferUsageToAccessFlags2(BufferUsage::Bits layout)
+    {
+        switch (layout)
+        {
+        case BufferUsage::UNIFORM_TEXEL_BUFFER:
+            return vk::AccessFlagBits2KHR::eShaderSampledRead;
+        case BufferUsage::STORAGE_TEXEL_BUFFER:
+        case BufferUsage::STORAGE_BUFFER:
+            return vk::AccessFlagBits2KHR::eShaderStorageRead | vk::AccessFlagBits2KHR::eShaderStorageWrite;
+        case BufferUsage::UNIFORM_BUFFER:
+            return vk::AccessFlagBits2KHR::eUniformRead;
+        default:
+            return vk::AccessFlags2KHR{ (VkFlags64)(VkAccessFlags)BufferUsageToAccessFlags(layout) };
+        }
+    }
+
+    vk::PipelineStageFlags2KHR BufferUsageToPipelineStage2(BufferUsage::Bits layout)
+    {
+        return vk::PipelineStageFlags2KHR{ (VkFlags64)(VkPipelineStageFlags)BufferUsageToPipelineStage(layout) };
+    }
+
     Buffer::Buffer(size_t byteSize, BufferUsage::Value usage, MemoryUsage memoryUsage)
     {
         this->Init(byteSize, usage, memoryUsage);
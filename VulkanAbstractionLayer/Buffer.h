@@ -63,6 +63,11 @@ namespace VulkanAbstractionLayer
         };
     };
 
+    vk::AccessFlags BufferUsageToAccessFlags(BufferUsage::Bits usage);
+    vk::PipelineStageFlags BufferUsageToPipelineStage(BufferUsage::Bits usage);
+    vk::AccessFlags2KHR BufferUsageToAccessFlags2(BufferUsage::Bits usage);
+    vk::PipelineStageFlags2KHR BufferUsageToPipelineStage2(BufferUsage::Bits usage);
+
     class Buffer
     {
         vk::Buffer handle;
@@ -30,6 +30,7 @@
 #include "RenderPass.h"
 #include "Image.h"
 #include "Buffer.h"
+#include "VulkanContext.h"
 
 namespace VulkanAbstractionLayer
 {
@@ -63,9 +64,51 @@ namespace VulkanAbstractionLayer
         this->handle.end();
     }
 
-    void CommandBuffer::BeginPass(const PassNative& pass)
+    void CommandBuffer::BeginSecondary()
     {
-        if ((bool)pass.RenderPassHandle)
+        vk::CommandBufferInheritanceInfo inheritanceInfo;
+
+        vk::CommandBufferBeginInfo commandBufferBeginInfo;
+        commandBufferBeginInfo
+            .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+            .setPInheritanceInfo(&inheritanceInfo);
+        this->handle.begin(commandBufferBeginInfo);
+    }
+
+    void CommandBuffer::BeginSecondary(const PassNative& renderPass, uint32_t subpass)
+    {
+        vk::CommandBufferInheritanceInfo inheritanceInfo;
+        inheritanceInfo
+            .setRenderPass(renderPass.RenderPassHandle)
+            .setSubpass(subpass)
+            .setFramebuffer(renderPass.Framebuffer);
+
+        vk::CommandBufferInheritanceRenderingInfoKHR renderingInheritanceInfo;
+        if (renderPass.UsesDynamicRendering)
+        {
+            renderingInheritanceInfo
+                .setColorAttachmentFormats(renderPass.ColorAttachmentFormats)
+                .setDepthAttachmentFormat(renderPass.DepthAttachmentFormat)
+                .setStencilAttachmentFormat(renderPass.StencilAttachmentFormat)
+                .setViewMask(renderPass.ViewMask)
+                .setRasterizationSamples(vk::SampleCountFlagBits::e1);
+            inheritanceInfo.setPNext(&renderingInheritanceInfo);
+        }
+
+        vk::CommandBufferBeginInfo commandBufferBeginInfo;
+        commandBufferBeginInfo
+            .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+            .setPInheritanceInfo(&inheritanceInfo);
+        this->handle.begin(commandBufferBeginInfo);
+    }
+
+    static void BeginNativeRenderPass(const vk::CommandBuffer& commandBuffer, const PassNative& pass, vk::SubpassContents contents)
+    {
+        if (pass.SubpassIndex > 0)
+        {
+            commandBuffer.nextSubpass(contents);
+        }
+        else if ((bool)pass.RenderPassHandle)
         {
             vk::RenderPassBeginInfo renderPassBeginInfo;
             renderPassBeginInfo
@@ -74,9 +117,37 @@ namespace VulkanAbstractionLayer
                 .setFramebuffer(pass.Framebuffer)
                 .setClearValues(pass.ClearValues);
 
-            this->handle.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+            commandBuffer.beginRenderPass(renderPassBeginInfo, contents);
+        }
+        else if (pass.UsesDynamicRendering)
+        {
+            vk::RenderingInfoKHR renderingInfo;
+            renderingInfo
+                .setFlags(contents == vk::SubpassContents::eSecondaryCommandBuffers ? vk::RenderingFlagBitsKHR::eContentsSecondaryCommandBuffers : vk::RenderingFlagsKHR{ })
+                .setRenderArea(pass.RenderArea)
+                .setLayerCount(1)
+                .setViewMask(pass.ViewMask)
+                .setColorAttachments(pass.ColorAttachments)
+                .setPDepthAttachment(pass.DepthAttachmentFormat != vk::Format::eUndefined ? &pass.DepthStencilAttachment : nullptr)
+                .setPStencilAttachment(pass.StencilAttachmentFormat != vk::Format::eUndefined ? &pass.DepthStencilAttachment : nullptr);
+
+            commandBuffer.beginRenderingKHR(renderingInfo, GetCurrentVulkanContext().GetDynamicLoader());
         }
+    }
+
+    void CommandBuffer::BeginPass(const PassNative& pass)
+    {
+        BeginNativeRenderPass(this->handle, pass, vk::SubpassContents::eInline);
+        this->BindPass(pass);
+    }
+
+    void CommandBuffer::BeginPassWithSecondaryCommands(const PassNative& pass)
+    {
+        BeginNativeRenderPass(this->handle, pass, vk::SubpassContents::eSecondaryCommandBuffers);
+    }
 
+    void CommandBuffer::BindPass(const PassNative& pass)
+    {
         vk::Pipeline pipeline = pass.Pipeline;
         vk::PipelineLayout pipelineLayout = pass.PipelineLayout;
         vk::PipelineBindPoint pipelineType = pass.PipelineType;
@@ -84,6 +155,7 @@ namespace VulkanAbstractionLayer
 
         if ((bool)pipeline) this->handle.bindPipeline(pipelineType, pipeline);
         if ((bool)descriptorSet) this->handle.bindDescriptorSets(pipelineType, pipelineLayout, 0, descriptorSet, { });
+        if ((bool)pass.ResourceHeapSet) this->handle.bindDescriptorSets(pipelineType, pipelineLayout, RESOURCE_HEAP_SET, pass.ResourceHeapSet, { });
     }
 
     void CommandBuffer::EndPass(const PassNative& pass)
@@ -92,6 +164,15 @@ namespace VulkanAbstractionLayer
         {
             this->handle.endRenderPass();
         }
+        else if (pass.UsesDynamicRendering)
+        {
+            this->handle.endRenderingKHR(GetCurrentVulkanContext().GetDynamicLoader());
+        }
+    }
+
+    void CommandBuffer::ExecuteCommands(const CommandBuffer& commands)
+    {
+        this->handle.executeCommands(commands.GetNativeHandle());
     }
 
     void CommandBuffer::Draw(uint32_t vertexCount, uint32_t instanceCount)
@@ -182,13 +263,15 @@ namespace VulkanAbstractionLayer
         auto sourceRange = GetDefaultImageSubresourceRange(source.Resource.get());
         auto distanceRange = GetDefaultImageSubresourceRange(distance.Resource.get());
 
-        std::array<vk::ImageMemoryBarrier, 2> barriers;
+        std::array<vk::ImageMemoryBarrier2KHR, 2> barriers;
         size_t barrierCount = 0;
 
-        vk::ImageMemoryBarrier toTransferSrcBarrier;
+        vk::ImageMemoryBarrier2KHR toTransferSrcBarrier;
         toTransferSrcBarrier
-            .setSrcAccessMask(ImageUsageToAccessFlags(source.Usage))
-            .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+            .setSrcStageMask(ImageUsageToPipelineStage2(source.Usage))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(source.Usage))
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eCopy)
+            .setDstAccessMask(vk::AccessFlagBits2KHR::eTransferRead)
             .setOldLayout(ImageUsageToImageLayout(source.Usage))
             .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -196,10 +279,12 @@ namespace VulkanAbstractionLayer
             .setImage(source.Resource.get().GetNativeHandle())
             .setSubresourceRange(sourceRange);
 
-        vk::ImageMemoryBarrier toTransferDstBarrier;
+        vk::ImageMemoryBarrier2KHR toTransferDstBarrier;
         toTransferDstBarrier
-            .setSrcAccessMask(ImageUsageToAccessFlags(distance.Usage))
-            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setSrcStageMask(ImageUsageToPipelineStage2(distance.Usage))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(distance.Usage))
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eCopy)
+            .setDstAccessMask(vk::AccessFlagBits2KHR::eTransferWrite)
             .setOldLayout(ImageUsageToImageLayout(distance.Usage))
             .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -214,14 +299,7 @@ namespace VulkanAbstractionLayer
         
         if (barrierCount > 0)
         {
-            this->handle.pipelineBarrier(
-                ImageUsageToPipelineStage(source.Usage) | ImageUsageToPipelineStage(distance.Usage),
-                vk::PipelineStageFlagBits::eTransfer,
-                { }, // dependency flags
-                0, nullptr, // memory barriers
-                0, nullptr, // buffer barriers
-                barrierCount, barriers.data()
-            );
+            this->PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ barriers.data(), barrierCount });
         }
 
         auto sourceLayers = GetDefaultImageSubresourceLayers(source.Resource.get(), source.MipLevel, source.Layer);
@@ -254,10 +332,12 @@ namespace VulkanAbstractionLayer
         {
             auto sourceRange = GetDefaultImageSubresourceRange(source.Resource.get());
 
-            vk::ImageMemoryBarrier toTransferSrcBarrier;
+            vk::ImageMemoryBarrier2KHR toTransferSrcBarrier;
             toTransferSrcBarrier
-                .setSrcAccessMask(ImageUsageToAccessFlags(source.Usage))
-                .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+                .setSrcStageMask(ImageUsageToPipelineStage2(source.Usage))
+                .setSrcAccessMask(ImageUsageToAccessFlags2(source.Usage))
+                .setDstStageMask(vk::PipelineStageFlagBits2KHR::eCopy)
+                .setDstAccessMask(vk::AccessFlagBits2KHR::eTransferRead)
                 .setOldLayout(ImageUsageToImageLayout(source.Usage))
                 .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
                 .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -265,14 +345,7 @@ namespace VulkanAbstractionLayer
                 .setImage(source.Resource.get().GetNativeHandle())
                 .setSubresourceRange(sourceRange);
 
-            this->handle.pipelineBarrier(
-                ImageUsageToPipelineStage(source.Usage),
-                vk::PipelineStageFlagBits::eTransfer,
-                { }, // dependency flags
-                { }, // memory barriers
-                { }, // buffer barriers
-                toTransferSrcBarrier
-            );
+            this->PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ &toTransferSrcBarrier, 1 });
         }
 
         auto sourceLayers = GetDefaultImageSubresourceLayers(source.Resource.get(), source.MipLevel, source.Layer);
@@ -302,10 +375,12 @@ namespace VulkanAbstractionLayer
         {
             auto distanceRange = GetDefaultImageSubresourceRange(distance.Resource.get());
 
-            vk::ImageMemoryBarrier toTransferDstBarrier;
+            vk::ImageMemoryBarrier2KHR toTransferDstBarrier;
             toTransferDstBarrier
-                .setSrcAccessMask(ImageUsageToAccessFlags(distance.Usage))
-                .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+                .setSrcStageMask(ImageUsageToPipelineStage2(distance.Usage))
+                .setSrcAccessMask(ImageUsageToAccessFlags2(distance.Usage))
+                .setDstStageMask(vk::PipelineStageFlagBits2KHR::eCopy)
+                .setDstAccessMask(vk::AccessFlagBits2KHR::eTransferWrite)
                 .setOldLayout(ImageUsageToImageLayout(distance.Usage))
                 .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
                 .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -313,14 +388,7 @@ namespace VulkanAbstractionLayer
                 .setImage(distance.Resource.get().GetNativeHandle())
                 .setSubresourceRange(distanceRange);
 
-            this->handle.pipelineBarrier(
-                ImageUsageToPipelineStage(distance.Usage),
-                vk::PipelineStageFlagBits::eTransfer,
-                { }, // dependency flags
-                { }, // memory barriers
-                { }, // buffer barriers
-                toTransferDstBarrier
-            );
+            this->PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ &toTransferDstBarrier, 1 });
         }
 
         auto distanceLayers = GetDefaultImageSubresourceLayers(distance.Resource.get(), distance.MipLevel, distance.Layer);
@@ -365,13 +433,15 @@ namespace VulkanAbstractionLayer
         auto sourceRange = GetDefaultImageSubresourceRange(source);
         auto distanceRange = GetDefaultImageSubresourceRange(distance);
 
-        std::array<vk::ImageMemoryBarrier, 2> barriers;
+        std::array<vk::ImageMemoryBarrier2KHR, 2> barriers;
         size_t barrierCount = 0;
 
-        vk::ImageMemoryBarrier toTransferSrcBarrier;
+        vk::ImageMemoryBarrier2KHR toTransferSrcBarrier;
         toTransferSrcBarrier
-            .setSrcAccessMask(ImageUsageToAccessFlags(sourceUsage))
-            .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+            .setSrcStageMask(ImageUsageToPipelineStage2(sourceUsage))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(sourceUsage))
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eBlit)
+            .setDstAccessMask(vk::AccessFlagBits2KHR::eTransferRead)
             .setOldLayout(ImageUsageToImageLayout(sourceUsage))
             .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -379,10 +449,12 @@ namespace VulkanAbstractionLayer
             .setImage(source.GetNativeHandle())
             .setSubresourceRange(sourceRange);
 
-        vk::ImageMemoryBarrier toTransferDstBarrier;
+        vk::ImageMemoryBarrier2KHR toTransferDstBarrier;
         toTransferDstBarrier
-            .setSrcAccessMask(ImageUsageToAccessFlags(distanceUsage))
-            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setSrcStageMask(ImageUsageToPipelineStage2(distanceUsage))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(distanceUsage))
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eBlit)
+            .setDstAccessMask(vk::AccessFlagBits2KHR::eTransferWrite)
             .setOldLayout(ImageUsageToImageLayout(distanceUsage))
             .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -397,14 +469,7 @@ namespace VulkanAbstractionLayer
 
         if (barrierCount > 0)
         {
-            this->handle.pipelineBarrier(
-                ImageUsageToPipelineStage(sourceUsage) | ImageUsageToPipelineStage(distanceUsage),
-                vk::PipelineStageFlagBits::eTransfer,
-                { }, // dependency flags
-                0, nullptr, // memory barriers
-                0, nullptr, // buffer barriers
-                barrierCount, barriers.data()
-            );
+            this->PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ barriers.data(), barrierCount });
         }
 
         auto sourceLayers = GetDefaultImageSubresourceLayers(source);
@@ -462,10 +527,12 @@ namespace VulkanAbstractionLayer
             distanceRange.setBaseMipLevel(i + 1);
             distanceRange.setLevelCount(1);
 
-            std::array<vk::ImageMemoryBarrier, 2> imageBarriers;
+            std::array<vk::ImageMemoryBarrier2KHR, 2> imageBarriers;
             imageBarriers[0] // to transfer source
-                .setSrcAccessMask(ImageUsageToAccessFlags(sourceUsage))
-                .setDstAccessMask(ImageUsageToAccessFlags(ImageUsage::TRANSFER_SOURCE))
+                .setSrcStageMask(ImageUsageToPipelineStage2(sourceUsage))
+                .setSrcAccessMask(ImageUsageToAccessFlags2(sourceUsage))
+                .setDstStageMask(ImageUsageToPipelineStage2(ImageUsage::TRANSFER_SOURCE))
+                .setDstAccessMask(ImageUsageToAccessFlags2(ImageUsage::TRANSFER_SOURCE))
                 .setOldLayout(ImageUsageToImageLayout(sourceUsage))
                 .setNewLayout(ImageUsageToImageLayout(ImageUsage::TRANSFER_SOURCE))
                 .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -474,8 +541,10 @@ namespace VulkanAbstractionLayer
                 .setSubresourceRange(sourceRange);
 
             imageBarriers[1] // to transfer distance
-                .setSrcAccessMask(ImageUsageToAccessFlags(ImageUsage::UNKNOWN))
-                .setDstAccessMask(ImageUsageToAccessFlags(ImageUsage::TRANSFER_DISTINATION))
+                .setSrcStageMask(ImageUsageToPipelineStage2(ImageUsage::UNKNOWN))
+                .setSrcAccessMask(ImageUsageToAccessFlags2(ImageUsage::UNKNOWN))
+                .setDstStageMask(ImageUsageToPipelineStage2(ImageUsage::TRANSFER_DISTINATION))
+                .setDstAccessMask(ImageUsageToAccessFlags2(ImageUsage::TRANSFER_DISTINATION))
                 .setOldLayout(ImageUsageToImageLayout(ImageUsage::UNKNOWN))
                 .setNewLayout(ImageUsageToImageLayout(ImageUsage::TRANSFER_DISTINATION))
                 .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -483,14 +552,7 @@ namespace VulkanAbstractionLayer
                 .setImage(image.GetNativeHandle())
                 .setSubresourceRange(distanceRange);
 
-            this->handle.pipelineBarrier(
-                vk::PipelineStageFlagBits::eTransfer,
-                vk::PipelineStageFlagBits::eTransfer,
-                { }, // dependencies
-                { }, // memory barriers
-                { }, // buffer barriers,
-                imageBarriers
-            );
+            this->PipelineBarrier({ }, imageBarriers);
             sourceUsage = ImageUsage::TRANSFER_DISTINATION;
 
             vk::ImageBlit imageBlitInfo;
@@ -519,10 +581,12 @@ namespace VulkanAbstractionLayer
 
         auto mipLevelsSubresourceRange = GetDefaultImageSubresourceRange(image);
         mipLevelsSubresourceRange.setLevelCount(mipLevelsSubresourceRange.levelCount - 1);
-        vk::ImageMemoryBarrier mipLevelsTransfer;
+        vk::ImageMemoryBarrier2KHR mipLevelsTransfer;
         mipLevelsTransfer
-            .setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
-            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setSrcStageMask(vk::PipelineStageFlagBits2KHR::eBlit)
+            .setSrcAccessMask(vk::AccessFlagBits2KHR::eTransferRead)
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eBlit)
+            .setDstAccessMask(vk::AccessFlagBits2KHR::eTransferWrite)
             .setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
             .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -530,23 +594,18 @@ namespace VulkanAbstractionLayer
             .setImage(image.GetNativeHandle())
             .setSubresourceRange(mipLevelsSubresourceRange);
 
-        this->handle.pipelineBarrier(
-            vk::PipelineStageFlagBits::eTransfer,
-            vk::PipelineStageFlagBits::eTransfer,
-            { }, // dependecies
-            { }, // memory barriers
-            { }, // buffer barriers
-            mipLevelsTransfer
-        );
+        this->PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ &mipLevelsTransfer, 1 });
     }
 
-    static vk::ImageMemoryBarrier GetImageMemoryBarrier(const Image& image, ImageUsage::Bits oldLayout, ImageUsage::Bits newLayout)
+    static vk::ImageMemoryBarrier2KHR GetImageMemoryBarrier(const Image& image, ImageUsage::Bits oldLayout, ImageUsage::Bits newLayout)
     {
         auto subresourceRange = GetDefaultImageSubresourceRange(image);
-        vk::ImageMemoryBarrier barrier;
+        vk::ImageMemoryBarrier2KHR barrier;
         barrier
-            .setSrcAccessMask(ImageUsageToAccessFlags(oldLayout))
-            .setDstAccessMask(ImageUsageToAccessFlags(newLayout))
+            .setSrcStageMask(ImageUsageToPipelineStage2(oldLayout))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(oldLayout))
+            .setDstStageMask(ImageUsageToPipelineStage2(newLayout))
+            .setDstAccessMask(ImageUsageToAccessFlags2(newLayout))
             .setOldLayout(ImageUsageToImageLayout(oldLayout))
             .setNewLayout(ImageUsageToImageLayout(newLayout))
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -561,19 +620,12 @@ namespace VulkanAbstractionLayer
     {
         auto barrier = GetImageMemoryBarrier(image, oldLayout, newLayout);
 
-        this->handle.pipelineBarrier(
-            ImageUsageToPipelineStage(oldLayout),
-            ImageUsageToPipelineStage(newLayout),
-            { }, // dependecies
-            { }, // memory barriers
-            { }, // buffer barriers
-            barrier
-        );
+        this->PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ &barrier, 1 });
     }
 
     void CommandBuffer::TransferLayout(ArrayView<ImageReference> images, ImageUsage::Bits oldLayout, ImageUsage::Bits newLayout)
     {
-        std::vector<vk::ImageMemoryBarrier> barriers;
+        std::vector<vk::ImageMemoryBarrier2KHR> barriers;
         barriers.reserve(images.size());
 
         for (const auto& image : images)
@@ -581,19 +633,12 @@ namespace VulkanAbstractionLayer
             barriers.push_back(GetImageMemoryBarrier(image.get(), oldLayout, newLayout));
         }
 
-        this->handle.pipelineBarrier(
-            ImageUsageToPipelineStage(oldLayout),
-            ImageUsageToPipelineStage(newLayout),
-            { }, // dependecies
-            { }, // memory barriers
-            { }, // buffer barriers
-            barriers
-        );
+        this->PipelineBarrier({ }, barriers);
     }
 
     void CommandBuffer::TransferLayout(ArrayView<Image> images, ImageUsage::Bits oldLayout, ImageUsage::Bits newLayout)
     {
-        std::vector<vk::ImageMemoryBarrier> barriers;
+        std::vector<vk::ImageMemoryBarrier2KHR> barriers;
         barriers.reserve(images.size());
 
         for (const auto& image : images)
@@ -601,13 +646,135 @@ namespace VulkanAbstractionLayer
             barriers.push_back(GetImageMemoryBarrier(image, oldLayout, newLayout));
         }
 
+        this->PipelineBarrier({ }, barriers);
+    }
+
+    static vk::PipelineStageFlags ToLegacyPipelineStages(vk::PipelineStageFlags2KHR stages)
+    {
+        const vk::PipelineStageFlags2KHR TransferStages =
+            vk::PipelineStageFlagBits2KHR::eCopy |
+            vk::PipelineStageFlagBits2KHR::eResolve |
+            vk::PipelineStageFlagBits2KHR::eBlit |
+            vk::PipelineStageFlagBits2KHR::eClear;
+        const vk::PipelineStageFlags2KHR VertexInputStages =
+            vk::PipelineStageFlagBits2KHR::eIndexInput |
+            vk::PipelineStageFlagBits2KHR::eVertexAttributeInput;
+
+        // lower bits are shared with legacy stages
+        vk::PipelineStageFlags legacyStages{ (VkPipelineStageFlags)((VkFlags64)stages & 0xFFFFFFFFu) };
+        if (stages & TransferStages) legacyStages |= vk::PipelineStageFlagBits::eTransfer;
+        if (stages & VertexInputStages) legacyStages |= vk::PipelineStageFlagBits::eVertexInput;
+        return legacyStages;
+    }
+
+    static vk::AccessFlags ToLegacyAccessFlags(vk::AccessFlags2KHR access)
+    {
+        const vk::AccessFlags2KHR ShaderReadAccess =
+            vk::AccessFlagBits2KHR::eShaderSampledRead |
+            vk::AccessFlagBits2KHR::eShaderStorageRead;
+
+        vk::AccessFlags legacyAccess{ (VkAccessFlags)((VkFlags64)access & 0xFFFFFFFFu) };
+        if (access & ShaderReadAccess) legacyAccess |= vk::AccessFlagBits::eShaderRead;
+        if (access & vk::AccessFlagBits2KHR::eShaderStorageWrite) legacyAccess |= vk::AccessFlagBits::eShaderWrite;
+        return legacyAccess;
+    }
+
+    struct LegacyBarriers
+    {
+        vk::PipelineStageFlags SourceStages;
+        vk::PipelineStageFlags DestinationStages;
+        std::vector<vk::BufferMemoryBarrier> BufferBarriers;
+        std::vector<vk::ImageMemoryBarrier> ImageBarriers;
+    };
+
+    static LegacyBarriers& ToLegacyBarriers(ArrayView<const vk::BufferMemoryBarrier2KHR> bufferBarriers, ArrayView<const vk::ImageMemoryBarrier2KHR> imageBarriers)
+    {
+        // capacity is kept between calls, command buffers can be recorded from multiple threads
+        thread_local LegacyBarriers legacyBarriers;
+        legacyBarriers.SourceStages = { };
+        legacyBarriers.DestinationStages = { };
+        legacyBarriers.BufferBarriers.clear();
+        legacyBarriers.ImageBarriers.clear();
+
+        for (const auto& bufferBarrier : bufferBarriers)
+        {
+            legacyBarriers.SourceStages |= ToLegacyPipelineStages(bufferBarrier.srcStageMask);
+            legacyBarriers.DestinationStages |= ToLegacyPipelineStages(bufferBarrier.dstStageMask);
+            legacyBarriers.BufferBarriers.push_back(vk::BufferMemoryBarrier{
+                ToLegacyAccessFlags(bufferBarrier.srcAccessMask),
+                ToLegacyAccessFlags(bufferBarrier.dstAccessMask),
+                bufferBarrier.srcQueueFamilyIndex,
+                bufferBarrier.dstQueueFamilyIndex,
+                bufferBarrier.buffer,
+                bufferBarrier.offset,
+                bufferBarrier.size
+            });
+        }
+        for (const auto& imageBarrier : imageBarriers)
+        {
+            legacyBarriers.SourceStages |= ToLegacyPipelineStages(imageBarrier.srcStageMask);
+            legacyBarriers.DestinationStages |= ToLegacyPipelineStages(imageBarrier.dstStageMask);
+            legacyBarriers.ImageBarriers.push_back(vk::ImageMemoryBarrier{
+                ToLegacyAccessFlags(imageBarrier.srcAccessMask),
+                ToLegacyAccessFlags(imageBarrier.dstAccessMask),
+                imageBarrier.oldLayout,
+                imageBarrier.newLayout,
+                imageBarrier.srcQueueFamilyIndex,
+                imageBarrier.dstQueueFamilyIndex,
+                imageBarrier.image,
+                imageBarrier.subresourceRange
+            });
+        }
+
+        // legacy barriers do not accept empty stage masks
+        if (!legacyBarriers.SourceStages) legacyBarriers.SourceStages = vk::PipelineStageFlagBits::eTopOfPipe;
+        if (!legacyBarriers.DestinationStages) legacyBarriers.DestinationStages = vk::PipelineStageFlagBits::eBottomOfPipe;
+        return legacyBarriers;
+    }
+
+    void CommandBuffer::PipelineBarrier(ArrayView<const vk::BufferMemoryBarrier2KHR> bufferBarriers, ArrayView<const vk::ImageMemoryBarrier2KHR> imageBarriers)
+    {
+        if (bufferBarriers.empty() && imageBarriers.empty()) return;
+
+        auto& vulkan = GetCurrentVulkanContext();
+        if (vulkan.IsSynchronization2Enabled())
+        {
+            vk::DependencyInfoKHR dependencyInfo;
+            dependencyInfo
+                .setBufferMemoryBarrierCount((uint32_t)bufferBarriers.size())
+                .setPBufferMemoryBarriers(bufferBarriers.data())
+                .setImageMemoryBarrierCount((uint32_t)imageBarriers.size())
+                .setPImageMemoryBarriers(imageBarriers.data());
+
+            this->handle.pipelineBarrier2KHR(dependencyInfo, vulkan.GetDynamicLoader());
+            return;
+        }
+
+        auto& legacyBarriers = ToLegacyBarriers(bufferBarriers, imageBarriers);
         this->handle.pipelineBarrier(
-            ImageUsageToPipelineStage(oldLayout),
-            ImageUsageToPipelineStage(newLayout),
-            { }, // dependecies
+            legacyBarriers.SourceStages,
+            legacyBarriers.DestinationStages,
+            { }, // dependency flags
             { }, // memory barriers
-            { }, // buffer barriers
-            barriers
+            legacyBarriers.BufferBarriers,
+            legacyBarriers.ImageBarriers
+        );
+    }
+
+    void CommandBuffer::WaitEvents(ArrayView<const vk::Event> events, vk::PipelineStageFlags signalStages, ArrayView<const vk::BufferMemoryBarrier2KHR> bufferBarriers, ArrayView<const vk::ImageMemoryBarrier2KHR> imageBarriers)
+    {
+        auto& legacyBarriers = ToLegacyBarriers(bufferBarriers, imageBarriers);
+        // source stages must match stage masks the events were set with
+        this->handle.waitEvents(
+            (uint32_t)events.size(),
+            events.data(),
+            signalStages,
+            legacyBarriers.DestinationStages,
+            0, nullptr,
+            (uint32_t)legacyBarriers.BufferBarriers.size(),
+            legacyBarriers.BufferBarriers.data(),
+            (uint32_t)legacyBarriers.ImageBarriers.size(),
+            legacyBarriers.ImageBarriers.data()
         );
     }
-}
\ No newline at end of file
+}
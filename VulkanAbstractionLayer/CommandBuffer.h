@@ -101,8 +101,13 @@ namespace VulkanAbstractionLayer
         const vk::CommandBuffer& GetNativeHandle() const { return this->handle; }
         void Begin();
         void End();
+        void BeginSecondary();
+        void BeginSecondary(const PassNative& renderPass, uint32_t subpass);
         void BeginPass(const PassNative& renderPass);
+        void BeginPassWithSecondaryCommands(const PassNative& renderPass);
+        void BindPass(const PassNative& renderPass);
         void EndPass(const PassNative& renderPass);
+        void ExecuteCommands(const CommandBuffer& commands);
         void Draw(uint32_t vertexCount, uint32_t instanceCount);
         void Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
         void DrawIndexed(uint32_t indexCount, uint32_t instanceCount);
@@ -128,6 +133,11 @@ namespace VulkanAbstractionLayer
         void TransferLayout(ArrayView<ImageReference> images, ImageUsage::Bits oldLayout, ImageUsage::Bits newLayout);
         void TransferLayout(ArrayView<Image> images, ImageUsage::Bits oldLayout, ImageUsage::Bits newLayout);
 
+        // single dependency with per-barrier stages, converted to legacy barrier with merged stages if synchronization2 is disabled
+        void PipelineBarrier(ArrayView<const vk::BufferMemoryBarrier2KHR> bufferBarriers, ArrayView<const vk::ImageMemoryBarrier2KHR> imageBarriers);
+        // events are set with legacy stage masks, so wait is always recorded as legacy one
+        void WaitEvents(ArrayView<const vk::Event> events, vk::PipelineStageFlags signalStages, ArrayView<const vk::BufferMemoryBarrier2KHR> bufferBarriers, ArrayView<const vk::ImageMemoryBarrier2KHR> imageBarriers);
+
         template<typename... Buffers>
         void BindVertexBuffers(const Buffers&... vertexBuffers)
         {
@@ -74,17 +74,19 @@ namespace VulkanAbstractionLayer
         computeShaderInfo.setCode(computeData.Bytecode);
         this->computeShader = vulkan.GetDevice().createShaderModule(computeShaderInfo);
 
-        // TODO: support multiple descriptor sets
-        assert(computeData.DescriptorSets.size() < 2);
+        // TODO: support multiple descriptor sets, only the second one can be used for global resource heap
+        assert(computeData.DescriptorSets.size() <= RESOURCE_HEAP_SET + 1);
         this->shaderUniforms = std::vector{
             ShaderUniforms{ computeData.DescriptorSets[0], ShaderType::COMPUTE }
         };
+        this->usesResourceHeap = computeData.DescriptorSets.size() > RESOURCE_HEAP_SET;
     }
 
     ComputeShader::ComputeShader(ComputeShader&& other) noexcept
     {
         this->computeShader = other.computeShader;
         this->shaderUniforms = std::move(other.shaderUniforms);
+        this->usesResourceHeap = other.usesResourceHeap;
 
         other.computeShader = vk::ShaderModule{ };
     }
@@ -95,6 +97,7 @@ namespace VulkanAbstractionLayer
 
         this->computeShader = other.computeShader;
         this->shaderUniforms = std::move(other.shaderUniforms);
+        this->usesResourceHeap = other.usesResourceHeap;
 
         other.computeShader = vk::ShaderModule{ };
 
@@ -36,6 +36,7 @@ namespace VulkanAbstractionLayer
     {
         vk::ShaderModule computeShader;
         std::vector<ShaderUniforms> shaderUniforms;
+        bool usesResourceHeap = false;
 
         void Destroy();
     public:
@@ -53,5 +54,6 @@ namespace VulkanAbstractionLayer
         ArrayView<const TypeSPIRV> GetInputAttributes() const override;
         ArrayView<const ShaderUniforms> GetShaderUniforms() const override;
         virtual const vk::ShaderModule& GetNativeShader(ShaderType type) const override;
+        bool UsesResourceHeap() const override { return this->usesResourceHeap; }
     };
 }
\ No newline at end of file
@@ -29,6 +29,8 @@
 #include "DescriptorBinding.h"
 #include "VulkanContext.h"
 
+#include <algorithm>
+
 namespace VulkanAbstractionLayer
 {
 	Sampler EmptySampler;
@@ -103,51 +105,84 @@ namespace VulkanAbstractionLayer
 		}
 	}
 
-	void ResolveInfo::Resolve(const std::string& name, const Buffer& buffer)
+	ResourceHandle ResolveInfo::FindHandle(std::string_view name) const
+	{
+		auto [first, last] = this->resourceHandles.equal_range(std::hash<std::string_view>{ }(name));
+		for (auto it = first; it != last; it++)
+		{
+			if (this->resourceNames[it->second] == name)
+				return it->second;
+		}
+		return INVALID_RESOURCE_HANDLE;
+	}
+
+	ResourceHandle ResolveInfo::GetHandle(std::string_view name)
+	{
+		auto handle = this->FindHandle(name);
+		if (handle != INVALID_RESOURCE_HANDLE)
+			return handle;
+
+		handle = (ResourceHandle)this->resourceNames.size();
+		this->resourceNames.emplace_back(name);
+		this->resourceHandles.emplace(std::hash<std::string_view>{ }(name), handle);
+		this->bufferResolves.emplace_back();
+		this->imageResolves.emplace_back();
+		return handle;
+	}
+
+	void ResolveInfo::Clear()
+	{
+		for (auto& buffers : this->bufferResolves)
+			buffers.clear();
+		for (auto& images : this->imageResolves)
+			images.clear();
+	}
+
+	void ResolveInfo::Resolve(ResourceHandle handle, const Buffer& buffer)
 	{
-		assert(this->bufferResolves.find(name) == this->bufferResolves.end());
-		this->bufferResolves[name] = { buffer };
+		assert(this->bufferResolves[handle].empty());
+		this->bufferResolves[handle].push_back(buffer);
 	}
 
-	void ResolveInfo::Resolve(const std::string& name, ArrayView<const Buffer> buffers)
+	void ResolveInfo::Resolve(ResourceHandle handle, ArrayView<const Buffer> buffers)
 	{
-		assert(this->bufferResolves.find(name) == this->bufferResolves.end());
+		assert(this->bufferResolves[handle].empty());
 		for (const auto& buffer : buffers)
 		{
-			this->bufferResolves[name].push_back(buffer);
+			this->bufferResolves[handle].push_back(buffer);
 		}
 	}
 
-	void ResolveInfo::Resolve(const std::string& name, ArrayView<const BufferReference> buffers)
+	void ResolveInfo::Resolve(ResourceHandle handle, ArrayView<const BufferReference> buffers)
 	{
-		assert(this->bufferResolves.find(name) == this->bufferResolves.end());
+		assert(this->bufferResolves[handle].empty());
 		for (const auto& buffer : buffers)
 		{
-			this->bufferResolves[name].push_back(buffer);
+			this->bufferResolves[handle].push_back(buffer);
 		}
 	}
 
-	void ResolveInfo::Resolve(const std::string& name, const Image& image)
+	void ResolveInfo::Resolve(ResourceHandle handle, const Image& image)
 	{
-		assert(this->imageResolves.find(name) == this->imageResolves.end());
-		this->imageResolves[name] = { image };
+		assert(this->imageResolves[handle].empty());
+		this->imageResolves[handle].push_back(image);
 	}
 
-	void ResolveInfo::Resolve(const std::string& name, ArrayView<const Image> images)
+	void ResolveInfo::Resolve(ResourceHandle handle, ArrayView<const Image> images)
 	{
-		assert(this->imageResolves.find(name) == this->imageResolves.end());
+		assert(this->imageResolves[handle].empty());
 		for (const auto& image : images)
 		{
-			this->imageResolves[name].push_back(image);
+			this->imageResolves[handle].push_back(image);
 		}
 	}
 
-	void ResolveInfo::Resolve(const std::string& name, ArrayView<const ImageReference> images)
+	void ResolveInfo::Resolve(ResourceHandle handle, ArrayView<const ImageReference> images)
 	{
-		assert(this->imageResolves.find(name) == this->imageResolves.end());
+		assert(this->imageResolves[handle].empty());
 		for (const auto& image : images)
 		{
-			this->imageResolves[name].push_back(image);
+			this->imageResolves[handle].push_back(image);
 		}
 	}
 
@@ -207,6 +242,7 @@ namespace VulkanAbstractionLayer
 	{
 		this->imagesToResolve.push_back(ImageToResolve{
 			name,
+			INVALID_RESOURCE_HANDLE,
 			binding,
 			type,
 			UniformTypeToImageUsage(type),
@@ -233,6 +269,7 @@ namespace VulkanAbstractionLayer
 		
 		this->buffersToResolve.push_back(BufferToResolve{
 			name,
+			INVALID_RESOURCE_HANDLE,
 			binding,
 			type,
 			UniformTypeToBufferUsage(type),
@@ -240,6 +277,14 @@ namespace VulkanAbstractionLayer
 		return *this;
 	}
 
+	void DescriptorBinding::InternNames(ResolveInfo& resolveInfo)
+	{
+		for (auto& imageToResolve : this->imagesToResolve)
+			imageToResolve.Handle = resolveInfo.GetHandle(imageToResolve.Name);
+		for (auto& bufferToResolve : this->buffersToResolve)
+			bufferToResolve.Handle = resolveInfo.GetHandle(bufferToResolve.Name);
+	}
+
 	void DescriptorBinding::Resolve(const ResolveInfo& resolve)
 	{
 		this->imageWriteInfos.clear();
@@ -248,7 +293,9 @@ namespace VulkanAbstractionLayer
 
 		for (const auto& imageToResolve : this->imagesToResolve)
 		{
-			auto& images = resolve.GetImages().at(imageToResolve.Name);
+			auto handle = imageToResolve.Handle != INVALID_RESOURCE_HANDLE ? imageToResolve.Handle : resolve.FindHandle(imageToResolve.Name);
+			assert(handle != INVALID_RESOURCE_HANDLE);
+			auto images = resolve.GetImages(handle);
 			size_t index = 0;
 			if ((bool)imageToResolve.SamplerHandle->GetNativeHandle())
 			{
@@ -271,7 +318,9 @@ namespace VulkanAbstractionLayer
 
 		for (const auto& bufferToResolve : this->buffersToResolve)
 		{
-			auto& buffers = resolve.GetBuffers().at(bufferToResolve.Name);
+			auto handle = bufferToResolve.Handle != INVALID_RESOURCE_HANDLE ? bufferToResolve.Handle : resolve.FindHandle(bufferToResolve.Name);
+			assert(handle != INVALID_RESOURCE_HANDLE);
+			auto buffers = resolve.GetBuffers(handle);
 			size_t index = 0;
 			for (const auto& buffer : buffers)
 				index = this->AllocateBinding(buffer.get(), bufferToResolve.Type);
@@ -314,57 +363,171 @@ namespace VulkanAbstractionLayer
 		}
 	}
 
-	void DescriptorBinding::Write(const vk::DescriptorSet& descriptorSet)
+	// both infos are read with the same stride from packed payload
+	static_assert(sizeof(vk::DescriptorImageInfo) == sizeof(vk::DescriptorBufferInfo));
+
+	size_t DescriptorBinding::GetDescriptorInfoIndex(const DescriptorWriteInfo& write, uint32_t element) const
 	{
-		if (this->options == ResolveOptions::ALREADY_RESOLVED)
-			return;
-		if (this->options == ResolveOptions::RESOLVE_ONCE)
-			this->options = ResolveOptions::ALREADY_RESOLVED;
+		size_t firstIndex = IsBufferType(write.Type) ? this->imageWriteInfos.size() + write.FirstIndex : write.FirstIndex;
+		return firstIndex + element;
+	}
 
-		std::vector<vk::WriteDescriptorSet> writesDescriptorSet;
-		std::vector<vk::DescriptorBufferInfo> descriptorBufferInfos;
-		std::vector<vk::DescriptorImageInfo> descriptorImageInfos;
-		writesDescriptorSet.reserve(this->descriptorWrites.size());
-		descriptorBufferInfos.reserve(this->bufferWriteInfos.size());
-		descriptorImageInfos.reserve(this->imageWriteInfos.size());
+	bool DescriptorBinding::IsDescriptorChanged(const WrittenDescriptorSet& writtenSet, const DescriptorWriteInfo& write, uint32_t element) const
+	{
+		size_t index = this->GetDescriptorInfoIndex(write, element);
+		if (IsBufferType(write.Type))
+			return writtenSet.DescriptorInfos[index].Buffer != this->nativeDescriptorInfos[index].Buffer;
+		else
+			return writtenSet.DescriptorInfos[index].Image != this->nativeDescriptorInfos[index].Image;
+	}
 
-		for (const auto& bufferInfo : this->bufferWriteInfos)
+	uint32_t DescriptorBinding::AppendChangedWrites(const vk::DescriptorSet& descriptorSet, const WrittenDescriptorSet* writtenSet, std::vector<vk::WriteDescriptorSet>& nativeWrites) const
+	{
+		uint32_t changedDescriptorCount = 0;
+		for (const auto& write : this->descriptorWrites)
 		{
-			descriptorBufferInfos.push_back(vk::DescriptorBufferInfo{
-				bufferInfo.Handle->GetNativeHandle(),
+			for (uint32_t element = 0; element < write.Count;)
+			{
+				// consecutive changed array elements are written together, every one is changed if set was not written with the same layout
+				uint32_t changedCount = 0;
+				while (element + changedCount < write.Count && (writtenSet == nullptr || this->IsDescriptorChanged(*writtenSet, write, element + changedCount)))
+					changedCount++;
+
+				if (changedCount == 0)
+				{
+					element++;
+					continue;
+				}
+
+				const auto& descriptorInfo = this->nativeDescriptorInfos[this->GetDescriptorInfoIndex(write, element)];
+				auto& writeDescriptorSet = nativeWrites.emplace_back();
+				writeDescriptorSet
+					.setDstSet(descriptorSet)
+					.setDstBinding(write.Binding)
+					.setDstArrayElement(element)
+					.setDescriptorType(ToNative(write.Type))
+					.setDescriptorCount(changedCount);
+
+				if (IsBufferType(write.Type))
+				{
+					writeDescriptorSet.setPBufferInfo(&descriptorInfo.Buffer);
+				}
+				else
+				{
+					writeDescriptorSet.setPImageInfo(&descriptorInfo.Image);
+				}
+				element += changedCount;
+				changedDescriptorCount += changedCount;
+			}
+		}
+		return changedDescriptorCount;
+	}
+
+	void DescriptorBinding::RecreateUpdateTemplate(const vk::DescriptorSetLayout& setLayout)
+	{
+		this->DestroyUpdateTemplate();
+
+		std::vector<vk::DescriptorUpdateTemplateEntry> templateEntries;
+		for (const auto& write : this->descriptorWrites)
+		{
+			if (write.Count == 0)
+				continue;
+
+			templateEntries.push_back(vk::DescriptorUpdateTemplateEntry{
+				write.Binding,
 				0,
-				bufferInfo.Handle->GetByteSize(),
+				write.Count,
+				ToNative(write.Type),
+				this->GetDescriptorInfoIndex(write, 0) * sizeof(NativeDescriptorInfo),
+				sizeof(NativeDescriptorInfo),
 			});
 		}
 
-		for (const auto& imageInfo : this->imageWriteInfos)
+		vk::DescriptorUpdateTemplateCreateInfo templateCreateInfo;
+		templateCreateInfo
+			.setDescriptorUpdateEntries(templateEntries)
+			.setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet)
+			.setDescriptorSetLayout(setLayout);
+
+		this->updateTemplate = GetCurrentVulkanContext().GetDevice().createDescriptorUpdateTemplate(templateCreateInfo);
+		this->updateTemplateWrites = this->descriptorWrites;
+	}
+
+	void DescriptorBinding::DestroyUpdateTemplate()
+	{
+		if ((bool)this->updateTemplate)
+			GetCurrentVulkanContext().GetDevice().destroyDescriptorUpdateTemplate(this->updateTemplate);
+		this->updateTemplate = vk::DescriptorUpdateTemplate{ };
+		this->updateTemplateWrites.clear();
+	}
+
+	uint32_t DescriptorBinding::Write(ArrayView<const vk::DescriptorSet> descriptorSets, const vk::DescriptorSetLayout& setLayout, std::vector<vk::WriteDescriptorSet>& nativeWrites)
+	{
+		if (this->options == ResolveOptions::ALREADY_RESOLVED)
+			return 0;
+		if (this->options == ResolveOptions::RESOLVE_ONCE)
+			this->options = ResolveOptions::ALREADY_RESOLVED;
+
+		auto& vulkan = GetCurrentVulkanContext();
+		auto& descriptorInfos = this->nativeDescriptorInfos;
+		descriptorInfos.resize(this->imageWriteInfos.size() + this->bufferWriteInfos.size());
+
+		for (size_t i = 0; i < this->imageWriteInfos.size(); i++)
 		{
-			descriptorImageInfos.push_back(vk::DescriptorImageInfo{
+			const auto& imageInfo = this->imageWriteInfos[i];
+			descriptorInfos[i].Image = vk::DescriptorImageInfo{
 				imageInfo.SamplerHandle != nullptr ? imageInfo.SamplerHandle->GetNativeHandle() : nullptr,
 				imageInfo.Handle != nullptr ? imageInfo.Handle->GetNativeView(imageInfo.View) : nullptr,
 				ImageUsageToImageLayout(imageInfo.Usage),
-			});
+			};
 		}
 
+		for (size_t i = 0; i < this->bufferWriteInfos.size(); i++)
+		{
+			const auto& bufferInfo = this->bufferWriteInfos[i];
+			descriptorInfos[this->imageWriteInfos.size() + i].Buffer = vk::DescriptorBufferInfo{
+				bufferInfo.Handle->GetNativeHandle(),
+				0,
+				bufferInfo.Handle->GetByteSize(),
+			};
+		}
+
+		uint32_t descriptorCount = 0;
 		for (const auto& write : this->descriptorWrites)
+			descriptorCount += write.Count;
+		bool isTemplateSupported = (bool)setLayout && descriptorCount > 0 && vulkan.GetAPIVersion() >= VK_API_VERSION_1_1;
+		uint32_t updatedDescriptorCount = 0;
+
+		for (const auto& descriptorSet : descriptorSets)
 		{
-			auto& writeDescriptorSet = writesDescriptorSet.emplace_back();
-			writeDescriptorSet
-				.setDstSet(descriptorSet)
-				.setDstBinding(write.Binding)
-				.setDescriptorType(ToNative(write.Type))
-				.setDescriptorCount(write.Count);
-
-			if (IsBufferType(write.Type))
+			auto writtenSet = std::find_if(this->writtenSets.begin(), this->writtenSets.end(), [&descriptorSet](const WrittenDescriptorSet& written) { return written.Set == descriptorSet; });
+			if (writtenSet == this->writtenSets.end())
+				writtenSet = this->writtenSets.insert(this->writtenSets.end(), WrittenDescriptorSet{ descriptorSet });
+
+			// different array sizes shift indices of resolved resources, so everything is written again
+			bool isRewritten = writtenSet->Writes != this->descriptorWrites;
+			size_t firstWrite = nativeWrites.size();
+			uint32_t changedCount = isRewritten && isTemplateSupported ?
+				descriptorCount :
+				this->AppendChangedWrites(descriptorSet, isRewritten ? nullptr : &*writtenSet, nativeWrites);
+			if (changedCount == 0)
+				continue;
+
+			// when most of the set changed, whole payload is written by template instead of separate writes
+			if (isTemplateSupported && changedCount * 2 >= descriptorCount)
 			{
-				writeDescriptorSet.setPBufferInfo(descriptorBufferInfos.data() + write.FirstIndex);
+				nativeWrites.resize(firstWrite);
+				if (this->updateTemplateWrites != this->descriptorWrites)
+					this->RecreateUpdateTemplate(setLayout);
+				vulkan.GetDevice().updateDescriptorSetWithTemplate(descriptorSet, this->updateTemplate, descriptorInfos.data());
+				// template writes every descriptor of the set, not only changed ones
+				changedCount = descriptorCount;
 			}
-			else
-			{
-				writeDescriptorSet.setPImageInfo(descriptorImageInfos.data() + write.FirstIndex);
-			}
-		}
 
-		GetCurrentVulkanContext().GetDevice().updateDescriptorSets(writesDescriptorSet, { });
+			writtenSet->Writes = this->descriptorWrites;
+			writtenSet->DescriptorInfos = descriptorInfos;
+			updatedDescriptorCount += changedCount;
+		}
+		return updatedDescriptorCount;
 	}
 }
\ No newline at end of file
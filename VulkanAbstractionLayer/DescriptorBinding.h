@@ -30,6 +30,7 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "Buffer.h"
@@ -40,22 +41,52 @@
 
 namespace VulkanAbstractionLayer
 {
+	using ResourceHandle = uint32_t;
+	constexpr ResourceHandle INVALID_RESOURCE_HANDLE = ResourceHandle(-1);
+
+	// resource names are interned to dense handles, resolves of known names reuse storage kept between frames
 	class ResolveInfo
 	{
-		std::unordered_map<std::string, std::vector<BufferReference>> bufferResolves;
-		std::unordered_map<std::string, std::vector<ImageReference>> imageResolves;
+		std::vector<std::string> resourceNames; // indexed by handle
+		std::unordered_multimap<size_t, ResourceHandle> resourceHandles; // by hash of name, so lookup by string view does not allocate
+		std::vector<std::vector<BufferReference>> bufferResolves;
+		std::vector<std::vector<ImageReference>> imageResolves;
 
 	public:
-		void Resolve(const std::string& name, const Buffer& buffer);
-		void Resolve(const std::string& name, ArrayView<const Buffer> buffers);
-		void Resolve(const std::string& name, ArrayView<const BufferReference> buffers);
-
-		void Resolve(const std::string& name, const Image& image);
-		void Resolve(const std::string& name, ArrayView<const Image> images);
-		void Resolve(const std::string& name, ArrayView<const ImageReference> images);
+		ResourceHandle GetHandle(std::string_view name);
+		ResourceHandle FindHandle(std::string_view name) const;
+		const std::string& GetName(ResourceHandle handle) const { return this->resourceNames[handle]; }
+		// forgets resolved resources, but keeps handles and capacity
+		void Clear();
+
+		void Resolve(ResourceHandle handle, const Buffer& buffer);
+		void Resolve(ResourceHandle handle, ArrayView<const Buffer> buffers);
+		void Resolve(ResourceHandle handle, ArrayView<const BufferReference> buffers);
+
+		void Resolve(ResourceHandle handle, const Image& image);
+		void Resolve(ResourceHandle handle, ArrayView<const Image> images);
+		void Resolve(ResourceHandle handle, ArrayView<const ImageReference> images);
+
+		void Resolve(std::string_view name, const Buffer& buffer) { this->Resolve(this->GetHandle(name), buffer); }
+		void Resolve(std::string_view name, ArrayView<const Buffer> buffers) { this->Resolve(this->GetHandle(name), buffers); }
+		void Resolve(std::string_view name, ArrayView<const BufferReference> buffers) { this->Resolve(this->GetHandle(name), buffers); }
+
+		void Resolve(std::string_view name, const Image& image) { this->Resolve(this->GetHandle(name), image); }
+		void Resolve(std::string_view name, ArrayView<const Image> images) { this->Resolve(this->GetHandle(name), images); }
+		void Resolve(std::string_view name, ArrayView<const ImageReference> images) { this->Resolve(this->GetHandle(name), images); }
+
+		// resource must be resolved in current frame
+		ArrayView<const BufferReference> GetBuffers(ResourceHandle handle) const
+		{
+			assert(handle < this->bufferResolves.size() && !this->bufferResolves[handle].empty());
+			return this->bufferResolves[handle];
+		}
 
-		const auto& GetBuffers() const { return this->bufferResolves; }
-		const auto& GetImages() const { return this->imageResolves; }
+		ArrayView<const ImageReference> GetImages(ResourceHandle handle) const
+		{
+			assert(handle < this->imageResolves.size() && !this->imageResolves[handle].empty());
+			return this->imageResolves[handle];
+		}
 	};
 
 	enum class ResolveOptions
@@ -73,6 +104,11 @@ namespace VulkanAbstractionLayer
 			uint32_t Binding;
 			uint32_t FirstIndex;
 			uint32_t Count;
+
+			bool operator==(const DescriptorWriteInfo& other) const
+			{
+				return this->Type == other.Type && this->Binding == other.Binding && this->FirstIndex == other.FirstIndex && this->Count == other.Count;
+			}
 		};
 
 		struct BufferWriteInfo
@@ -92,6 +128,7 @@ namespace VulkanAbstractionLayer
 		struct ImageToResolve
 		{
 			std::string Name;
+			ResourceHandle Handle;
 			uint32_t Binding;
 			UniformType Type;
 			ImageUsage::Bits Usage;
@@ -102,6 +139,7 @@ namespace VulkanAbstractionLayer
 		struct BufferToResolve
 		{
 			std::string Name;
+			ResourceHandle Handle;
 			uint32_t Binding;
 			UniformType Type;
 			BufferUsage::Bits Usage;
@@ -114,6 +152,23 @@ namespace VulkanAbstractionLayer
 			UniformType Type;
 		};
 
+		// image and buffer infos share storage, so update template reads all of them from single payload
+		union NativeDescriptorInfo
+		{
+			vk::DescriptorImageInfo Image;
+			vk::DescriptorBufferInfo Buffer;
+
+			NativeDescriptorInfo() : Image() { }
+		};
+
+		// last content written to descriptor set, descriptors equal to it are not written again
+		struct WrittenDescriptorSet
+		{
+			vk::DescriptorSet Set;
+			std::vector<DescriptorWriteInfo> Writes;
+			std::vector<NativeDescriptorInfo> DescriptorInfos;
+		};
+
 		std::vector<DescriptorWriteInfo> descriptorWrites;
 		std::vector<BufferWriteInfo> bufferWriteInfos;
 		std::vector<ImageWriteInfo> imageWriteInfos;
@@ -121,12 +176,22 @@ namespace VulkanAbstractionLayer
 		std::vector<ImageToResolve> imagesToResolve;
 		std::vector<SamplerToResolve> samplersToResolve;
 
+		// native structures filled on each write, capacity is kept between frames
+		std::vector<NativeDescriptorInfo> nativeDescriptorInfos; // image infos followed by buffer infos
+		std::vector<WrittenDescriptorSet> writtenSets; // one per virtual frame set the binding was written to
+		vk::DescriptorUpdateTemplate updateTemplate;
+		std::vector<DescriptorWriteInfo> updateTemplateWrites; // template is recreated if resolved array sizes change
+
 		ResolveOptions options = ResolveOptions::RESOLVE_EACH_FRAME;
 
 		size_t AllocateBinding(const Buffer& buffer, UniformType type);
 		size_t AllocateBinding(const Image& image, ImageView view, UniformType type);
 		size_t AllocateBinding(const Image& image, const Sampler& sampler, ImageView view, UniformType type);
 		size_t AllocateBinding(const Sampler& sampler);
+		size_t GetDescriptorInfoIndex(const DescriptorWriteInfo& write, uint32_t element) const;
+		bool IsDescriptorChanged(const WrittenDescriptorSet& writtenSet, const DescriptorWriteInfo& write, uint32_t element) const;
+		uint32_t AppendChangedWrites(const vk::DescriptorSet& descriptorSet, const WrittenDescriptorSet* writtenSet, std::vector<vk::WriteDescriptorSet>& nativeWrites) const;
+		void RecreateUpdateTemplate(const vk::DescriptorSetLayout& setLayout);
 	public:
 		DescriptorBinding& Bind(uint32_t binding, const std::string& name, UniformType type);
 		DescriptorBinding& Bind(uint32_t binding, const std::string& name, UniformType type, ImageView view);
@@ -136,10 +201,19 @@ namespace VulkanAbstractionLayer
 		DescriptorBinding& Bind(uint32_t binding, const Sampler& sampler, UniformType type);
 
 		void SetOptions(ResolveOptions options) { this->options = options; }
+		ResolveOptions GetOptions() const { return this->options; }
 
+		// handles are valid only for resolve info they were interned in, other ones are searched by name
+		void InternNames(ResolveInfo& resolveInfo);
 		void Resolve(const ResolveInfo& resolveInfo);
 
-		void Write(const vk::DescriptorSet& descriptorSet);
+		// appends writes of descriptors changed since last write to each set, they point to storage valid until next write of this binding
+		// set in which most descriptors changed is updated immediately with update template created for its layout, returns count of updated descriptors
+		uint32_t Write(ArrayView<const vk::DescriptorSet> descriptorSets, const vk::DescriptorSetLayout& setLayout, std::vector<vk::WriteDescriptorSet>& nativeWrites);
+		// binding is copied with pipeline, so template is destroyed by owner of the last copy
+		void DestroyUpdateTemplate();
+		// resources may be recreated under the same handles, next write updates every descriptor
+		void InvalidateWrites() { this->writtenSets.clear(); }
 		const auto& GetBoundBuffers() const { return this->buffersToResolve; }
 		const auto& GetBoundImages() const { return this->imagesToResolve; }
 	};
@@ -31,56 +31,46 @@
 
 namespace VulkanAbstractionLayer
 {
-	void DescriptorCache::Init()
-	{
-        auto& vulkan = GetCurrentVulkanContext();
-        // TODO: rework
-        std::array descriptorPoolSizes = {
-            vk::DescriptorPoolSize { vk::DescriptorType::eSampler,              1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eCombinedImageSampler, 1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eSampledImage,         1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eStorageImage,         1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eUniformTexelBuffer,   1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eStorageTexelBuffer,   1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eUniformBuffer,        1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eStorageBuffer,        1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eUniformBufferDynamic, 1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eStorageBufferDynamic, 1024 },
-            vk::DescriptorPoolSize { vk::DescriptorType::eInputAttachment,      1024 },
-        };
-        vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
-        descriptorPoolCreateInfo
-            .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
-            .setPoolSizes(descriptorPoolSizes)
-            .setMaxSets(2048 * (uint32_t)descriptorPoolSizes.size());
-
-        this->descriptorPool = vulkan.GetDevice().createDescriptorPool(descriptorPoolCreateInfo);
-	}
+    void DescriptorCache::Init()
+    {
+        // pools are created on first allocation, when shaders which use them are known
+    }
 
     void DescriptorCache::Destroy()
     {
         auto& vulkan = GetCurrentVulkanContext();
-        if ((bool)this->descriptorPool) vulkan.GetDevice().destroyDescriptorPool(this->descriptorPool);
+        for (const auto& pool : this->descriptorPools)
+            vulkan.GetDevice().destroyDescriptorPool(pool.Pool);
+        this->descriptorPools.clear();
+        this->descriptorSetPools.clear();
+        this->descriptorTypeHistogram.clear();
+        this->histogramSetCount = 0;
 
-        for (const auto& descriptor : this->cache)
+        for (const auto& [hash, pipelineLayout] : this->pipelineLayouts)
+            vulkan.GetDevice().destroyPipelineLayout(pipelineLayout.PipelineLayout);
+        this->pipelineLayouts.clear();
+
+        for (const auto& [hash, setLayout] : this->setLayouts)
         {
-            this->DestroyDescriptorSetLayout(descriptor.SetLayout);
+            this->DestroyDescriptorSetLayout(setLayout.SetLayout);
             // descriptor sets are already freed when pool is destroyed
         }
-        this->cache.clear();
+        this->setLayouts.clear();
     }
 
-    vk::DescriptorSetLayout DescriptorCache::CreateDescriptorSetLayout(ArrayView<const ShaderUniforms> specification)
+    static void HashCombine(size_t& seed, size_t value)
     {
-        auto& vulkan = GetCurrentVulkanContext();
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
 
+    // bindings are merged over shader stages and sorted, so equal specifications produce equal descriptions
+    static std::vector<vk::DescriptorSetLayoutBinding> GetLayoutBindings(ArrayView<const ShaderUniforms> specification)
+    {
         std::vector<vk::DescriptorSetLayoutBinding> layoutBindings;
-        std::vector<vk::DescriptorBindingFlags> bindingFlags;
         size_t totalUniformCount = 0;
         for (const auto& uniformsPerStage : specification)
             totalUniformCount += uniformsPerStage.Uniforms.size();
         layoutBindings.reserve(totalUniformCount);
-        bindingFlags.reserve(totalUniformCount);
 
         for (const auto& uniformsPerStage : specification)
         {
@@ -103,36 +93,176 @@ namespace VulkanAbstractionLayer
                     uniform.Count,
                     ToNative(uniformsPerStage.ShaderStage)
                 });
-
-                vk::DescriptorBindingFlags descriptorBindingFlags = { };
-                descriptorBindingFlags |= vk::DescriptorBindingFlagBits::eUpdateAfterBind;
-                if (uniform.Count > 1)
-                    descriptorBindingFlags |= vk::DescriptorBindingFlagBits::ePartiallyBound;
-                bindingFlags.push_back(descriptorBindingFlags);
             }
         }
 
+        std::sort(layoutBindings.begin(), layoutBindings.end(), [](const auto& left, const auto& right) { return left.binding < right.binding; });
+        return layoutBindings;
+    }
+
+    static size_t ComputeLayoutHash(ArrayView<const vk::DescriptorSetLayoutBinding> layoutBindings)
+    {
+        size_t hash = layoutBindings.size();
+        for (const auto& layoutBinding : layoutBindings)
+        {
+            HashCombine(hash, layoutBinding.binding);
+            HashCombine(hash, (size_t)layoutBinding.descriptorType);
+            HashCombine(hash, layoutBinding.descriptorCount);
+            HashCombine(hash, (size_t)(VkShaderStageFlags)layoutBinding.stageFlags);
+        }
+        return hash;
+    }
+
+    vk::DescriptorSetLayout DescriptorCache::CreateDescriptorSetLayout(ArrayView<const vk::DescriptorSetLayoutBinding> layoutBindings)
+    {
+        auto& vulkan = GetCurrentVulkanContext();
+
+        std::vector<vk::DescriptorBindingFlags> bindingFlags;
+        bindingFlags.reserve(layoutBindings.size());
+        for (const auto& layoutBinding : layoutBindings)
+        {
+            vk::DescriptorBindingFlags descriptorBindingFlags = { };
+            descriptorBindingFlags |= vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+            if (layoutBinding.descriptorCount > 1)
+                descriptorBindingFlags |= vk::DescriptorBindingFlagBits::ePartiallyBound;
+            bindingFlags.push_back(descriptorBindingFlags);
+        }
+
         vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo;
         bindingFlagsCreateInfo.setBindingFlags(bindingFlags);
 
         vk::DescriptorSetLayoutCreateInfo layoutCreateInfo;
         layoutCreateInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
-        layoutCreateInfo.setBindings(layoutBindings);
+        layoutCreateInfo.setBindingCount((uint32_t)layoutBindings.size());
+        layoutCreateInfo.setPBindings(layoutBindings.data());
         layoutCreateInfo.setPNext(&bindingFlagsCreateInfo);
 
         return vulkan.GetDevice().createDescriptorSetLayout(layoutCreateInfo);
     }
 
-    vk::DescriptorSet DescriptorCache::AllocateDescriptorSet(vk::DescriptorSetLayout layout)
+    const DescriptorCache::CachedSetLayout& DescriptorCache::AcquireDescriptorSetLayout(ArrayView<const ShaderUniforms> specification)
     {
-        auto& vulkan = GetCurrentVulkanContext();
+        auto layoutBindings = GetLayoutBindings(specification);
+        auto hash = ComputeLayoutHash(layoutBindings);
+
+        auto [first, last] = this->setLayouts.equal_range(hash);
+        for (auto cached = first; cached != last; cached++)
+        {
+            if (cached->second.Bindings == layoutBindings)
+            {
+                cached->second.ReferenceCount++;
+                return cached->second;
+            }
+        }
+
+        auto setLayout = this->CreateDescriptorSetLayout(layoutBindings);
+        return this->setLayouts.emplace(hash, CachedSetLayout{ std::move(layoutBindings), setLayout, 1 })->second;
+    }
+
+    DescriptorCache::SetLayoutMap::iterator DescriptorCache::FindDescriptorSetLayout(vk::DescriptorSetLayout layout)
+    {
+        auto cached = std::find_if(this->setLayouts.begin(), this->setLayouts.end(), [layout](const auto& entry) { return entry.second.SetLayout == layout; });
+        assert(cached != this->setLayouts.end());
+        return cached;
+    }
+
+    void DescriptorCache::ReleaseDescriptorSetLayout(vk::DescriptorSetLayout layout)
+    {
+        auto cached = this->FindDescriptorSetLayout(layout);
+        if (--cached->second.ReferenceCount > 0)
+            return;
+
+        this->DestroyDescriptorSetLayout(layout);
+        this->setLayouts.erase(cached);
+    }
+
+    static uint32_t CountDescriptors(ArrayView<const vk::DescriptorSetLayoutBinding> layoutBindings)
+    {
+        uint32_t descriptorCount = 0;
+        for (const auto& layoutBinding : layoutBindings)
+            descriptorCount += layoutBinding.descriptorCount;
+        return descriptorCount;
+    }
+
+    // descriptor types keep proportions of all sets allocated so far, pool can hold at least one set of requested layout
+    DescriptorCache::DescriptorPoolBlock DescriptorCache::CreateDescriptorPool(ArrayView<const vk::DescriptorSetLayoutBinding> layoutBindings, uint32_t setCapacity, vk::DescriptorPoolCreateFlags flags)
+    {
+        std::unordered_map<vk::DescriptorType, uint32_t> layoutTypeCounts;
+        for (const auto& layoutBinding : layoutBindings)
+            layoutTypeCounts[layoutBinding.descriptorType] += layoutBinding.descriptorCount;
+
+        std::unordered_map<vk::DescriptorType, uint32_t> poolTypeCounts;
+        for (const auto& [type, count] : this->descriptorTypeHistogram)
+            poolTypeCounts[type] = (uint32_t)((count * setCapacity + this->histogramSetCount - 1) / this->histogramSetCount);
+        for (const auto& [type, count] : layoutTypeCounts)
+            poolTypeCounts[type] = std::max(poolTypeCounts[type], this->histogramSetCount == 0 ? count * setCapacity : count);
+
+        std::vector<vk::DescriptorPoolSize> poolSizes;
+        uint32_t descriptorCapacity = 0;
+        for (const auto& [type, count] : poolTypeCounts)
+        {
+            poolSizes.push_back(vk::DescriptorPoolSize{ type, count });
+            descriptorCapacity += count;
+        }
+        // layouts without bindings still need pool with at least one pool size
+        if (poolSizes.empty())
+            poolSizes.push_back(vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 });
+
+        vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
+        descriptorPoolCreateInfo
+            .setFlags(flags | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+            .setPoolSizes(poolSizes)
+            .setMaxSets(setCapacity);
+
+        auto pool = GetCurrentVulkanContext().GetDevice().createDescriptorPool(descriptorPoolCreateInfo);
+        return DescriptorPoolBlock{ pool, setCapacity, descriptorCapacity };
+    }
+
+    bool DescriptorCache::TryAllocateDescriptorSet(DescriptorPoolBlock& pool, const CachedSetLayout& setLayout, vk::DescriptorSet& set)
+    {
+        if (pool.AllocatedSetCount == pool.SetCapacity)
+            return false;
 
         vk::DescriptorSetAllocateInfo descriptorAllocateInfo;
         descriptorAllocateInfo
-            .setDescriptorPool(this->descriptorPool)
-            .setSetLayouts(layout);
+            .setDescriptorPool(pool.Pool)
+            .setSetLayouts(setLayout.SetLayout);
+
+        // exhausted or fragmented pool is skipped, allocation continues with the next one, any other error is reported as with other device calls
+        auto result = GetCurrentVulkanContext().GetDevice().allocateDescriptorSets(&descriptorAllocateInfo, &set);
+        if (result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool)
+            return false;
+        if (result != vk::Result::eSuccess)
+            throw vk::SystemError(vk::make_error_code(result), "vk::Device::allocateDescriptorSets");
 
-        return vulkan.GetDevice().allocateDescriptorSets(descriptorAllocateInfo).front();
+        pool.AllocatedSetCount++;
+        pool.AllocatedDescriptorCount += CountDescriptors(setLayout.Bindings);
+        return true;
+    }
+
+    vk::DescriptorSet DescriptorCache::AllocateDescriptorSet(const CachedSetLayout& setLayout)
+    {
+        const uint32_t MinPoolSetCapacity = 64;
+        const uint32_t MaxPoolSetCapacity = 1024;
+
+        vk::DescriptorSet descriptorSet;
+        for (size_t poolIndex = this->descriptorPools.size(); poolIndex > 0; poolIndex--)
+        {
+            // newest pool is tried first, older ones only have space left by freed sets
+            if (this->TryAllocateDescriptorSet(this->descriptorPools[poolIndex - 1], setLayout, descriptorSet))
+            {
+                this->descriptorSetPools.emplace((VkDescriptorSet)descriptorSet, poolIndex - 1);
+                return descriptorSet;
+            }
+        }
+
+        // each new pool is twice as large, so scene with many passes ends up with few pools
+        uint32_t setCapacity = std::min(MinPoolSetCapacity << std::min(this->descriptorPools.size(), (size_t)4), MaxPoolSetCapacity);
+        auto& pool = this->descriptorPools.emplace_back(this->CreateDescriptorPool(setLayout.Bindings, setCapacity, vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet));
+        bool isAllocated = this->TryAllocateDescriptorSet(pool, setLayout, descriptorSet);
+        assert(isAllocated);
+        this->descriptorSetPools.emplace((VkDescriptorSet)descriptorSet, this->descriptorPools.size() - 1);
+        return descriptorSet;
     }
 
     void DescriptorCache::DestroyDescriptorSetLayout(vk::DescriptorSetLayout layout)
@@ -140,15 +270,104 @@ namespace VulkanAbstractionLayer
         GetCurrentVulkanContext().GetDevice().destroyDescriptorSetLayout(layout);
     }
 
-    void DescriptorCache::FreeDescriptorSet(vk::DescriptorSet set)
+    void DescriptorCache::FreeDescriptorSet(vk::DescriptorSet set, vk::DescriptorSetLayout layout)
     {
-        GetCurrentVulkanContext().GetDevice().freeDescriptorSets(this->descriptorPool, set);
+        auto setPool = this->descriptorSetPools.find((VkDescriptorSet)set);
+        assert(setPool != this->descriptorSetPools.end());
+        auto& pool = this->descriptorPools[setPool->second];
+
+        GetCurrentVulkanContext().GetDevice().freeDescriptorSets(pool.Pool, set);
+        pool.AllocatedSetCount--;
+        pool.AllocatedDescriptorCount -= CountDescriptors(this->FindDescriptorSetLayout(layout)->second.Bindings);
+        this->descriptorSetPools.erase(setPool);
     }
 
     DescriptorCache::Descriptor DescriptorCache::GetDescriptor(ArrayView<const ShaderUniforms> specification)
     {
-        auto descriptorSetLayout = this->CreateDescriptorSetLayout(specification);
-        auto descriptorSet = this->AllocateDescriptorSet(descriptorSetLayout);
-        return this->cache.emplace_back(Descriptor{ descriptorSetLayout, descriptorSet });
+        const auto& setLayout = this->AcquireDescriptorSetLayout(specification);
+        for (const auto& layoutBinding : setLayout.Bindings)
+            this->descriptorTypeHistogram[layoutBinding.descriptorType] += layoutBinding.descriptorCount;
+        this->histogramSetCount++;
+
+        auto descriptorSet = this->AllocateDescriptorSet(setLayout);
+        return Descriptor{ setLayout.SetLayout, descriptorSet };
+    }
+
+    void DescriptorCache::ReleaseDescriptor(const Descriptor& descriptor)
+    {
+        this->FreeDescriptorSet(descriptor.Set, descriptor.SetLayout);
+        this->ReleaseDescriptorSetLayout(descriptor.SetLayout);
+    }
+
+    DescriptorPoolStatistics DescriptorCache::GetPoolStatistics() const
+    {
+        DescriptorPoolStatistics statistics;
+        for (const auto& pool : this->descriptorPools)
+        {
+            statistics.PoolCount++;
+            statistics.AllocatedSetCount += pool.AllocatedSetCount;
+            statistics.SetCapacity += pool.SetCapacity;
+            statistics.AllocatedDescriptorCount += pool.AllocatedDescriptorCount;
+            statistics.DescriptorCapacity += pool.DescriptorCapacity;
+        }
+        return statistics;
+    }
+
+    vk::PipelineLayout DescriptorCache::GetPipelineLayout(vk::DescriptorSetLayout setLayout, ArrayView<const vk::PushConstantRange> pushConstantRanges, vk::DescriptorSetLayout resourceHeapLayout)
+    {
+        size_t hash = std::hash<VkDescriptorSetLayout>{ }((VkDescriptorSetLayout)setLayout);
+        HashCombine(hash, std::hash<VkDescriptorSetLayout>{ }((VkDescriptorSetLayout)resourceHeapLayout));
+        for (const auto& pushConstantRange : pushConstantRanges)
+        {
+            HashCombine(hash, pushConstantRange.offset);
+            HashCombine(hash, pushConstantRange.size);
+            HashCombine(hash, (size_t)(VkShaderStageFlags)pushConstantRange.stageFlags);
+        }
+
+        auto [first, last] = this->pipelineLayouts.equal_range(hash);
+        for (auto cached = first; cached != last; cached++)
+        {
+            auto& cachedRanges = cached->second.PushConstantRanges;
+            if (cached->second.SetLayout == setLayout && cached->second.ResourceHeapLayout == resourceHeapLayout && std::equal(cachedRanges.begin(), cachedRanges.end(), pushConstantRanges.begin(), pushConstantRanges.end()))
+            {
+                cached->second.ReferenceCount++;
+                return cached->second.PipelineLayout;
+            }
+        }
+
+        // resource heap is bound after pass descriptors, as set RESOURCE_HEAP_SET, its capacity leaves room only for reserved count of them
+        if ((bool)resourceHeapLayout && CountDescriptors(this->FindDescriptorSetLayout(setLayout)->second.Bindings) > GetCurrentVulkanContext().GetResourceHeap().GetReservedPassDescriptorCount())
+            throw vk::SystemError(vk::make_error_code(vk::Result::eErrorOutOfPoolMemory), "pass descriptors exceed ResourceHeapReservedPassDescriptorCount");
+        std::array setLayouts = { setLayout, resourceHeapLayout };
+        vk::PipelineLayoutCreateInfo layoutCreateInfo;
+        layoutCreateInfo
+            .setSetLayoutCount((bool)resourceHeapLayout ? 2u : 1u)
+            .setPSetLayouts(setLayouts.data())
+            .setPushConstantRangeCount((uint32_t)pushConstantRanges.size())
+            .setPPushConstantRanges(pushConstantRanges.data());
+
+        auto pipelineLayout = GetCurrentVulkanContext().GetDevice().createPipelineLayout(layoutCreateInfo);
+        this->FindDescriptorSetLayout(setLayout)->second.ReferenceCount++;
+        this->pipelineLayouts.emplace(hash, CachedPipelineLayout{
+            setLayout,
+            resourceHeapLayout,
+            std::vector<vk::PushConstantRange>(pushConstantRanges.begin(), pushConstantRanges.end()),
+            pipelineLayout,
+            1
+        });
+        return pipelineLayout;
+    }
+
+    void DescriptorCache::ReleasePipelineLayout(vk::PipelineLayout layout)
+    {
+        auto cached = std::find_if(this->pipelineLayouts.begin(), this->pipelineLayouts.end(), [layout](const auto& entry) { return entry.second.PipelineLayout == layout; });
+        assert(cached != this->pipelineLayouts.end());
+        if (--cached->second.ReferenceCount > 0)
+            return;
+
+        auto setLayout = cached->second.SetLayout;
+        GetCurrentVulkanContext().GetDevice().destroyPipelineLayout(layout);
+        this->pipelineLayouts.erase(cached);
+        this->ReleaseDescriptorSetLayout(setLayout);
     }
 }
\ No newline at end of file
@@ -29,12 +29,22 @@
 #pragma once
 
 #include <vulkan/vulkan.hpp>
+#include <unordered_map>
 
 #include "ShaderReflection.h"
 #include "ArrayUtils.h"
 
 namespace VulkanAbstractionLayer
 {
+	struct DescriptorPoolStatistics
+	{
+		size_t PoolCount = 0;
+		size_t AllocatedSetCount = 0;
+		size_t SetCapacity = 0;
+		size_t AllocatedDescriptorCount = 0;
+		size_t DescriptorCapacity = 0;
+	};
+
 	class DescriptorCache
 	{
 	public:
@@ -45,19 +55,66 @@ namespace VulkanAbstractionLayer
 		};
 
 	private:
-		vk::DescriptorPool descriptorPool;
-		std::vector<Descriptor> cache;
+		struct CachedSetLayout
+		{
+			std::vector<vk::DescriptorSetLayoutBinding> Bindings; // sorted by binding index
+			vk::DescriptorSetLayout SetLayout;
+			size_t ReferenceCount;
+		};
+
+		struct CachedPipelineLayout
+		{
+			vk::DescriptorSetLayout SetLayout;
+			vk::DescriptorSetLayout ResourceHeapLayout; // not owned by cache, empty if pipeline does not use resource heap
+			std::vector<vk::PushConstantRange> PushConstantRanges;
+			vk::PipelineLayout PipelineLayout;
+			size_t ReferenceCount;
+		};
+
+		struct DescriptorPoolBlock
+		{
+			vk::DescriptorPool Pool;
+			uint32_t SetCapacity;
+			uint32_t DescriptorCapacity;
+			uint32_t AllocatedSetCount = 0;
+			uint32_t AllocatedDescriptorCount = 0;
+		};
+
+		using SetLayoutMap = std::unordered_multimap<size_t, CachedSetLayout>;
 
-		vk::DescriptorSetLayout CreateDescriptorSetLayout(ArrayView<const ShaderUniforms> specification);
-		vk::DescriptorSet AllocateDescriptorSet(vk::DescriptorSetLayout layout);
+		std::vector<DescriptorPoolBlock> descriptorPools;
+		std::unordered_map<VkDescriptorSet, size_t> descriptorSetPools;
+		// descriptors of each type requested by all sets allocated so far, new pools are sized by it
+		std::unordered_map<vk::DescriptorType, size_t> descriptorTypeHistogram;
+		size_t histogramSetCount = 0;
+		// keyed by hash of canonical description, equal layouts are created once and shared
+		SetLayoutMap setLayouts;
+		std::unordered_multimap<size_t, CachedPipelineLayout> pipelineLayouts;
+
+		vk::DescriptorSetLayout CreateDescriptorSetLayout(ArrayView<const vk::DescriptorSetLayoutBinding> layoutBindings);
+		const CachedSetLayout& AcquireDescriptorSetLayout(ArrayView<const ShaderUniforms> specification);
+		void ReleaseDescriptorSetLayout(vk::DescriptorSetLayout layout);
+		SetLayoutMap::iterator FindDescriptorSetLayout(vk::DescriptorSetLayout layout);
+		DescriptorPoolBlock CreateDescriptorPool(ArrayView<const vk::DescriptorSetLayoutBinding> layoutBindings, uint32_t setCapacity, vk::DescriptorPoolCreateFlags flags);
+		bool TryAllocateDescriptorSet(DescriptorPoolBlock& pool, const CachedSetLayout& setLayout, vk::DescriptorSet& set);
+		vk::DescriptorSet AllocateDescriptorSet(const CachedSetLayout& setLayout);
 		void DestroyDescriptorSetLayout(vk::DescriptorSetLayout layout);
-		void FreeDescriptorSet(vk::DescriptorSet set);
+		void FreeDescriptorSet(vk::DescriptorSet set, vk::DescriptorSetLayout layout);
 	public:
 
 		void Init();
 		void Destroy();
 
-		const auto& GetDescriptorPool() const { return this->descriptorPool; }
+		// set is allocated for each call, layout is shared by all specifications with the same bindings
 		Descriptor GetDescriptor(ArrayView<const ShaderUniforms> specification);
+		void ReleaseDescriptor(const Descriptor& descriptor);
+		// pipeline layout references set layout, so both are destroyed when last pipeline layout using them is released
+		// vk::SystemError is thrown if set layout of pass using resource heap has more descriptors than reserved for it
+		vk::PipelineLayout GetPipelineLayout(vk::DescriptorSetLayout setLayout, ArrayView<const vk::PushConstantRange> pushConstantRanges, vk::DescriptorSetLayout resourceHeapLayout = { });
+		void ReleasePipelineLayout(vk::PipelineLayout layout);
+
+		size_t GetDescriptorSetLayoutCount() const { return this->setLayouts.size(); }
+		size_t GetPipelineLayoutCount() const { return this->pipelineLayouts.size(); }
+		DescriptorPoolStatistics GetPoolStatistics() const;
 	};
 }
\ No newline at end of file
@@ -73,8 +73,11 @@ namespace VulkanAbstractionLayer
         tessEvalShaderInfo.setCode(tessEval.Bytecode);
         this->tessEvalShader = device.createShaderModule(tessEvalShaderInfo);
         
+        assert(tessControl.DescriptorSets.size() <= RESOURCE_HEAP_SET + 1);
+        assert(tessEval.DescriptorSets.size() <= RESOURCE_HEAP_SET + 1);
         this->shaderUniforms.push_back(ShaderUniforms{ tessControl.DescriptorSets[0], ShaderType::TESS_CONTROL });
         this->shaderUniforms.push_back(ShaderUniforms{ tessEval.DescriptorSets[0], ShaderType::TESS_EVALUATION });
+        this->usesResourceHeap |= tessControl.DescriptorSets.size() > RESOURCE_HEAP_SET || tessEval.DescriptorSets.size() > RESOURCE_HEAP_SET;
         
     }
 
@@ -91,13 +94,14 @@ namespace VulkanAbstractionLayer
         this->fragmentShader = vulkan.GetDevice().createShaderModule(fragmentShaderInfo);
 
         this->inputAttributes = vertex.InputAttributes;
-        // TODO: support multiple descriptor sets
-        assert(vertex.DescriptorSets.size() < 2);
-        assert(fragment.DescriptorSets.size() < 2);
+        // TODO: support multiple descriptor sets, only the second one can be used for global resource heap
+        assert(vertex.DescriptorSets.size() <= RESOURCE_HEAP_SET + 1);
+        assert(fragment.DescriptorSets.size() <= RESOURCE_HEAP_SET + 1);
         this->shaderUniforms = std::vector{
             ShaderUniforms{ vertex.DescriptorSets[0], ShaderType::VERTEX },
             ShaderUniforms{ fragment.DescriptorSets[0], ShaderType::FRAGMENT },
         };
+        this->usesResourceHeap = vertex.DescriptorSets.size() > RESOURCE_HEAP_SET || fragment.DescriptorSets.size() > RESOURCE_HEAP_SET;
     }
 
     GraphicShader::GraphicShader(GraphicShader&& other) noexcept
@@ -106,6 +110,7 @@ namespace VulkanAbstractionLayer
         this->fragmentShader = other.fragmentShader;
         this->inputAttributes = std::move(other.inputAttributes);
         this->shaderUniforms = std::move(other.shaderUniforms);
+        this->usesResourceHeap = other.usesResourceHeap;
 
         other.vertexShader = vk::ShaderModule{ };
         other.fragmentShader = vk::ShaderModule{ };
@@ -127,6 +132,7 @@ namespace VulkanAbstractionLayer
         this->fragmentShader = other.fragmentShader;
         this->inputAttributes = std::move(other.inputAttributes);
         this->shaderUniforms = std::move(other.shaderUniforms);
+        this->usesResourceHeap = other.usesResourceHeap;
 
         other.vertexShader = vk::ShaderModule{ };
         other.fragmentShader = vk::ShaderModule{ };
@@ -39,6 +39,7 @@ namespace VulkanAbstractionLayer
         vk::ShaderModule tessControlShader;
         vk::ShaderModule tessEvalShader;
         std::vector<ShaderUniforms> shaderUniforms;
+        bool usesResourceHeap = false;
         std::vector<TypeSPIRV> inputAttributes;
 
         void Destroy();
@@ -59,5 +60,6 @@ namespace VulkanAbstractionLayer
         ArrayView<const TypeSPIRV> GetInputAttributes() const override;
         ArrayView<const ShaderUniforms> GetShaderUniforms() const override;
         virtual const vk::ShaderModule& GetNativeShader(ShaderType type) const override;
+        bool UsesResourceHeap() const override { return this->usesResourceHeap; }
     };
 }
\ No newline at end of file
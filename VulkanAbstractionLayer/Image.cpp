@@ -80,7 +80,7 @@ namespace VulkanAbstractionLayer
         case VulkanAbstractionLayer::ImageUsage::DEPTH_SPENCIL_ATTACHMENT:
             return vk::ImageLayout::eDepthStencilAttachmentOptimal;
         case VulkanAbstractionLayer::ImageUsage::INPUT_ATTACHMENT:
-            return vk::ImageLayout::eAttachmentOptimalKHR; // TODO: is it ok?
+            return vk::ImageLayout::eShaderReadOnlyOptimal;
         case VulkanAbstractionLayer::ImageUsage::FRAGMENT_SHADING_RATE_ATTACHMENT:
             return vk::ImageLayout::eFragmentShadingRateAttachmentOptimalKHR;
         default:
@@ -117,6 +117,25 @@ namespace VulkanAbstractionLayer
         }
     }
 
+    // synchronization2 distinguishes shader accesses by descriptor type, other bits are shared with legacy flags
+    vk::AccessFlags2KHR ImageUsageToAccessFlags2(ImageUsage::Bits layout)
+    {
+        switch (layout)
+        {
+        case ImageUsage::SHADER_READ:
+            return vk::AccessFlagBits2KHR::eShaderSampledRead;
+        case ImageUsage::STORAGE:
+            return vk::AccessFlagBits2KHR::eShaderStorageRead | vk::AccessFlagBits2KHR::eShaderStorageWrite;
+        default:
+            return vk::AccessFlags2KHR{ (VkFlags64)(VkAccessFlags)ImageUsageToAccessFlags(layout) };
+        }
+    }
+
+    vk::PipelineStageFlags2KHR ImageUsageToPipelineStage2(ImageUsage::Bits layout)
+    {
+        return vk::PipelineStageFlags2KHR{ (VkFlags64)(VkPipelineStageFlags)ImageUsageToPipelineStage(layout) };
+    }
+
     vk::PipelineStageFlags ImageUsageToPipelineStage(ImageUsage::Bits layout)
     {
         switch (layout)
@@ -134,7 +153,7 @@ namespace VulkanAbstractionLayer
         case ImageUsage::COLOR_ATTACHMENT:
             return vk::PipelineStageFlagBits::eColorAttachmentOutput;
         case ImageUsage::DEPTH_SPENCIL_ATTACHMENT:
-            return vk::PipelineStageFlagBits::eEarlyFragmentTests; // TODO: whats for late fragment test?
+            return vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
         case ImageUsage::INPUT_ATTACHMENT:
             return vk::PipelineStageFlagBits::eFragmentShader; // TODO: check if at least works
         case ImageUsage::FRAGMENT_SHADING_RATE_ATTACHMENT:
@@ -193,6 +212,36 @@ namespace VulkanAbstractionLayer
             return 1;
     }
 
+    static vk::ImageCreateInfo GetImageCreateInfo(uint32_t width, uint32_t height, Format format, ImageUsage::Value usage, ImageOptions::Value options)
+    {
+        vk::ImageCreateInfo imageCreateInfo;
+        imageCreateInfo
+            .setImageType(vk::ImageType::e2D)
+            .setFormat(ToNative(format))
+            .setExtent(vk::Extent3D{ width, height, 1 })
+            .setSamples(vk::SampleCountFlagBits::e1)
+            .setMipLevels(CalculateImageMipLevelCount(options, width, height))
+            .setArrayLayers(CalculateImageLayerCount(options))
+            .setTiling(vk::ImageTiling::eOptimal)
+            .setUsage((vk::ImageUsageFlags)usage)
+            .setSharingMode(vk::SharingMode::eExclusive)
+            .setInitialLayout(vk::ImageLayout::eUndefined);
+
+        if (options & ImageOptions::CUBEMAP)
+            imageCreateInfo.setFlags(vk::ImageCreateFlagBits::eCubeCompatible);
+
+        return imageCreateInfo;
+    }
+
+    vk::MemoryRequirements GetImageMemoryRequirements(uint32_t width, uint32_t height, Format format, ImageUsage::Value usage, ImageOptions::Value options)
+    {
+        auto& device = GetCurrentVulkanContext().GetDevice();
+        auto image = device.createImage(GetImageCreateInfo(width, height, format, usage, options));
+        auto memoryRequirements = device.getImageMemoryRequirements(image);
+        device.destroyImage(image);
+        return memoryRequirements;
+    }
+
     void Image::Destroy()
     {
         if ((bool)this->handle)
@@ -201,6 +250,10 @@ namespace VulkanAbstractionLayer
             {
                 DeallocateImage(this->handle, this->allocation);
             }
+            else if (this->isMemoryAliased) // bound to external memory
+            {
+                GetCurrentVulkanContext().GetDevice().destroyImage(this->handle);
+            }
 
             GetCurrentVulkanContext().GetDevice().destroyImageView(this->defaultImageViews.NativeView);
             if ((bool)this->defaultImageViews.DepthOnlyView)
@@ -223,6 +276,7 @@ namespace VulkanAbstractionLayer
             this->extent = vk::Extent2D{ 0u, 0u };
             this->mipLevelCount = 1;
             this->layerCount = 1;
+            this->isMemoryAliased = false;
         }
     }
 
@@ -320,6 +374,11 @@ namespace VulkanAbstractionLayer
         this->InitViews(image, format);
     }
 
+    Image::Image(uint32_t width, uint32_t height, Format format, ImageUsage::Value usage, ImageOptions::Value options, VmaAllocation memory, size_t memoryOffset)
+    {
+        this->InitAliased(width, height, format, usage, options, memory, memoryOffset);
+    }
+
     Image::Image(Image&& other) noexcept
     {
         this->handle = other.handle;
@@ -330,6 +389,7 @@ namespace VulkanAbstractionLayer
         this->allocation = other.allocation;
         this->mipLevelCount = other.mipLevelCount;
         this->layerCount = other.layerCount;
+        this->isMemoryAliased = other.isMemoryAliased;
 
         other.handle = vk::Image{ };
         other.defaultImageViews = { };
@@ -339,6 +399,7 @@ namespace VulkanAbstractionLayer
         other.allocation = { };
         other.mipLevelCount = 1;
         other.layerCount = 1;
+        other.isMemoryAliased = false;
     }
 
     Image& Image::operator=(Image&& other) noexcept
@@ -353,6 +414,7 @@ namespace VulkanAbstractionLayer
         this->allocation = other.allocation;
         this->mipLevelCount = other.mipLevelCount;
         this->layerCount = other.layerCount;
+        this->isMemoryAliased = other.isMemoryAliased;
 
         other.handle = vk::Image{ };
         other.defaultImageViews = { };
@@ -362,6 +424,7 @@ namespace VulkanAbstractionLayer
         other.allocation = { };
         other.mipLevelCount = 1;
         other.layerCount = 1;
+        other.isMemoryAliased = false;
 
         return *this;
     }
@@ -376,27 +439,28 @@ namespace VulkanAbstractionLayer
         this->mipLevelCount = CalculateImageMipLevelCount(options, width, height);
         this->layerCount = CalculateImageLayerCount(options);
 
-        vk::ImageCreateInfo imageCreateInfo;
-        imageCreateInfo
-            .setImageType(vk::ImageType::e2D)
-            .setFormat(ToNative(format))
-            .setExtent(vk::Extent3D{ width, height, 1 })
-            .setSamples(vk::SampleCountFlagBits::e1)
-            .setMipLevels(this->GetMipLevelCount())
-            .setArrayLayers(this->layerCount)
-            .setTiling(vk::ImageTiling::eOptimal)
-            .setUsage((vk::ImageUsageFlags)usage)
-            .setSharingMode(vk::SharingMode::eExclusive)
-            .setInitialLayout(vk::ImageLayout::eUndefined);
-
-        if (options & ImageOptions::CUBEMAP)
-            imageCreateInfo.setFlags(vk::ImageCreateFlagBits::eCubeCompatible);
+        auto imageCreateInfo = GetImageCreateInfo(width, height, format, usage, options);
         
         this->extent = vk::Extent2D{ (uint32_t)width, (uint32_t)height };
         this->allocation = AllocateImage(imageCreateInfo, memoryUsage, &this->handle);
         this->InitViews(this->handle, format);
     }
 
+    void Image::InitAliased(uint32_t width, uint32_t height, Format format, ImageUsage::Value usage, ImageOptions::Value options, VmaAllocation memory, size_t memoryOffset)
+    {
+        this->mipLevelCount = CalculateImageMipLevelCount(options, width, height);
+        this->layerCount = CalculateImageLayerCount(options);
+
+        auto imageCreateInfo = GetImageCreateInfo(width, height, format, usage, options);
+
+        this->extent = vk::Extent2D{ (uint32_t)width, (uint32_t)height };
+        this->allocation = { }; // memory is owned by the caller and may be shared with other images
+        this->isMemoryAliased = true;
+        this->handle = GetCurrentVulkanContext().GetDevice().createImage(imageCreateInfo);
+        BindImageMemory(this->handle, memory, memoryOffset);
+        this->InitViews(this->handle, format);
+    }
+
     vk::ImageView Image::GetNativeView(ImageView view) const
     {
         switch (view)
@@ -30,6 +30,20 @@
 
 namespace VulkanAbstractionLayer
 {
+	constexpr const char* HistorySuffix = "@prev";
+
+	std::string GetHistoryAttachmentName(const std::string& name, uint32_t age)
+	{
+		if (age == 0) return name;
+		if (age == 1) return name + HistorySuffix;
+		return name + HistorySuffix + std::to_string(age);
+	}
+
+	std::string GetHistoryAttachmentBaseName(const std::string& name)
+	{
+		return name.substr(0, name.find(HistorySuffix));
+	}
+
 	void Pipeline::AddDependency(const std::string& name, BufferUsage::Bits usage)
 	{
 		this->bufferDependencies.push_back(
@@ -44,6 +58,27 @@ namespace VulkanAbstractionLayer
 		);
 	}
 
+	void Pipeline::AddDependency(const std::string& name, ImageUsage::Bits usage, uint32_t mipLevel, uint32_t layer)
+	{
+		this->imageDependencies.push_back(
+			ImageDependency{ name, usage, ImageSubresource{ mipLevel, 1, layer, 1 } }
+		);
+	}
+
+	void Pipeline::AddDependency(const std::string& name, BufferUsage::Bits usage, vk::PipelineStageFlags stages)
+	{
+		this->bufferDependencies.push_back(
+			BufferDependency{ name, usage, stages }
+		);
+	}
+
+	void Pipeline::AddDependency(const std::string& name, ImageUsage::Bits usage, vk::PipelineStageFlags stages)
+	{
+		this->imageDependencies.push_back(
+			ImageDependency{ name, usage, ImageSubresource{ }, stages }
+		);
+	}
+
 	void Pipeline::DeclareAttachment(const std::string& name, Format format)
 	{
 		this->DeclareAttachment(name, format, 0, 0, ImageOptions::DEFAULT);
@@ -65,6 +100,29 @@ namespace VulkanAbstractionLayer
 		});
 	}
 
+	void Pipeline::AddCacheParameter(const std::string& name)
+	{
+		this->cacheParameters.push_back(name);
+	}
+
+	void Pipeline::DeclareHistoryAttachment(const std::string& name, Format format, uint32_t historyDepth)
+	{
+		this->DeclareHistoryAttachment(name, format, 0, 0, historyDepth);
+	}
+
+	void Pipeline::DeclareHistoryAttachment(const std::string& name, Format format, uint32_t width, uint32_t height, uint32_t historyDepth)
+	{
+		assert(historyDepth > 0);
+		this->attachmentDeclarations.push_back(AttachmentDeclaration{
+			name,
+			format,
+			width,
+			height,
+			ImageOptions::DEFAULT,
+			historyDepth
+		});
+	}
+
 	void Pipeline::AddOutputAttachment(const std::string& name, ClearColor clear)
 	{
 		this->AddOutputAttachment(name, clear, OutputAttachment::ALL_LAYERS);
@@ -31,6 +31,7 @@
 #include "Shader.h"
 #include "DescriptorBinding.h"
 #include "CommandBuffer.h"
+#include "PipelineBarrier.h"
 
 namespace VulkanAbstractionLayer
 {
@@ -50,6 +51,17 @@ namespace VulkanAbstractionLayer
         FRAME_WIRE,
     };
 
+    enum class QueueType
+    {
+        GRAPHICS = 0,
+        ASYNC_COMPUTE,
+    };
+
+    // name under which attachment written `age` frames ago can be accessed
+    std::string GetHistoryAttachmentName(const std::string& name, uint32_t age);
+    // name of attachment which history image belongs to, or same name for ordinary resource
+    std::string GetHistoryAttachmentBaseName(const std::string& name);
+
     class Pipeline
     {
     public:
@@ -67,12 +79,15 @@ namespace VulkanAbstractionLayer
         {
             std::string Name;
             ImageUsage::Bits Usage;
+            ImageSubresource Subresource = { };
+            vk::PipelineStageFlags Stages = { }; // empty for all shader stages of pipeline
         };
 
         struct BufferDependency
         {
             std::string Name;
             BufferUsage::Bits Usage;
+            vk::PipelineStageFlags Stages = { }; // empty for all shader stages of pipeline
         };
 
         struct AttachmentDeclaration
@@ -82,6 +97,7 @@ namespace VulkanAbstractionLayer
             uint32_t Width;
             uint32_t Height;
             ImageOptions::Value Options;
+            uint32_t HistoryDepth = 1; // number of frames kept, older images are accessed as "Name@prev", "Name@prev2", ...
         };
 
         struct OutputAttachment
@@ -103,6 +119,10 @@ namespace VulkanAbstractionLayer
         std::vector<OutputAttachment> outputAttachments;
 
         FillMode fillMode = FillMode::FILL;
+        bool hasSideEffect = false;
+        bool isCacheable = false;
+        std::vector<std::string> cacheParameters;
+        QueueType queueType = QueueType::GRAPHICS;
 
     public:
         std::shared_ptr<Shader> Shader;
@@ -118,10 +138,17 @@ namespace VulkanAbstractionLayer
 
         void AddDependency(const std::string& name, BufferUsage::Bits usage);
         void AddDependency(const std::string& name, ImageUsage::Bits usage);
+        // only single mip level and layer are synchronized, other subresources keep their state
+        void AddDependency(const std::string& name, ImageUsage::Bits usage, uint32_t mipLevel, uint32_t layer);
+        // resource is accessed only by listed shader stages, as reflected for bound descriptors
+        void AddDependency(const std::string& name, BufferUsage::Bits usage, vk::PipelineStageFlags stages);
+        void AddDependency(const std::string& name, ImageUsage::Bits usage, vk::PipelineStageFlags stages);
 
         void DeclareAttachment(const std::string& name, Format format);
         void DeclareAttachment(const std::string& name, Format format, uint32_t width, uint32_t height);
         void DeclareAttachment(const std::string& name, Format format, uint32_t width, uint32_t height, ImageOptions::Value options);
+        void DeclareHistoryAttachment(const std::string& name, Format format, uint32_t historyDepth);
+        void DeclareHistoryAttachment(const std::string& name, Format format, uint32_t width, uint32_t height, uint32_t historyDepth);
 
         const auto& GetBufferDependencies() const { return this->bufferDependencies; }
         const auto& GetImageDependencies() const { return this->imageDependencies; }
@@ -130,5 +157,20 @@ namespace VulkanAbstractionLayer
 
         void SetFillMode(FillMode mode) { this->fillMode = mode; }
         FillMode GetFillMode()const { return this->fillMode; }
+
+        // pass with side effect (e.g. writing to external resource) is never culled from render graph
+        void SetSideEffect(bool sideEffect) { this->hasSideEffect = sideEffect; }
+        bool HasSideEffect() const { return this->hasSideEffect; }
+
+        // cacheable pass is skipped while resources it accesses and its cache parameters are unchanged, outputs keep last contents
+        void SetCacheable(bool cacheable) { this->isCacheable = cacheable; }
+        bool IsCacheable() const { return this->isCacheable; }
+        // user value which output of cacheable pass depends on, changed with RenderGraph::InvalidateResource
+        void AddCacheParameter(const std::string& name);
+        const auto& GetCacheParameters() const { return this->cacheParameters; }
+
+        // hint only: pass falls back to graphics queue if device has no separate compute queue or pass has output attachments
+        void SetQueueType(QueueType type) { this->queueType = type; }
+        QueueType GetQueueType() const { return this->queueType; }
     };
 }
\ No newline at end of file
@@ -0,0 +1,335 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "PipelineBarrier.h"
+
+#include <algorithm>
+
+namespace VulkanAbstractionLayer
+{
+    bool HasImageWriteDependency(ImageUsage::Bits usage)
+    {
+        switch (usage)
+        {
+        case ImageUsage::TRANSFER_DISTINATION:
+        case ImageUsage::STORAGE:
+        case ImageUsage::COLOR_ATTACHMENT:
+        case ImageUsage::DEPTH_SPENCIL_ATTACHMENT:
+        case ImageUsage::FRAGMENT_SHADING_RATE_ATTACHMENT:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool HasBufferWriteDependency(BufferUsage::Bits usage)
+    {
+        switch (usage)
+        {
+        case BufferUsage::TRANSFER_DESTINATION:
+        case BufferUsage::UNIFORM_TEXEL_BUFFER:
+        case BufferUsage::STORAGE_TEXEL_BUFFER:
+        case BufferUsage::STORAGE_BUFFER:
+        case BufferUsage::TRANSFORM_FEEDBACK_BUFFER:
+        case BufferUsage::TRANSFORM_FEEDBACK_COUNTER_BUFFER:
+        case BufferUsage::ACCELERATION_STRUCTURE_STORAGE:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool IsSynchronizationNeeded(const BufferTransition& transition)
+    {
+        return HasBufferWriteDependency(transition.InitialUsage);
+    }
+
+    bool IsSynchronizationNeeded(const ImageTransition& transition)
+    {
+        return transition.InitialUsage != transition.FinalUsage || HasImageWriteDependency(transition.InitialUsage);
+    }
+
+    vk::PipelineStageFlags GetInitialPipelineStages(const BufferTransition& transition)
+    {
+        return transition.InitialStages ? transition.InitialStages : BufferUsageToPipelineStage(transition.InitialUsage);
+    }
+
+    vk::PipelineStageFlags GetFinalPipelineStages(const BufferTransition& transition)
+    {
+        return transition.FinalStages ? transition.FinalStages : BufferUsageToPipelineStage(transition.FinalUsage);
+    }
+
+    vk::PipelineStageFlags GetInitialPipelineStages(const ImageTransition& transition)
+    {
+        return transition.InitialStages ? transition.InitialStages : ImageUsageToPipelineStage(transition.InitialUsage);
+    }
+
+    vk::PipelineStageFlags GetFinalPipelineStages(const ImageTransition& transition)
+    {
+        return transition.FinalStages ? transition.FinalStages : ImageUsageToPipelineStage(transition.FinalUsage);
+    }
+
+    // counts are resolved on emit, when image is known
+    static vk::ImageSubresourceRange ToSubresourceRange(const ImageSubresource& subresource)
+    {
+        vk::ImageSubresourceRange subresourceRange;
+        subresourceRange
+            .setBaseMipLevel(subresource.BaseMipLevel)
+            .setLevelCount(subresource.MipLevelCount)
+            .setBaseArrayLayer(subresource.BaseLayer)
+            .setLayerCount(subresource.LayerCount);
+        return subresourceRange;
+    }
+
+    static vk::PipelineStageFlags2KHR ToPipelineStages2(vk::PipelineStageFlags stages)
+    {
+        return vk::PipelineStageFlags2KHR{ (VkFlags64)(VkPipelineStageFlags)stages };
+    }
+
+    bool PipelineBarrier::AddTransition(const std::string& name, const BufferTransition& transition)
+    {
+        if (!IsSynchronizationNeeded(transition))
+            return false;
+
+        vk::BufferMemoryBarrier2KHR bufferBarrier;
+        bufferBarrier
+            .setSrcStageMask(ToPipelineStages2(GetInitialPipelineStages(transition)))
+            .setSrcAccessMask(BufferUsageToAccessFlags2(transition.InitialUsage))
+            .setDstStageMask(ToPipelineStages2(GetFinalPipelineStages(transition)))
+            .setDstAccessMask(BufferUsageToAccessFlags2(transition.FinalUsage))
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setSize(VK_WHOLE_SIZE)
+            .setOffset(0);
+
+        this->bufferBarrierInfos.push_back(BufferBarrierInfo{ name, bufferBarrier, false });
+        return true;
+    }
+
+    bool PipelineBarrier::AddTransition(const std::string& name, const ImageTransition& transition)
+    {
+        if (!IsSynchronizationNeeded(transition))
+            return false;
+
+        vk::ImageMemoryBarrier2KHR imageBarrier;
+        imageBarrier
+            .setOldLayout(ImageUsageToImageLayout(transition.InitialUsage))
+            .setNewLayout(ImageUsageToImageLayout(transition.FinalUsage))
+            // also wait for previous user of aliased memory to finish its accesses
+            .setSrcStageMask(ToPipelineStages2(GetInitialPipelineStages(transition)))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(transition.InitialUsage) | ImageUsageToAccessFlags2(transition.AliasedUsage))
+            .setDstStageMask(ToPipelineStages2(GetFinalPipelineStages(transition)))
+            .setDstAccessMask(ImageUsageToAccessFlags2(transition.FinalUsage))
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setSubresourceRange(ToSubresourceRange(transition.Subresource));
+        if (transition.AliasedUsage != ImageUsage::UNKNOWN)
+            imageBarrier.srcStageMask |= ImageUsageToPipelineStage2(transition.AliasedUsage);
+
+        this->imageBarrierInfos.push_back(ImageBarrierInfo{ name, imageBarrier, false });
+        return true;
+    }
+
+    static vk::BufferMemoryBarrier2KHR CreateOwnershipBarrier(const BufferTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily)
+    {
+        vk::BufferMemoryBarrier2KHR bufferBarrier;
+        bufferBarrier
+            .setSrcQueueFamilyIndex(sourceQueueFamily)
+            .setDstQueueFamilyIndex(destinationQueueFamily)
+            .setSize(VK_WHOLE_SIZE)
+            .setOffset(0);
+        return bufferBarrier;
+    }
+
+    static vk::ImageMemoryBarrier2KHR CreateOwnershipBarrier(const ImageTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily)
+    {
+        vk::ImageMemoryBarrier2KHR imageBarrier;
+        imageBarrier
+            .setOldLayout(ImageUsageToImageLayout(transition.InitialUsage))
+            .setNewLayout(ImageUsageToImageLayout(transition.FinalUsage))
+            .setSrcQueueFamilyIndex(sourceQueueFamily)
+            .setDstQueueFamilyIndex(destinationQueueFamily)
+            .setSubresourceRange(ToSubresourceRange(transition.Subresource));
+        return imageBarrier;
+    }
+
+    void PipelineBarrier::AddReleaseTransition(const std::string& name, const BufferTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily)
+    {
+        auto bufferBarrier = CreateOwnershipBarrier(transition, sourceQueueFamily, destinationQueueFamily);
+        bufferBarrier
+            .setSrcStageMask(ToPipelineStages2(GetInitialPipelineStages(transition)))
+            .setSrcAccessMask(BufferUsageToAccessFlags2(transition.InitialUsage))
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eBottomOfPipe);
+        this->bufferBarrierInfos.push_back(BufferBarrierInfo{ name, bufferBarrier, false });
+    }
+
+    void PipelineBarrier::AddReleaseTransition(const std::string& name, const ImageTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily)
+    {
+        auto imageBarrier = CreateOwnershipBarrier(transition, sourceQueueFamily, destinationQueueFamily);
+        imageBarrier
+            .setSrcStageMask(ToPipelineStages2(GetInitialPipelineStages(transition)))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(transition.InitialUsage))
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eBottomOfPipe);
+        this->imageBarrierInfos.push_back(ImageBarrierInfo{ name, imageBarrier, false });
+    }
+
+    void PipelineBarrier::AddAcquireTransition(const std::string& name, const BufferTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily, bool isFromPreviousFrame)
+    {
+        auto bufferBarrier = CreateOwnershipBarrier(transition, sourceQueueFamily, destinationQueueFamily);
+        bufferBarrier
+            .setSrcStageMask(vk::PipelineStageFlagBits2KHR::eTopOfPipe)
+            .setDstStageMask(ToPipelineStages2(GetFinalPipelineStages(transition)))
+            .setDstAccessMask(BufferUsageToAccessFlags2(transition.FinalUsage));
+        this->bufferBarrierInfos.push_back(BufferBarrierInfo{ name, bufferBarrier, isFromPreviousFrame });
+    }
+
+    void PipelineBarrier::AddAcquireTransition(const std::string& name, const ImageTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily, bool isFromPreviousFrame)
+    {
+        auto imageBarrier = CreateOwnershipBarrier(transition, sourceQueueFamily, destinationQueueFamily);
+        imageBarrier
+            .setSrcStageMask(vk::PipelineStageFlagBits2KHR::eTopOfPipe)
+            .setDstStageMask(ToPipelineStages2(GetFinalPipelineStages(transition)))
+            .setDstAccessMask(ImageUsageToAccessFlags2(transition.FinalUsage));
+        this->imageBarrierInfos.push_back(ImageBarrierInfo{ name, imageBarrier, isFromPreviousFrame });
+    }
+
+    static vk::PipelineStageFlags2KHR ToComputeStages(vk::PipelineStageFlags2KHR stages)
+    {
+        const vk::PipelineStageFlags2KHR ComputeQueueStages =
+            vk::PipelineStageFlagBits2KHR::eTopOfPipe |
+            vk::PipelineStageFlagBits2KHR::eBottomOfPipe |
+            vk::PipelineStageFlagBits2KHR::eDrawIndirect |
+            vk::PipelineStageFlagBits2KHR::eComputeShader |
+            vk::PipelineStageFlagBits2KHR::eTransfer |
+            vk::PipelineStageFlagBits2KHR::eCopy |
+            vk::PipelineStageFlagBits2KHR::eClear |
+            vk::PipelineStageFlagBits2KHR::eHost |
+            vk::PipelineStageFlagBits2KHR::eAllCommands;
+
+        // graphics stages come from usages which are shared with graphic passes, compute queue only runs compute shaders
+        if (stages & ~ComputeQueueStages)
+            stages = (stages & ComputeQueueStages) | vk::PipelineStageFlagBits2KHR::eComputeShader;
+        return stages;
+    }
+
+    void PipelineBarrier::RestrictToComputeStages()
+    {
+        for (auto& bufferBarrierInfo : this->bufferBarrierInfos)
+        {
+            bufferBarrierInfo.Barrier.srcStageMask = ToComputeStages(bufferBarrierInfo.Barrier.srcStageMask);
+            bufferBarrierInfo.Barrier.dstStageMask = ToComputeStages(bufferBarrierInfo.Barrier.dstStageMask);
+        }
+        for (auto& imageBarrierInfo : this->imageBarrierInfos)
+        {
+            imageBarrierInfo.Barrier.srcStageMask = ToComputeStages(imageBarrierInfo.Barrier.srcStageMask);
+            imageBarrierInfo.Barrier.dstStageMask = ToComputeStages(imageBarrierInfo.Barrier.dstStageMask);
+        }
+    }
+
+    void PipelineBarrier::InternNames(ResolveInfo& resolveInfo)
+    {
+        for (auto& bufferBarrierInfo : this->bufferBarrierInfos)
+            bufferBarrierInfo.Handle = resolveInfo.GetHandle(bufferBarrierInfo.Name);
+        for (auto& imageBarrierInfo : this->imageBarrierInfos)
+            imageBarrierInfo.Handle = resolveInfo.GetHandle(imageBarrierInfo.Name);
+    }
+
+    template<typename BarrierInfo>
+    static ResourceHandle GetResolveHandle(const BarrierInfo& barrierInfo, const ResolveInfo& resolveInfo)
+    {
+        auto handle = barrierInfo.Handle != INVALID_RESOURCE_HANDLE ? barrierInfo.Handle : resolveInfo.FindHandle(barrierInfo.Name);
+        assert(handle != INVALID_RESOURCE_HANDLE);
+        return handle;
+    }
+
+    bool PipelineBarrier::ResolveBarriers(const ResolveInfo& resolveInfo, bool isFirstFrame)
+    {
+        this->bufferBarriers.clear();
+        this->imageBarriers.clear();
+
+        for (const auto& bufferBarrierInfo : this->bufferBarrierInfos)
+        {
+            auto buffers = resolveInfo.GetBuffers(GetResolveHandle(bufferBarrierInfo, resolveInfo));
+            for (const auto& buffer : buffers)
+            {
+                auto& bufferBarrier = this->bufferBarriers.emplace_back(bufferBarrierInfo.Barrier);
+                bufferBarrier.setBuffer(buffer.get().GetNativeHandle());
+                // nothing was released yet, resource is used by this queue for the first time
+                if (isFirstFrame && bufferBarrierInfo.IsFromPreviousFrame)
+                {
+                    bufferBarrier
+                        .setSrcStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands)
+                        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                }
+            }
+        }
+
+        for (const auto& imageBarrierInfo : this->imageBarrierInfos)
+        {
+            auto images = resolveInfo.GetImages(GetResolveHandle(imageBarrierInfo, resolveInfo));
+            for (const auto& image : images)
+            {
+                auto& range = imageBarrierInfo.Barrier.subresourceRange;
+                assert(range.baseMipLevel < image.get().GetMipLevelCount() && range.baseArrayLayer < image.get().GetLayerCount());
+
+                auto& imageBarrier = this->imageBarriers.emplace_back(imageBarrierInfo.Barrier);
+                imageBarrier.setImage(image.get().GetNativeHandle());
+                if (isFirstFrame && imageBarrierInfo.IsFromPreviousFrame)
+                {
+                    imageBarrier
+                        .setSrcStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands)
+                        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                }
+                imageBarrier.subresourceRange
+                    .setAspectMask(ImageFormatToImageAspect(image.get().GetFormat()))
+                    .setLevelCount(std::min(range.levelCount, image.get().GetMipLevelCount() - range.baseMipLevel))
+                    .setLayerCount(std::min(range.layerCount, image.get().GetLayerCount() - range.baseArrayLayer));
+            }
+        }
+
+        return !this->bufferBarriers.empty() || !this->imageBarriers.empty();
+    }
+
+    void PipelineBarrier::Emit(CommandBuffer& commandBuffer, const ResolveInfo& resolveInfo, bool isFirstFrame)
+    {
+        if (this->IsEmpty() || !this->ResolveBarriers(resolveInfo, isFirstFrame))
+            return;
+
+        commandBuffer.PipelineBarrier(this->bufferBarriers, this->imageBarriers);
+    }
+
+    void PipelineBarrier::EmitWait(CommandBuffer& commandBuffer, const ResolveInfo& resolveInfo, ArrayView<const vk::Event> events, vk::PipelineStageFlags signalStages)
+    {
+        if (this->IsEmpty() || !this->ResolveBarriers(resolveInfo, false))
+            return;
+
+        commandBuffer.WaitEvents(events, signalStages, this->bufferBarriers, this->imageBarriers);
+    }
+}
@@ -0,0 +1,126 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "DescriptorBinding.h"
+#include "CommandBuffer.h"
+
+namespace VulkanAbstractionLayer
+{
+    // mip levels and array layers of image, REMAINING count extends range to the end of image
+    struct ImageSubresource
+    {
+        constexpr static uint32_t REMAINING = uint32_t(-1);
+
+        uint32_t BaseMipLevel = 0;
+        uint32_t MipLevelCount = REMAINING;
+        uint32_t BaseLayer = 0;
+        uint32_t LayerCount = REMAINING;
+    };
+
+    struct ImageTransition
+    {
+        ImageUsage::Bits InitialUsage;
+        ImageUsage::Bits FinalUsage;
+        ImageUsage::Bits AliasedUsage = ImageUsage::UNKNOWN; // last usage of image previously bound to the same memory
+        ImageSubresource Subresource = { };
+        vk::PipelineStageFlags InitialStages = { }; // shader stages which accessed image, deduced from usage if empty
+        vk::PipelineStageFlags FinalStages = { };
+    };
+
+    struct BufferTransition
+    {
+        BufferUsage::Bits InitialUsage;
+        BufferUsage::Bits FinalUsage;
+        vk::PipelineStageFlags InitialStages = { }; // shader stages which accessed buffer, deduced from usage if empty
+        vk::PipelineStageFlags FinalStages = { };
+    };
+
+    bool HasImageWriteDependency(ImageUsage::Bits usage);
+    bool HasBufferWriteDependency(BufferUsage::Bits usage);
+    // false if accesses before and after transition can overlap without barrier
+    bool IsSynchronizationNeeded(const BufferTransition& transition);
+    bool IsSynchronizationNeeded(const ImageTransition& transition);
+
+    vk::PipelineStageFlags GetInitialPipelineStages(const BufferTransition& transition);
+    vk::PipelineStageFlags GetFinalPipelineStages(const BufferTransition& transition);
+    vk::PipelineStageFlags GetInitialPipelineStages(const ImageTransition& transition);
+    vk::PipelineStageFlags GetFinalPipelineStages(const ImageTransition& transition);
+
+    class PipelineBarrier
+    {
+        struct BufferBarrierInfo
+        {
+            std::string Name;
+            vk::BufferMemoryBarrier2KHR Barrier;
+            bool IsFromPreviousFrame;
+            ResourceHandle Handle = INVALID_RESOURCE_HANDLE;
+        };
+
+        struct ImageBarrierInfo
+        {
+            std::string Name;
+            vk::ImageMemoryBarrier2KHR Barrier;
+            bool IsFromPreviousFrame;
+            ResourceHandle Handle = INVALID_RESOURCE_HANDLE;
+        };
+
+        std::vector<BufferBarrierInfo> bufferBarrierInfos;
+        std::vector<ImageBarrierInfo> imageBarrierInfos;
+
+        // filled with native handles on each emit, capacity is kept between frames
+        std::vector<vk::BufferMemoryBarrier2KHR> bufferBarriers;
+        std::vector<vk::ImageMemoryBarrier2KHR> imageBarriers;
+
+        bool ResolveBarriers(const ResolveInfo& resolveInfo, bool isFirstFrame);
+
+    public:
+        // returns false if transition does not need synchronization
+        bool AddTransition(const std::string& name, const BufferTransition& transition);
+        bool AddTransition(const std::string& name, const ImageTransition& transition);
+
+        // queue family ownership transfer, release and acquire must be added with the same transition
+        void AddReleaseTransition(const std::string& name, const BufferTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily);
+        void AddReleaseTransition(const std::string& name, const ImageTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily);
+        void AddAcquireTransition(const std::string& name, const BufferTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily, bool isFromPreviousFrame);
+        void AddAcquireTransition(const std::string& name, const ImageTransition& transition, uint32_t sourceQueueFamily, uint32_t destinationQueueFamily, bool isFromPreviousFrame);
+        void RestrictToComputeStages();
+        // handles are valid only for resolve info they were interned in, other ones are searched by name
+        void InternNames(ResolveInfo& resolveInfo);
+
+        void Emit(CommandBuffer& commandBuffer, const ResolveInfo& resolveInfo, bool isFirstFrame = false);
+        // second half of split barrier, signal stages are combined stage masks of the events
+        void EmitWait(CommandBuffer& commandBuffer, const ResolveInfo& resolveInfo, ArrayView<const vk::Event> events, vk::PipelineStageFlags signalStages);
+
+        bool IsEmpty() const { return this->bufferBarrierInfos.empty() && this->imageBarrierInfos.empty(); }
+    };
+}
\ No newline at end of file
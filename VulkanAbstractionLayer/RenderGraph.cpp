@@ -30,12 +30,315 @@
 #include "VulkanContext.h"
 #include "CommandBuffer.h"
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
 namespace VulkanAbstractionLayer
 {
-    RenderGraph::RenderGraph(std::vector<RenderGraphNode> nodes, std::unordered_map<std::string, Image> attachments, const std::string& outputName, PresentCallback onPresent, CreateCallback onCreate)
-        : nodes(std::move(nodes)), attachments(std::move(attachments)), outputName(std::move(outputName)), onPresent(std::move(onPresent)), onCreate(std::move(onCreate))
+    RenderGraph::RenderGraph(std::vector<RenderGraphNode> nodes, std::unordered_map<std::string, Image> attachments, const std::string& outputName, PresentCallback onPresent, CreateCallback onCreate, std::vector<VmaAllocation> attachmentMemory, std::vector<SurfaceAttachment> surfaceAttachments, const RenderGraphStatistics& statistics, std::vector<RenderGraphBatch> batches, std::vector<std::vector<std::string>> historyAttachments)
+        : nodes(std::move(nodes)), attachments(std::move(attachments)), outputName(std::move(outputName)), onPresent(std::move(onPresent)), onCreate(std::move(onCreate)), attachmentMemory(std::move(attachmentMemory)), surfaceAttachments(std::move(surfaceAttachments)), statistics(statistics), batches(std::move(batches)), historyAttachments(std::move(historyAttachments))
+    {
+        this->InitializeBatchResources();
+        this->InitializeEventResources();
+        this->InitializeHistoryResources();
+        this->InitializeResolveHandles();
+        this->InitializeNodeVersions();
+    }
+
+    size_t RenderGraph::GetResourceVersionIndex(const std::string& name)
+    {
+        auto versionIndex = this->resourceVersionIndices.emplace(name, this->resourceVersions.size());
+        if (versionIndex.second)
+            this->resourceVersions.push_back(0);
+        return versionIndex.first->second;
+    }
+
+    void RenderGraph::InitializeNodeVersions()
+    {
+        this->nodeVersions.resize(this->nodes.size());
+        for (size_t nodeIndex = 0; nodeIndex < this->nodes.size(); nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            auto& versions = this->nodeVersions[nodeIndex];
+            for (const auto& input : node.VersionedInputs)
+                versions.Inputs.push_back(this->GetResourceVersionIndex(input));
+            for (const auto& output : node.VersionedOutputs)
+                versions.Outputs.push_back(this->GetResourceVersionIndex(output));
+        }
+    }
+
+    void RenderGraph::UpdateSkippedNodes()
+    {
+        // node is executed if any of its inputs was written by earlier executed node, in this or previous frames
+        this->skippedNodeCount = 0;
+        for (size_t nodeIndex = 0; nodeIndex < this->nodes.size(); nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            auto& versions = this->nodeVersions[nodeIndex];
+
+            versions.IsSkipped = node.IsCacheable && !versions.ExecutedInputVersions.empty();
+            for (size_t input = 0; input < versions.Inputs.size() && versions.IsSkipped; input++)
+                versions.IsSkipped = this->resourceVersions[versions.Inputs[input]] == versions.ExecutedInputVersions[input];
+
+            if (versions.IsSkipped)
+            {
+                this->skippedNodeCount++;
+                continue;
+            }
+
+            for (size_t output : versions.Outputs)
+                this->resourceVersions[output]++;
+
+            // taken after outputs are increased, so node is not invalidated by its own writes
+            if (node.IsCacheable)
+            {
+                versions.ExecutedInputVersions.clear();
+                for (size_t input : versions.Inputs)
+                    versions.ExecutedInputVersions.push_back(this->resourceVersions[input]);
+            }
+        }
+    }
+
+    void RenderGraph::InvalidateResource(const std::string& name)
+    {
+        auto versionIndex = this->resourceVersionIndices.find(name);
+        if (versionIndex != this->resourceVersionIndices.end())
+            this->resourceVersions[versionIndex->second]++;
+    }
+
+    void RenderGraph::InvalidateCachedNodes()
+    {
+        for (auto& versions : this->nodeVersions)
+            versions.ExecutedInputVersions.clear();
+    }
+
+    void RenderGraph::InitializeResolveHandles()
     {
+        // attachment images are replaced in place on resize and rotation, so pointers to them stay valid
+        for (const auto& [attachmentName, attachment] : this->attachments)
+            this->attachmentResolves.emplace_back(this->resolveInfo.GetHandle(attachmentName), &attachment);
 
+        for (auto& node : this->nodes)
+        {
+            node.Descriptors.InternNames(this->resolveInfo);
+            node.Barrier.InternNames(this->resolveInfo);
+            node.EventBarrier.InternNames(this->resolveInfo);
+        }
+        for (auto& batch : this->batches)
+            batch.ReleaseBarrier.InternNames(this->resolveInfo);
+    }
+
+    void RenderGraph::InitializeHistoryResources()
+    {
+        for (const auto& historyNames : this->historyAttachments)
+            this->historyPeriod = std::lcm(this->historyPeriod, historyNames.size());
+
+        for (auto& node : this->nodes)
+        {
+            bool usesHistory = std::any_of(node.FramebufferAttachments.begin(), node.FramebufferAttachments.end(), [this](const FramebufferAttachment& attachment)
+            {
+                return std::any_of(this->historyAttachments.begin(), this->historyAttachments.end(), [&attachment](const std::vector<std::string>& historyNames)
+                {
+                    return std::find(historyNames.begin(), historyNames.end(), attachment.Name) != historyNames.end();
+                });
+            });
+            if (!(bool)node.PassNative.Framebuffer || !usesHistory)
+                continue;
+
+            // framebuffer created by builder references images of current rotation
+            vk::Extent2D extent;
+            node.HistoryFramebuffers.resize(this->historyPeriod);
+            for (size_t rotation = 0; rotation < this->historyPeriod; rotation++)
+            {
+                node.HistoryFramebuffers[rotation] = rotation == this->historyRotation ?
+                    node.PassNative.Framebuffer :
+                    this->CreateNodeFramebuffer(node, rotation, extent);
+            }
+        }
+    }
+
+    const Image& RenderGraph::GetRotatedAttachment(const std::string& name, size_t rotation) const
+    {
+        for (const auto& historyNames : this->historyAttachments)
+        {
+            auto historyName = std::find(historyNames.begin(), historyNames.end(), name);
+            if (historyName == historyNames.end())
+                continue;
+
+            // each rotation moves image one frame older, the oldest one becomes current
+            size_t depth = historyNames.size();
+            size_t age = size_t(historyName - historyNames.begin());
+            size_t rotationCount = (rotation + this->historyPeriod - this->historyRotation) % this->historyPeriod;
+            return this->attachments.at(historyNames[(age + depth - rotationCount % depth) % depth]);
+        }
+        return this->attachments.at(name);
+    }
+
+    vk::Framebuffer RenderGraph::CreateNodeFramebuffer(const RenderGraphNode& node, size_t rotation, vk::Extent2D& extent) const
+    {
+        std::vector<vk::ImageView> attachmentViews;
+        uint32_t renderAreaWidth = std::numeric_limits<uint32_t>::max();
+        uint32_t renderAreaHeight = std::numeric_limits<uint32_t>::max();
+        for (const auto& framebufferAttachment : node.FramebufferAttachments)
+        {
+            const auto& image = this->GetRotatedAttachment(framebufferAttachment.Name, rotation);
+            if (framebufferAttachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS)
+                attachmentViews.push_back(image.GetNativeView(ImageView::NATIVE));
+            else
+                attachmentViews.push_back(image.GetNativeView(ImageView::NATIVE, framebufferAttachment.Layer));
+
+            renderAreaWidth = std::min(renderAreaWidth, (uint32_t)image.GetWidth());
+            renderAreaHeight = std::min(renderAreaHeight, (uint32_t)image.GetHeight());
+        }
+
+        vk::FramebufferCreateInfo framebufferCreateInfo;
+        framebufferCreateInfo
+            .setRenderPass(node.PassNative.RenderPassHandle)
+            .setAttachments(attachmentViews)
+            .setWidth(renderAreaWidth)
+            .setHeight(renderAreaHeight)
+            .setLayers(1);
+
+        extent = vk::Extent2D{ renderAreaWidth, renderAreaHeight };
+        return GetCurrentVulkanContext().GetDevice().createFramebuffer(framebufferCreateInfo);
+    }
+
+    vk::Extent2D RenderGraph::RecreateNodeFramebuffers(RenderGraphNode& node)
+    {
+        auto& device = GetCurrentVulkanContext().GetDevice();
+        vk::Extent2D extent;
+        if (node.HistoryFramebuffers.empty())
+        {
+            device.destroyFramebuffer(node.PassNative.Framebuffer);
+            node.PassNative.Framebuffer = this->CreateNodeFramebuffer(node, this->historyRotation, extent);
+            return extent;
+        }
+
+        for (size_t rotation = 0; rotation < node.HistoryFramebuffers.size(); rotation++)
+        {
+            device.destroyFramebuffer(node.HistoryFramebuffers[rotation]);
+            node.HistoryFramebuffers[rotation] = this->CreateNodeFramebuffer(node, rotation, extent);
+        }
+        node.PassNative.Framebuffer = node.HistoryFramebuffers[this->historyRotation];
+        return extent;
+    }
+
+    vk::Extent2D RenderGraph::UpdateRenderingAttachments(RenderGraphNode& node)
+    {
+        // color attachments are followed by depth one, as listed by builder
+        auto& pass = node.PassNative;
+        uint32_t renderAreaWidth = std::numeric_limits<uint32_t>::max();
+        uint32_t renderAreaHeight = std::numeric_limits<uint32_t>::max();
+        for (size_t attachmentIndex = 0; attachmentIndex < node.FramebufferAttachments.size(); attachmentIndex++)
+        {
+            const auto& framebufferAttachment = node.FramebufferAttachments[attachmentIndex];
+            const auto& image = this->attachments.at(framebufferAttachment.Name);
+            auto view = framebufferAttachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS ?
+                image.GetNativeView(ImageView::NATIVE) :
+                image.GetNativeView(ImageView::NATIVE, framebufferAttachment.Layer);
+
+            if (attachmentIndex < pass.ColorAttachments.size())
+                pass.ColorAttachments[attachmentIndex].setImageView(view);
+            else
+                pass.DepthStencilAttachment.setImageView(view);
+
+            renderAreaWidth = std::min(renderAreaWidth, (uint32_t)image.GetWidth());
+            renderAreaHeight = std::min(renderAreaHeight, (uint32_t)image.GetHeight());
+        }
+        return vk::Extent2D{ renderAreaWidth, renderAreaHeight };
+    }
+
+    void RenderGraph::RotateHistoryAttachments()
+    {
+        if (this->historyAttachments.empty())
+            return;
+
+        // the oldest image is overwritten in current frame
+        for (const auto& historyNames : this->historyAttachments)
+        {
+            Image oldestImage = std::move(this->attachments.at(historyNames.back()));
+            for (size_t age = historyNames.size() - 1; age > 0; age--)
+                this->attachments.at(historyNames[age]) = std::move(this->attachments.at(historyNames[age - 1]));
+            this->attachments.at(historyNames.front()) = std::move(oldestImage);
+        }
+
+        this->historyRotation = (this->historyRotation + 1) % this->historyPeriod;
+        for (auto& node : this->nodes)
+        {
+            if (!node.HistoryFramebuffers.empty())
+                node.PassNative.Framebuffer = node.HistoryFramebuffers[this->historyRotation];
+            if (node.PassNative.UsesDynamicRendering)
+                this->UpdateRenderingAttachments(node);
+        }
+    }
+
+    void RenderGraph::InitializeBatchResources()
+    {
+        // everything is recorded to frame command buffer if graph does not use async compute
+        if (this->batches.size() <= 1)
+            return;
+
+        auto& vulkan = GetCurrentVulkanContext();
+        auto& device = vulkan.GetDevice();
+
+        vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
+        commandBufferAllocateInfo
+            .setCommandPool(vulkan.GetComputeCommandPool())
+            .setCommandBufferCount((uint32_t)this->batches.size())
+            .setLevel(vk::CommandBufferLevel::ePrimary);
+
+        this->batchFrameResources.resize(vulkan.GetVirtualFrameCount());
+        for (auto& frameResources : this->batchFrameResources)
+        {
+            for (auto commandBuffer : device.allocateCommandBuffers(commandBufferAllocateInfo))
+                frameResources.CommandBuffers.push_back(CommandBuffer{ commandBuffer });
+
+            for (size_t i = 0; i < this->batches.size(); i++)
+            {
+                frameResources.GraphicsSemaphores.push_back(device.createSemaphore(vk::SemaphoreCreateInfo{ }));
+                frameResources.ComputeSemaphores.push_back(device.createSemaphore(vk::SemaphoreCreateInfo{ }));
+            }
+        }
+    }
+
+    void RenderGraph::InitializeEventResources()
+    {
+        auto& vulkan = GetCurrentVulkanContext();
+        for (auto& node : this->nodes)
+        {
+            if (!(bool)node.SignalStages)
+                continue;
+
+            // event of virtual frame is reset on host after frame fence was waited
+            for (size_t frameIndex = 0; frameIndex < vulkan.GetVirtualFrameCount(); frameIndex++)
+                node.SignalEvents.push_back(vulkan.GetDevice().createEvent(vk::EventCreateInfo{ }));
+        }
+    }
+
+    void RenderGraph::WaitNodeEvents(RenderGraphNode& node, CommandBuffer& commandBuffer, ResolveInfo& resolve)
+    {
+        if (node.WaitedNodes.empty())
+            return;
+
+        auto frameIndex = GetCurrentVulkanContext().GetCurrentVirtualFrameIndex();
+        vk::PipelineStageFlags signalStages = { };
+        this->waitedEvents.clear();
+        for (size_t waitedNode : node.WaitedNodes)
+        {
+            this->waitedEvents.push_back(this->nodes[waitedNode].SignalEvents[frameIndex]);
+            signalStages |= this->nodes[waitedNode].SignalStages;
+        }
+        node.EventBarrier.EmitWait(commandBuffer, resolve, this->waitedEvents, signalStages);
+    }
+
+    void RenderGraph::SignalNodeEvent(RenderGraphNode& node, CommandBuffer& commandBuffer)
+    {
+        if (node.SignalEvents.empty())
+            return;
+
+        auto frameIndex = GetCurrentVulkanContext().GetCurrentVirtualFrameIndex();
+        commandBuffer.GetNativeHandle().setEvent(node.SignalEvents[frameIndex], node.SignalStages);
     }
 
     void RenderGraph::InitializeOnFirstFrame(CommandBuffer& commandBuffer)
@@ -47,40 +350,587 @@ namespace VulkanAbstractionLayer
         }
     }
 
+    void RenderGraph::UpdateNodeDescriptors(ResolveInfo& resolve)
+    {
+        // every node is resolved before recording, so partial updates of whole frame are written with single call
+        auto frameIndex = GetCurrentVulkanContext().GetCurrentVirtualFrameIndex();
+        this->descriptorWrites.clear();
+        this->writtenDescriptorCount = 0;
+        for (size_t nodeIndex = 0; nodeIndex < this->nodes.size(); nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            node.PassCustom->ResolveResources(resolve);
+            if (this->nodeVersions[nodeIndex].IsSkipped || node.PassNative.FrameDescriptorSets.empty())
+                continue;
+
+            auto& pass = node.PassNative;
+            pass.DescriptorSet = pass.FrameDescriptorSets[frameIndex];
+            auto options = node.Descriptors.GetOptions();
+            if (options == ResolveOptions::ALREADY_RESOLVED)
+                continue;
+
+            node.Descriptors.Resolve(resolve);
+            // resources resolved once are written to sets of all virtual frames
+            if (options == ResolveOptions::RESOLVE_ONCE)
+                this->writtenDescriptorCount += node.Descriptors.Write(pass.FrameDescriptorSets, pass.DescriptorSetLayout, this->descriptorWrites);
+            else
+                this->writtenDescriptorCount += node.Descriptors.Write({ &pass.DescriptorSet, 1 }, pass.DescriptorSetLayout, this->descriptorWrites);
+        }
+
+        if (!this->descriptorWrites.empty())
+            GetCurrentVulkanContext().GetDevice().updateDescriptorSets(this->descriptorWrites, { });
+    }
+
     void RenderGraph::ExecuteRenderGraphNode(RenderGraphNode& node, CommandBuffer& commandBuffer, ResolveInfo& resolve)
     {
+        using CpuStage = RenderGraphProfiler::CpuStage;
         RenderPassState state{ *this, commandBuffer, node.PassNative };
+        auto nodeIndex = this->GetNodeIndex(node);
+        if (this->nodeVersions[nodeIndex].IsSkipped)
+        {
+            this->ExecuteSkippedRenderGraphNode(node, commandBuffer, resolve);
+            return;
+        }
+        if ((bool)this->profiler) this->profiler->WriteBeginTimestamp(commandBuffer, nodeIndex);
 
-        node.PassCustom->ResolveResources(resolve);
-        node.Descriptors.Resolve(resolve);
-        node.Descriptors.Write(node.PassNative.DescriptorSet);
+        {
+            RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, CpuStage::BEFORE_RENDER };
+            node.PassCustom->BeforeRender(state);
+        }
+        node.Barrier.Emit(commandBuffer, resolve, this->isFirstFrame);
+        this->WaitNodeEvents(node, commandBuffer, resolve);
 
-        node.PassCustom->BeforeRender(state);
-        node.PipelineBarrierCallback(commandBuffer, resolve);
+        {
+            RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, CpuStage::ON_RENDER };
+            commandBuffer.BeginPass(node.PassNative);
+            node.PassCustom->OnRender(state);
+            commandBuffer.EndPass(node.PassNative);
+        }
 
-        commandBuffer.BeginPass(node.PassNative);
-        node.PassCustom->OnRender(state);
-        commandBuffer.EndPass(node.PassNative);
+        {
+            RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, CpuStage::AFTER_RENDER };
+            node.PassCustom->AfterRender(state);
+        }
+        this->SignalNodeEvent(node, commandBuffer);
+        if ((bool)this->profiler) this->profiler->WriteEndTimestamp(commandBuffer, nodeIndex);
+    }
+
+    void RenderGraph::ExecuteSkippedRenderGraphNode(RenderGraphNode& node, CommandBuffer& commandBuffer, ResolveInfo& resolve)
+    {
+        // synchronization is still recorded, later nodes expect resources in the state this node leaves them in
+        auto nodeIndex = this->GetNodeIndex(node);
+        if ((bool)this->profiler) this->profiler->WriteBeginTimestamp(commandBuffer, nodeIndex);
+        node.Barrier.Emit(commandBuffer, resolve, this->isFirstFrame);
+        this->WaitNodeEvents(node, commandBuffer, resolve);
+        this->SignalNodeEvent(node, commandBuffer);
+        if ((bool)this->profiler) this->profiler->WriteEndTimestamp(commandBuffer, nodeIndex);
+    }
 
-        node.PassCustom->AfterRender(state);
+    void RenderGraph::ExecuteMergedRenderGraphNodes(size_t firstNode, size_t subpassCount, CommandBuffer& commandBuffer, ResolveInfo& resolve)
+    {
+        // barriers cannot be recorded inside render pass, so every subpass is prepared before it begins
+        for (size_t nodeIndex = firstNode; nodeIndex < firstNode + subpassCount; nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            RenderPassState state{ *this, commandBuffer, node.PassNative };
+
+            {
+                RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, RenderGraphProfiler::CpuStage::BEFORE_RENDER };
+                node.PassCustom->BeforeRender(state);
+            }
+            node.Barrier.Emit(commandBuffer, resolve, this->isFirstFrame);
+            this->WaitNodeEvents(node, commandBuffer, resolve);
+        }
+
+        // only subpass commands are measured on gpu, they share load and store operations of the render pass
+        for (size_t nodeIndex = firstNode; nodeIndex < firstNode + subpassCount; nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            RenderPassState state{ *this, commandBuffer, node.PassNative };
+            RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, RenderGraphProfiler::CpuStage::ON_RENDER };
+
+            commandBuffer.BeginPass(node.PassNative);
+            if ((bool)this->profiler) this->profiler->WriteBeginTimestamp(commandBuffer, nodeIndex);
+            node.PassCustom->OnRender(state);
+            if ((bool)this->profiler) this->profiler->WriteEndTimestamp(commandBuffer, nodeIndex);
+        }
+        commandBuffer.EndPass(this->nodes[firstNode].PassNative);
+
+        for (size_t nodeIndex = firstNode; nodeIndex < firstNode + subpassCount; nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            RenderPassState state{ *this, commandBuffer, node.PassNative };
+
+            {
+                RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, RenderGraphProfiler::CpuStage::AFTER_RENDER };
+                node.PassCustom->AfterRender(state);
+            }
+            this->SignalNodeEvent(node, commandBuffer);
+        }
+    }
+
+    void RenderGraph::ExecuteRenderGraphNodes(size_t firstNode, size_t nodeCount, CommandBuffer& commandBuffer, ResolveInfo& resolve)
+    {
+        if ((bool)this->recordingThreads)
+        {
+            this->ExecuteRenderGraphNodesInParallel(firstNode, nodeCount, commandBuffer, resolve);
+            return;
+        }
+
+        for (size_t nodeIndex = firstNode; nodeIndex < firstNode + nodeCount;)
+        {
+            size_t subpassCount = 1;
+            while (nodeIndex + subpassCount < firstNode + nodeCount && this->nodes[nodeIndex + subpassCount].PassNative.SubpassIndex > 0)
+                subpassCount++;
+
+            if (subpassCount == 1)
+                this->ExecuteRenderGraphNode(this->nodes[nodeIndex], commandBuffer, resolve);
+            else
+                this->ExecuteMergedRenderGraphNodes(nodeIndex, subpassCount, commandBuffer, resolve);
+            nodeIndex += subpassCount;
+        }
+    }
+
+    CommandBuffer& RenderGraph::AcquireSecondaryCommandBuffer(RecordingFrameResources& frameResources, size_t poolIndex)
+    {
+        auto& commandBuffers = frameResources.CommandBuffers[poolIndex];
+        auto& usedCount = frameResources.UsedCommandBufferCounts[poolIndex];
+
+        if (usedCount == commandBuffers.size())
+        {
+            vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
+            commandBufferAllocateInfo
+                .setCommandPool(frameResources.CommandPools[poolIndex])
+                .setCommandBufferCount(1)
+                .setLevel(vk::CommandBufferLevel::eSecondary);
+
+            commandBuffers.push_back(CommandBuffer{ GetCurrentVulkanContext().GetDevice().allocateCommandBuffers(commandBufferAllocateInfo).front() });
+        }
+        return commandBuffers[usedCount++];
+    }
+
+    void RenderGraph::ExecuteRenderGraphNodesInParallel(size_t firstNode, size_t nodeCount, CommandBuffer& commandBuffer, ResolveInfo& resolve)
+    {
+        auto& frameResources = this->recordingFrameResources[GetCurrentVulkanContext().GetCurrentVirtualFrameIndex()];
+        size_t callingThreadPool = this->recordingThreads->GetWorkerCount();
+
+        // callbacks except OnRender are called in graph order on calling thread, OnRender of node starts right after its BeforeRender
+        for (size_t nodeIndex = firstNode; nodeIndex < firstNode + nodeCount; nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            if (this->nodeVersions[nodeIndex].IsSkipped)
+                continue;
+
+            auto& beforeRenderCommands = this->beforeRenderCommands[nodeIndex];
+            beforeRenderCommands = this->AcquireSecondaryCommandBuffer(frameResources, callingThreadPool);
+
+            beforeRenderCommands.BeginSecondary();
+            {
+                RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, RenderGraphProfiler::CpuStage::BEFORE_RENDER };
+                node.PassCustom->BeforeRender(RenderPassState{ *this, beforeRenderCommands, node.PassNative });
+            }
+            beforeRenderCommands.End();
+
+            // capture fits into std::function small buffer, everything else is looked up by the task
+            this->recordingThreads->Submit([this, nodeIndex](size_t workerIndex)
+            {
+                auto& frameResources = this->recordingFrameResources[GetCurrentVulkanContext().GetCurrentVirtualFrameIndex()];
+                auto& node = this->nodes[nodeIndex];
+                auto& onRenderCommands = this->onRenderCommands[nodeIndex];
+                onRenderCommands = this->AcquireSecondaryCommandBuffer(frameResources, workerIndex);
+
+                size_t renderPassNode = nodeIndex;
+                while (this->nodes[renderPassNode].PassNative.SubpassIndex > 0)
+                    renderPassNode--;
+
+                const auto& renderPass = this->nodes[renderPassNode].PassNative;
+                if ((bool)renderPass.RenderPassHandle || renderPass.UsesDynamicRendering)
+                    onRenderCommands.BeginSecondary(renderPass, node.PassNative.SubpassIndex);
+                else
+                    onRenderCommands.BeginSecondary();
+
+                // timestamps are written to secondary command buffer, primary one cannot record them inside render pass
+                RenderGraphProfiler::CpuScope scope{ this->profiler.get(), nodeIndex, RenderGraphProfiler::CpuStage::ON_RENDER };
+                if ((bool)this->profiler) this->profiler->WriteBeginTimestamp(onRenderCommands, nodeIndex);
+                onRenderCommands.BindPass(node.PassNative);
+                node.PassCustom->OnRender(RenderPassState{ *this, onRenderCommands, node.PassNative });
+                if ((bool)this->profiler) this->profiler->WriteEndTimestamp(onRenderCommands, nodeIndex);
+                onRenderCommands.End();
+            });
+        }
+        this->recordingThreads->Wait();
+
+        // stitch recorded commands in graph order
+        for (size_t nodeIndex = firstNode; nodeIndex < firstNode + nodeCount;)
+        {
+            // cacheable node is never merged with other ones
+            if (this->nodeVersions[nodeIndex].IsSkipped)
+            {
+                this->ExecuteSkippedRenderGraphNode(this->nodes[nodeIndex], commandBuffer, resolve);
+                nodeIndex++;
+                continue;
+            }
+
+            size_t subpassCount = 1;
+            while (nodeIndex + subpassCount < firstNode + nodeCount && this->nodes[nodeIndex + subpassCount].PassNative.SubpassIndex > 0)
+                subpassCount++;
+
+            for (size_t subpassNode = nodeIndex; subpassNode < nodeIndex + subpassCount; subpassNode++)
+            {
+                commandBuffer.ExecuteCommands(this->beforeRenderCommands[subpassNode]);
+                this->nodes[subpassNode].Barrier.Emit(commandBuffer, resolve, this->isFirstFrame);
+                this->WaitNodeEvents(this->nodes[subpassNode], commandBuffer, resolve);
+            }
+
+            for (size_t subpassNode = nodeIndex; subpassNode < nodeIndex + subpassCount; subpassNode++)
+            {
+                commandBuffer.BeginPassWithSecondaryCommands(this->nodes[subpassNode].PassNative);
+                commandBuffer.ExecuteCommands(this->onRenderCommands[subpassNode]);
+            }
+            commandBuffer.EndPass(this->nodes[nodeIndex].PassNative);
+
+            for (size_t subpassNode = nodeIndex; subpassNode < nodeIndex + subpassCount; subpassNode++)
+            {
+                auto& node = this->nodes[subpassNode];
+                {
+                    RenderGraphProfiler::CpuScope scope{ this->profiler.get(), subpassNode, RenderGraphProfiler::CpuStage::AFTER_RENDER };
+                    node.PassCustom->AfterRender(RenderPassState{ *this, commandBuffer, node.PassNative });
+                }
+                this->SignalNodeEvent(node, commandBuffer);
+            }
+            nodeIndex += subpassCount;
+        }
+    }
+
+    void RenderGraph::SetRecordingThreadCount(size_t threadCount)
+    {
+        this->DestroyRecordingResources();
+        if (threadCount == 0)
+            return;
+
+        auto& vulkan = GetCurrentVulkanContext();
+        this->recordingThreads = std::make_unique<ThreadPool>(threadCount);
+        this->beforeRenderCommands.assign(this->nodes.size(), CommandBuffer{ vk::CommandBuffer{ } });
+        this->onRenderCommands.assign(this->nodes.size(), CommandBuffer{ vk::CommandBuffer{ } });
+
+        vk::CommandPoolCreateInfo commandPoolCreateInfo;
+        commandPoolCreateInfo
+            .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+            .setQueueFamilyIndex(vulkan.GetQueueFamilyIndex());
+
+        // command pools are externally synchronized, so each thread records with its own
+        // any thread can record every node in worst case, so command buffers are allocated up front and not while recording
+        this->recordingFrameResources.resize(vulkan.GetVirtualFrameCount());
+        for (auto& frameResources : this->recordingFrameResources)
+        {
+            for (size_t poolIndex = 0; poolIndex < threadCount + 1; poolIndex++)
+                frameResources.CommandPools.push_back(vulkan.GetDevice().createCommandPool(commandPoolCreateInfo));
+            frameResources.CommandBuffers.resize(threadCount + 1);
+            frameResources.UsedCommandBufferCounts.resize(threadCount + 1, 0);
+
+            for (size_t poolIndex = 0; poolIndex < threadCount + 1 && !this->nodes.empty(); poolIndex++)
+            {
+                vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
+                commandBufferAllocateInfo
+                    .setCommandPool(frameResources.CommandPools[poolIndex])
+                    .setCommandBufferCount((uint32_t)this->nodes.size())
+                    .setLevel(vk::CommandBufferLevel::eSecondary);
+
+                for (const auto& commandBuffer : vulkan.GetDevice().allocateCommandBuffers(commandBufferAllocateInfo))
+                    frameResources.CommandBuffers[poolIndex].push_back(CommandBuffer{ commandBuffer });
+            }
+        }
+    }
+
+    void RenderGraph::DestroyRecordingResources()
+    {
+        if (!(bool)this->recordingThreads)
+            return;
+
+        auto& device = GetCurrentVulkanContext().GetDevice();
+        device.waitIdle();
+
+        this->recordingThreads.reset();
+        for (const auto& frameResources : this->recordingFrameResources)
+        {
+            for (const auto& commandPool : frameResources.CommandPools)
+                device.destroyCommandPool(commandPool);
+        }
+        this->recordingFrameResources.clear();
+    }
+
+    void RenderGraph::Resize(uint32_t surfaceWidth, uint32_t surfaceHeight)
+    {
+        auto& vulkan = GetCurrentVulkanContext();
+        // minimized surface is not rendered, attachments are recreated once it has non zero size again
+        if (!vulkan.IsRenderingEnabled() || surfaceWidth == 0 || surfaceHeight == 0)
+            return;
+
+        auto& device = vulkan.GetDevice();
+        device.waitIdle();
+
+        ResolveInfo resolveInfo;
+        PipelineBarrier attachmentBarrier;
+        std::unordered_set<std::string> resizedAttachments;
+        std::unordered_map<size_t, std::vector<SurfaceAttachment*>> aliasedAttachments;
+
+        for (auto& surfaceAttachment : this->surfaceAttachments)
+        {
+            uint32_t width = surfaceAttachment.DeclaredWidth == 0 ? surfaceWidth : surfaceAttachment.DeclaredWidth;
+            uint32_t height = surfaceAttachment.DeclaredHeight == 0 ? surfaceHeight : surfaceAttachment.DeclaredHeight;
+            auto memorySize = (size_t)GetImageMemoryRequirements(width, height, surfaceAttachment.ImageFormat, surfaceAttachment.Usage, surfaceAttachment.Options).size;
+            auto& image = this->attachments.at(surfaceAttachment.Name);
+
+            if (surfaceAttachment.MemoryIndex == SurfaceAttachment::NOT_ALIASED)
+            {
+                image = Image(width, height, surfaceAttachment.ImageFormat, surfaceAttachment.Usage, surfaceAttachment.ImageMemoryUsage, surfaceAttachment.Options);
+                if (surfaceAttachment.ImageMemoryUsage != MemoryUsage::GPU_LAZILY_ALLOCATED)
+                    this->statistics.AttachmentMemoryAllocated += memorySize - surfaceAttachment.MemorySize;
+            }
+            else
+            {
+                aliasedAttachments[surfaceAttachment.MemoryIndex].push_back(&surfaceAttachment);
+            }
+            this->statistics.AttachmentMemoryRequired += memorySize - surfaceAttachment.MemorySize;
+        }
+
+        // images must be destroyed before their shared memory is released
+        for (auto& [memoryIndex, blockAttachments] : aliasedAttachments)
+        {
+            vk::MemoryRequirements blockRequirements;
+            blockRequirements.memoryTypeBits = ~0u;
+            size_t previousBlockSize = 0;
+
+            for (auto* surfaceAttachment : blockAttachments)
+            {
+                uint32_t width = surfaceAttachment->DeclaredWidth == 0 ? surfaceWidth : surfaceAttachment->DeclaredWidth;
+                uint32_t height = surfaceAttachment->DeclaredHeight == 0 ? surfaceHeight : surfaceAttachment->DeclaredHeight;
+                auto memoryRequirements = GetImageMemoryRequirements(width, height, surfaceAttachment->ImageFormat, surfaceAttachment->Usage, surfaceAttachment->Options);
+
+                blockRequirements.size = std::max(blockRequirements.size, memoryRequirements.size);
+                blockRequirements.alignment = std::max(blockRequirements.alignment, memoryRequirements.alignment);
+                blockRequirements.memoryTypeBits &= memoryRequirements.memoryTypeBits;
+                previousBlockSize = std::max(previousBlockSize, surfaceAttachment->MemorySize);
+
+                this->attachments.at(surfaceAttachment->Name) = Image{ };
+            }
+
+            DeallocateMemory(this->attachmentMemory[memoryIndex]);
+            this->attachmentMemory[memoryIndex] = AllocateMemory(blockRequirements, MemoryUsage::GPU_ONLY);
+            this->statistics.AttachmentMemoryAllocated += (size_t)blockRequirements.size - previousBlockSize;
+
+            for (auto* surfaceAttachment : blockAttachments)
+            {
+                uint32_t width = surfaceAttachment->DeclaredWidth == 0 ? surfaceWidth : surfaceAttachment->DeclaredWidth;
+                uint32_t height = surfaceAttachment->DeclaredHeight == 0 ? surfaceHeight : surfaceAttachment->DeclaredHeight;
+                this->attachments.at(surfaceAttachment->Name) = Image(
+                    width, height, surfaceAttachment->ImageFormat, surfaceAttachment->Usage, surfaceAttachment->Options, this->attachmentMemory[memoryIndex], 0
+                );
+            }
+        }
+        this->statistics.AttachmentMemorySaved = this->statistics.AttachmentMemoryRequired - this->statistics.AttachmentMemoryAllocated;
+
+        for (auto& surfaceAttachment : this->surfaceAttachments)
+        {
+            auto& image = this->attachments.at(surfaceAttachment.Name);
+            surfaceAttachment.MemorySize = (size_t)GetImageMemoryRequirements(image.GetWidth(), image.GetHeight(), surfaceAttachment.ImageFormat, surfaceAttachment.Usage, surfaceAttachment.Options).size;
+
+            for (const auto& initialTransition : surfaceAttachment.InitialTransitions)
+                attachmentBarrier.AddTransition(surfaceAttachment.Name, initialTransition);
+            resolveInfo.Resolve(surfaceAttachment.Name, image);
+            resizedAttachments.insert(surfaceAttachment.Name);
+            // content of recreated image is lost, cacheable nodes which use it are executed again
+            this->InvalidateResource(surfaceAttachment.Name);
+        }
+
+        for (size_t nodeIndex = 0; nodeIndex < this->nodes.size(); nodeIndex++)
+        {
+            auto& node = this->nodes[nodeIndex];
+            if (node.Descriptors.GetOptions() == ResolveOptions::ALREADY_RESOLVED)
+                node.Descriptors.SetOptions(ResolveOptions::RESOLVE_ONCE);
+            node.Descriptors.InvalidateWrites();
+
+            bool isResized = std::any_of(node.FramebufferAttachments.begin(), node.FramebufferAttachments.end(), [&resizedAttachments](const FramebufferAttachment& attachment)
+            {
+                return resizedAttachments.count(attachment.Name) > 0;
+            });
+            if (node.PassNative.UsesDynamicRendering && isResized)
+                node.PassNative.RenderArea = vk::Rect2D{ vk::Offset2D{ 0u, 0u }, this->UpdateRenderingAttachments(node) };
+            if (!(bool)node.PassNative.Framebuffer || !isResized)
+                continue;
+
+            auto extent = this->RecreateNodeFramebuffers(node);
+
+            // merged subpasses share render area of the render pass
+            vk::Rect2D renderArea{ vk::Offset2D{ 0u, 0u }, extent };
+            node.PassNative.RenderArea = renderArea;
+            for (size_t subpassNode = nodeIndex + 1; subpassNode < this->nodes.size() && this->nodes[subpassNode].PassNative.SubpassIndex > 0; subpassNode++)
+                this->nodes[subpassNode].PassNative.RenderArea = renderArea;
+        }
+
+        // new images have undefined layout, if graph was not executed yet create callback still transitions all attachments
+        if (!(bool)this->onCreate)
+        {
+            this->onCreate = [resolve = std::move(resolveInfo), barrier = std::move(attachmentBarrier)](CommandBuffer& commandBuffer) mutable
+            {
+                barrier.Emit(commandBuffer, resolve);
+            };
+        }
     }
 
     void RenderGraph::Execute(CommandBuffer& commandBuffer)
     {
+        // batches split frame command buffer into several submits, recording anything to other command buffer would break their synchronization
+        bool isFrameCommandBuffer = &commandBuffer == &GetCurrentVulkanContext().GetCurrentCommandBuffer();
+        assert(this->batchFrameResources.empty() || isFrameCommandBuffer);
+        if (!this->batchFrameResources.empty() && !isFrameCommandBuffer)
+            return;
+
+        // images written in previous frame become history, rotated here so present still sees images of last executed frame
+        if (!this->isFirstFrame)
+            this->RotateHistoryAttachments();
         this->InitializeOnFirstFrame(commandBuffer);
+        this->UpdateSkippedNodes();
 
-        ResolveInfo resolve;
-        for (const auto& [attachmentName, attachment] : this->attachments)
+        if ((bool)this->recordingThreads)
         {
-            resolve.Resolve(attachmentName, attachment);
+            // frame fence was waited, secondary command buffers of this virtual frame can be reused
+            auto& frameResources = this->recordingFrameResources[GetCurrentVulkanContext().GetCurrentVirtualFrameIndex()];
+            for (size_t poolIndex = 0; poolIndex < frameResources.CommandPools.size(); poolIndex++)
+            {
+                GetCurrentVulkanContext().GetDevice().resetCommandPool(frameResources.CommandPools[poolIndex]);
+                frameResources.UsedCommandBufferCounts[poolIndex] = 0;
+            }
         }
 
-        for (auto& node : this->nodes)
+        // frame fence was waited, so events of this virtual frame are not used by device anymore
+        auto frameIndex = GetCurrentVulkanContext().GetCurrentVirtualFrameIndex();
+        for (const auto& node : this->nodes)
+        {
+            if (!node.SignalEvents.empty())
+                GetCurrentVulkanContext().GetDevice().resetEvent(node.SignalEvents[frameIndex]);
+        }
+
+        if ((bool)this->profiler)
+            this->profiler->BeginFrame(commandBuffer);
+
+        // resources resolved by passes are interned on first frame, later frames only refill preallocated storage
+        auto& resolve = this->resolveInfo;
+        resolve.Clear();
+        for (const auto& [attachmentHandle, attachment] : this->attachmentResolves)
+        {
+            resolve.Resolve(attachmentHandle, *attachment);
+        }
+        this->UpdateNodeDescriptors(resolve);
+
+        if (this->batchFrameResources.empty())
+        {
+            this->ExecuteRenderGraphNodes(0, this->nodes.size(), commandBuffer, resolve);
+        }
+        else
+        {
+            this->ExecuteBatches(commandBuffer, resolve);
+        }
+
+        if ((bool)this->profiler)
+            this->profiler->EndFrame();
+        this->isFirstFrame = false;
+    }
+
+    void RenderGraph::ExecuteBatches(CommandBuffer& commandBuffer, ResolveInfo& resolve)
+    {
+        auto& vulkan = GetCurrentVulkanContext();
+        auto& frameResources = this->batchFrameResources[vulkan.GetCurrentVirtualFrameIndex()];
+        bool hasPendingGraphicsCommands = true;
+
+        for (size_t batchIndex = 0; batchIndex < this->batches.size(); batchIndex++)
+        {
+            auto& batch = this->batches[batchIndex];
+
+            if (batch.Queue == QueueType::GRAPHICS)
+            {
+                // independent graphic work is already submitted, so it can overlap with compute
+                if (!batch.WaitBatches.empty() && hasPendingGraphicsCommands)
+                {
+                    vulkan.SubmitCurrentCommandBuffer({ });
+                }
+                for (size_t waitBatch : batch.WaitBatches)
+                {
+                    vulkan.AddFrameWaitSemaphore(frameResources.ComputeSemaphores[waitBatch], vk::PipelineStageFlagBits::eAllCommands);
+                }
+
+                this->ExecuteRenderGraphNodes(batch.FirstNode, batch.NodeCount, commandBuffer, resolve);
+                batch.ReleaseBarrier.Emit(commandBuffer, resolve);
+                hasPendingGraphicsCommands = true;
+            }
+            else
+            {
+                // compute batch starts after all previously recorded graphic work
+                auto& graphicsSemaphore = frameResources.GraphicsSemaphores[batchIndex];
+                auto& computeSemaphore = frameResources.ComputeSemaphores[batchIndex];
+                vulkan.SubmitCurrentCommandBuffer(ArrayView<const vk::Semaphore>{ &graphicsSemaphore, 1 });
+                hasPendingGraphicsCommands = false;
+
+                auto& computeCommands = frameResources.CommandBuffers[batchIndex];
+                computeCommands.Begin();
+                for (size_t nodeIndex = batch.FirstNode; nodeIndex < batch.FirstNode + batch.NodeCount; nodeIndex++)
+                {
+                    this->ExecuteRenderGraphNode(this->nodes[nodeIndex], computeCommands, resolve);
+                }
+                batch.ReleaseBarrier.Emit(computeCommands, resolve);
+                computeCommands.End();
+
+                vulkan.GetCurrentStageBuffer().Flush();
+
+                vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+                vk::SubmitInfo submitInfo;
+                submitInfo
+                    .setWaitSemaphores(graphicsSemaphore)
+                    .setWaitDstStageMask(waitStage)
+                    .setSignalSemaphores(computeSemaphore)
+                    .setCommandBuffers(computeCommands.GetNativeHandle());
+
+                vulkan.GetComputeQueue().submit(std::array{ submitInfo }, vk::Fence{ });
+            }
+        }
+
+        // every signaled semaphore must be waited, also frame fence must cover compute work
+        for (size_t batchIndex = 0; batchIndex < this->batches.size(); batchIndex++)
         {
-            this->ExecuteRenderGraphNode(node, commandBuffer, resolve);
+            if (this->batches[batchIndex].IsWaitedAtFrameEnd)
+                vulkan.AddFrameWaitSemaphore(frameResources.ComputeSemaphores[batchIndex], vk::PipelineStageFlagBits::eAllCommands);
         }
     }
 
+    void RenderGraph::SetProfiling(bool enabled)
+    {
+        if (!enabled && (bool)this->profiler)
+        {
+            // query pools can still be used by frames in flight
+            GetCurrentVulkanContext().GetDevice().waitIdle();
+            this->profiler.reset();
+        }
+        if (enabled && !(bool)this->profiler)
+        {
+            std::vector<std::string> nodeNames;
+            for (const auto& node : this->nodes)
+                nodeNames.push_back(node.Name);
+            this->profiler = std::make_unique<RenderGraphProfiler>(std::move(nodeNames));
+        }
+    }
+
+    const RenderGraphNodeProfile& RenderGraph::GetNodeProfile(const std::string& name) const
+    {
+        assert((bool)this->profiler);
+        return this->profiler->GetNodeProfile(this->GetNodeIndex(this->GetNodeByName(name)));
+    }
+
+    void RenderGraph::WriteProfilingTrace(const std::string& filepath) const
+    {
+        assert((bool)this->profiler);
+        this->profiler->WriteChromeTrace(filepath);
+    }
+
     void RenderGraph::Present(CommandBuffer& commandBuffer, const Image& presentImage)
     {
         this->onPresent(commandBuffer, this->attachments.at(this->outputName), presentImage);
@@ -106,16 +956,50 @@ namespace VulkanAbstractionLayer
         auto& device = vulkan.GetDevice();
         device.waitIdle();
 
-        for (const auto& node : this->nodes)
+        this->DestroyRecordingResources();
+        this->profiler.reset();
+        auto& descriptorCache = vulkan.GetDescriptorCache();
+        for (auto& node : this->nodes)
         {
             auto& pass = node.PassNative;
+            node.Descriptors.DestroyUpdateTemplate();
             if ((bool)pass.Pipeline)         device.destroyPipeline(pass.Pipeline);
-            if ((bool)pass.PipelineLayout)   device.destroyPipelineLayout(pass.PipelineLayout);
-            if ((bool)pass.Framebuffer)      device.destroyFramebuffer(pass.Framebuffer);
+            if ((bool)pass.PipelineLayout)   descriptorCache.ReleasePipelineLayout(pass.PipelineLayout);
+            for (const auto& descriptorSet : pass.FrameDescriptorSets)
+                descriptorCache.ReleaseDescriptor({ pass.DescriptorSetLayout, descriptorSet });
+            if ((bool)pass.Framebuffer && node.HistoryFramebuffers.empty()) device.destroyFramebuffer(pass.Framebuffer);
+            for (const auto& framebuffer : node.HistoryFramebuffers)
+                device.destroyFramebuffer(framebuffer);
             if ((bool)pass.RenderPassHandle) device.destroyRenderPass(pass.RenderPassHandle);
+            for (const auto& event : node.SignalEvents)
+                device.destroyEvent(event);
         }
         this->nodes.clear();
         this->attachments.clear();
+
+        for (const auto& frameResources : this->batchFrameResources)
+        {
+            for (const auto& commandBuffer : frameResources.CommandBuffers)
+                device.freeCommandBuffers(vulkan.GetComputeCommandPool(), commandBuffer.GetNativeHandle());
+            for (const auto& semaphore : frameResources.GraphicsSemaphores)
+                device.destroySemaphore(semaphore);
+            for (const auto& semaphore : frameResources.ComputeSemaphores)
+                device.destroySemaphore(semaphore);
+        }
+        this->batchFrameResources.clear();
+
+        // aliased attachments are destroyed, memory can be released
+        for (auto memory : this->attachmentMemory)
+            DeallocateMemory(memory);
+        this->attachmentMemory.clear();
+    }
+
+    std::vector<std::string> RenderGraph::GetExecutionOrder() const
+    {
+        std::vector<std::string> executionOrder;
+        for (const auto& node : this->nodes)
+            executionOrder.push_back(node.Name);
+        return executionOrder;
     }
 
     const Image& RenderGraph::GetAttachmentByName(const std::string& name) const
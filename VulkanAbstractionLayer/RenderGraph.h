@@ -31,22 +31,86 @@
 #include "RenderPass.h"
 #include "Image.h"
 #include "CommandBuffer.h"
+#include "PipelineBarrier.h"
+#include "ThreadPool.h"
+#include "RenderGraphProfiler.h"
 
 #include <vector>
 #include <functional>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace VulkanAbstractionLayer
 {
+    struct FramebufferAttachment
+    {
+        std::string Name;
+        uint32_t Layer;
+    };
+
     struct RenderGraphNode
     {
         std::string Name;
         PassNative PassNative;
         std::unique_ptr<RenderPass> PassCustom;
         std::vector<std::string> UsedAttachments;
-        std::function<void(CommandBuffer&, const ResolveInfo&)> PipelineBarrierCallback;
+        PipelineBarrier Barrier;
         DescriptorBinding Descriptors;
+        std::vector<FramebufferAttachment> FramebufferAttachments; // only for node which owns render pass
+        PipelineBarrier EventBarrier; // waits for events of earlier nodes instead of pipeline barrier
+        std::vector<size_t> WaitedNodes;
+        vk::PipelineStageFlags SignalStages = { }; // not empty if later node waits for this one
+        std::vector<vk::Event> SignalEvents = { }; // one per virtual frame
+        std::vector<vk::Framebuffer> HistoryFramebuffers = { }; // one per history rotation if framebuffer uses history attachment
+        bool IsCacheable = false; // skipped while versions of its inputs are unchanged
+        std::vector<std::string> VersionedInputs = { }; // resources and cache parameters, only for cacheable node
+        std::vector<std::string> VersionedOutputs = { }; // resources written by node, their versions are increased on execution
+    };
+
+    // attachment declared with zero width or height, recreated when surface is resized
+    struct SurfaceAttachment
+    {
+        constexpr static size_t NOT_ALIASED = size_t(-1);
+
+        std::string Name;
+        Format ImageFormat;
+        uint32_t DeclaredWidth;
+        uint32_t DeclaredHeight;
+        ImageUsage::Value Usage;
+        ImageOptions::Value Options;
+        std::vector<ImageTransition> InitialTransitions; // to usage of each subresource at the beginning of frame
+        size_t MemoryIndex; // index of shared memory in graph attachment memory
+        size_t MemorySize;
+        MemoryUsage ImageMemoryUsage = MemoryUsage::GPU_ONLY;
+    };
+
+    // contiguous range of nodes submitted to the same queue
+    struct RenderGraphBatch
+    {
+        QueueType Queue;
+        size_t FirstNode;
+        size_t NodeCount;
+        std::vector<size_t> WaitBatches; // compute batches which graphics batch waits for
+        bool IsWaitedAtFrameEnd;
+        PipelineBarrier ReleaseBarrier;
+    };
+
+    struct RenderGraphStatistics
+    {
+        size_t AttachmentMemoryRequired = 0;
+        size_t AttachmentMemoryAllocated = 0;
+        size_t AttachmentMemorySaved = 0;
+        size_t AliasedAttachmentCount = 0;
+        size_t LazilyAllocatedAttachmentCount = 0; // memoryless, counted as required but not allocated
+        size_t CulledPassCount = 0;
+        size_t AsyncComputePassCount = 0;
+        size_t PipelineBarrierCountBeforeReordering = 0; // in order passes were added
+        size_t PipelineBarrierCount = 0;
+        size_t MergedSubpassCount = 0;
+        size_t SplitBarrierCount = 0; // transitions synchronized with events
+        size_t CoalescedPipelineBarrierCount = 0; // barriers merged into barrier of earlier render pass
+        size_t RecordedPipelineBarrierCount = 0; // per frame, excluding queue ownership releases
     };
 
     class RenderGraph
@@ -54,25 +118,109 @@ namespace VulkanAbstractionLayer
         using PresentCallback = std::function<void(CommandBuffer&, const Image&, const Image&)>;
         using CreateCallback = std::function<void(CommandBuffer&)>;
 
+        struct BatchFrameResources
+        {
+            std::vector<CommandBuffer> CommandBuffers;
+            std::vector<vk::Semaphore> GraphicsSemaphores;
+            std::vector<vk::Semaphore> ComputeSemaphores;
+        };
+
+        struct NodeVersions
+        {
+            std::vector<size_t> Inputs; // indices of resource versions
+            std::vector<size_t> Outputs;
+            std::vector<uint64_t> ExecutedInputVersions; // empty until cacheable node is executed
+            bool IsSkipped = false;
+        };
+
+        struct RecordingFrameResources
+        {
+            std::vector<vk::CommandPool> CommandPools; // one per worker thread, last one is used by calling thread
+            std::vector<std::vector<CommandBuffer>> CommandBuffers;
+            std::vector<size_t> UsedCommandBufferCounts;
+        };
+
         std::vector<RenderGraphNode> nodes;
         std::unordered_map<std::string, Image> attachments;
         std::string outputName;
         PresentCallback onPresent;
         CreateCallback onCreate;
+        std::vector<VmaAllocation> attachmentMemory;
+        std::vector<SurfaceAttachment> surfaceAttachments;
+        RenderGraphStatistics statistics;
+        std::vector<RenderGraphBatch> batches;
+        std::vector<BatchFrameResources> batchFrameResources;
+        bool isFirstFrame = true;
+        std::unique_ptr<ThreadPool> recordingThreads;
+        std::vector<RecordingFrameResources> recordingFrameResources;
+        std::vector<CommandBuffer> beforeRenderCommands;
+        std::vector<CommandBuffer> onRenderCommands;
+        std::vector<vk::Event> waitedEvents;
+        std::unique_ptr<RenderGraphProfiler> profiler;
+        std::vector<std::vector<std::string>> historyAttachments; // names of history images ordered by age
+        size_t historyRotation = 0;
+        size_t historyPeriod = 1; // rotations after which every history image is back under its original name
+        ResolveInfo resolveInfo; // reused each frame, names of graph resources are interned on creation
+        std::vector<std::pair<ResourceHandle, const Image*>> attachmentResolves;
+        std::vector<NodeVersions> nodeVersions;
+        std::vector<uint64_t> resourceVersions; // increased when resource is written or invalidated
+        std::unordered_map<std::string, size_t> resourceVersionIndices;
+        size_t skippedNodeCount = 0;
+        std::vector<vk::WriteDescriptorSet> descriptorWrites; // of all nodes in current frame, capacity is kept
+        size_t writtenDescriptorCount = 0;
 
         void InitializeOnFirstFrame(CommandBuffer& commandBuffer);
+        void InitializeBatchResources();
+        void InitializeEventResources();
+        void InitializeHistoryResources();
+        void InitializeResolveHandles();
+        void InitializeNodeVersions();
+        size_t GetResourceVersionIndex(const std::string& name);
+        void UpdateSkippedNodes();
+        void UpdateNodeDescriptors(ResolveInfo& resolve);
+        void ExecuteSkippedRenderGraphNode(RenderGraphNode& node, CommandBuffer& commandBuffer, ResolveInfo& resolve);
+        const Image& GetRotatedAttachment(const std::string& name, size_t rotation) const;
+        vk::Framebuffer CreateNodeFramebuffer(const RenderGraphNode& node, size_t rotation, vk::Extent2D& extent) const;
+        vk::Extent2D RecreateNodeFramebuffers(RenderGraphNode& node);
+        vk::Extent2D UpdateRenderingAttachments(RenderGraphNode& node);
+        void RotateHistoryAttachments();
+        void WaitNodeEvents(RenderGraphNode& node, CommandBuffer& commandBuffer, ResolveInfo& resolve);
+        void SignalNodeEvent(RenderGraphNode& node, CommandBuffer& commandBuffer);
+        size_t GetNodeIndex(const RenderGraphNode& node) const { return size_t(&node - this->nodes.data()); }
+        void ExecuteMergedRenderGraphNodes(size_t firstNode, size_t subpassCount, CommandBuffer& commandBuffer, ResolveInfo& resolve);
+        void ExecuteRenderGraphNodes(size_t firstNode, size_t nodeCount, CommandBuffer& commandBuffer, ResolveInfo& resolve);
+        void ExecuteRenderGraphNodesInParallel(size_t firstNode, size_t nodeCount, CommandBuffer& commandBuffer, ResolveInfo& resolve);
+        CommandBuffer& AcquireSecondaryCommandBuffer(RecordingFrameResources& frameResources, size_t poolIndex);
+        void DestroyRecordingResources();
+        void ExecuteBatches(CommandBuffer& commandBuffer, ResolveInfo& resolve);
     public:
-        RenderGraph(std::vector<RenderGraphNode> nodes, std::unordered_map<std::string, Image> attachments, const std::string& outputName, PresentCallback onPresent, CreateCallback onCreate);
+        RenderGraph(std::vector<RenderGraphNode> nodes, std::unordered_map<std::string, Image> attachments, const std::string& outputName, PresentCallback onPresent, CreateCallback onCreate, std::vector<VmaAllocation> attachmentMemory, std::vector<SurfaceAttachment> surfaceAttachments, const RenderGraphStatistics& statistics, std::vector<RenderGraphBatch> batches, std::vector<std::vector<std::string>> historyAttachments);
         ~RenderGraph();
         RenderGraph(RenderGraph&&) = default;
         RenderGraph& operator=(RenderGraph&& other) = delete;
 
         void ExecuteRenderGraphNode(RenderGraphNode& node, CommandBuffer& commandBuffer, ResolveInfo& resolve);
+        // graph with async compute batches splits frame command buffer into several submits, so it must be given current command buffer of context
         void Execute(CommandBuffer& commandBuffer);
+        // OnRender callbacks of graphic queue passes are recorded concurrently, 0 records everything on calling thread
+        void SetRecordingThreadCount(size_t threadCount);
+        // recreates surface sized attachments and framebuffers which use them, pipelines are kept, size should be clamped surface extent of context
+        void Resize(uint32_t surfaceWidth, uint32_t surfaceHeight);
+        // gpu timestamps around every node and cpu time of its callbacks, gpu results are read back when virtual frame is reused
+        void SetProfiling(bool enabled);
+        const RenderGraphNodeProfile& GetNodeProfile(const std::string& name) const;
+        void WriteProfilingTrace(const std::string& filepath) const;
         void Present(CommandBuffer& commandBuffer, const Image& presentImage);
         const RenderGraphNode& GetNodeByName(const std::string& name) const;
         RenderGraphNode& GetNodeByName(const std::string& name);
         const Image& GetAttachmentByName(const std::string& name) const;
+        const RenderGraphStatistics& GetStatistics() const { return this->statistics; }
+        // increases version of resource or cache parameter, so cacheable nodes which depend on it are executed again
+        void InvalidateResource(const std::string& name);
+        void InvalidateCachedNodes();
+        size_t GetSkippedNodeCount() const { return this->skippedNodeCount; } // in last executed frame
+        size_t GetWrittenDescriptorCount() const { return this->writtenDescriptorCount; } // in last executed frame
+        std::vector<std::string> GetExecutionOrder() const;
 
         template<typename T>
         T& GetRenderPassByName(const std::string& name)
@@ -32,6 +32,9 @@
 #include "GraphicShader.h"
 #include "ComputeShader.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace VulkanAbstractionLayer
 {
     vk::VertexInputRate VertexBindingRateToVertexInputRate(VertexBinding::Rate rate)
@@ -106,252 +109,322 @@ namespace VulkanAbstractionLayer
         }
     }
 
-    vk::PipelineStageFlags BufferUsageToPipelineStage(BufferUsage::Bits layout)
+    static std::vector<std::string> GetRenderPassResourceNames(const Pipeline& pipeline)
     {
-        switch (layout)
-        {
-        case BufferUsage::UNKNOWN:
-            return vk::PipelineStageFlagBits::eTopOfPipe;
-        case BufferUsage::TRANSFER_SOURCE:
-            return vk::PipelineStageFlagBits::eTransfer;
-        case BufferUsage::TRANSFER_DESTINATION:
-            return vk::PipelineStageFlagBits::eTransfer;
-        case BufferUsage::UNIFORM_TEXEL_BUFFER:
-            return vk::PipelineStageFlagBits::eVertexShader; // TODO: from other shader stages?
-        case BufferUsage::STORAGE_TEXEL_BUFFER:
-            return vk::PipelineStageFlagBits::eComputeShader;
-        case BufferUsage::UNIFORM_BUFFER:
-            return vk::PipelineStageFlagBits::eVertexShader;
-        case BufferUsage::STORAGE_BUFFER:
-            return vk::PipelineStageFlagBits::eComputeShader;
-        case BufferUsage::INDEX_BUFFER:
-            return vk::PipelineStageFlagBits::eVertexInput;
-        case BufferUsage::VERTEX_BUFFER:
-            return vk::PipelineStageFlagBits::eVertexInput;
-        case BufferUsage::INDIRECT_BUFFER:
-            return vk::PipelineStageFlagBits::eDrawIndirect;
-        case BufferUsage::SHADER_DEVICE_ADDRESS:
-            return vk::PipelineStageFlagBits::eFragmentShader; // TODO: what should be here?
-        case BufferUsage::TRANSFORM_FEEDBACK_BUFFER:
-            return vk::PipelineStageFlagBits::eTransformFeedbackEXT;
-        case BufferUsage::TRANSFORM_FEEDBACK_COUNTER_BUFFER:
-            return vk::PipelineStageFlagBits::eTransformFeedbackEXT;
-        case BufferUsage::CONDITIONAL_RENDERING:
-            return vk::PipelineStageFlagBits::eConditionalRenderingEXT;
-        case BufferUsage::ACCELERATION_STRUCTURE_BUILD_INPUT_READONLY:
-            return vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR;
-        case BufferUsage::ACCELERATION_STRUCTURE_STORAGE:
-            return vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR; // TODO: what should be here?
-        case BufferUsage::SHADER_BINDING_TABLE:
-            return vk::PipelineStageFlagBits::eFragmentShader; // TODO: what should be here?
-        default:
-            assert(false);
-            return vk::PipelineStageFlags{ };
-        }
+        std::vector<std::string> resourceNames;
+        for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+            resourceNames.push_back(bufferDependency.Name);
+        for (const auto& imageDependency : pipeline.GetImageDependencies())
+            resourceNames.push_back(imageDependency.Name);
+        for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+            resourceNames.push_back(outputAttachment.Name);
+        return resourceNames;
     }
 
-    vk::AccessFlags BufferUsageToAccessFlags(BufferUsage::Bits layout)
+    std::vector<QueueType> RenderGraphBuilder::GetRenderPassQueues(const PipelineHashMap& pipelines)
     {
-        switch (layout)
+        std::vector<QueueType> renderPassQueues;
+        bool hasAsyncCompute = GetCurrentVulkanContext().HasAsyncCompute();
+
+        for (const auto& renderPassReference : this->renderPassReferences)
         {
-        case BufferUsage::UNKNOWN:
-            return vk::AccessFlags{ };
-        case BufferUsage::TRANSFER_SOURCE:
-            return vk::AccessFlagBits::eTransferRead;
-        case BufferUsage::TRANSFER_DESTINATION:
-            return vk::AccessFlagBits::eTransferWrite;
-        case BufferUsage::UNIFORM_TEXEL_BUFFER:
-            return vk::AccessFlagBits::eShaderRead;
-        case BufferUsage::STORAGE_TEXEL_BUFFER:
-            return vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead;
-        case BufferUsage::UNIFORM_BUFFER:
-            return vk::AccessFlagBits::eShaderRead;
-        case BufferUsage::STORAGE_BUFFER:
-            return vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead;
-        case BufferUsage::INDEX_BUFFER:
-            return vk::AccessFlagBits::eIndexRead;
-        case BufferUsage::VERTEX_BUFFER:
-            return vk::AccessFlagBits::eVertexAttributeRead;
-        case BufferUsage::INDIRECT_BUFFER:
-            return vk::AccessFlagBits::eIndirectCommandRead;
-        case BufferUsage::SHADER_DEVICE_ADDRESS:
-            return vk::AccessFlagBits::eShaderRead;
-        case BufferUsage::TRANSFORM_FEEDBACK_BUFFER:
-            return vk::AccessFlagBits::eTransformFeedbackWriteEXT;
-        case BufferUsage::TRANSFORM_FEEDBACK_COUNTER_BUFFER:
-            return vk::AccessFlagBits::eTransformFeedbackCounterWriteEXT;
-        case BufferUsage::CONDITIONAL_RENDERING:
-            return vk::AccessFlagBits::eConditionalRenderingReadEXT;
-        case BufferUsage::ACCELERATION_STRUCTURE_BUILD_INPUT_READONLY:
-            return vk::AccessFlagBits::eAccelerationStructureReadKHR;
-        case BufferUsage::ACCELERATION_STRUCTURE_STORAGE:
-            return vk::AccessFlagBits::eAccelerationStructureReadKHR;
-        case BufferUsage::SHADER_BINDING_TABLE:
-            return vk::AccessFlagBits::eShaderRead;
-        default:
-            assert(false);
-            return vk::AccessFlags{ };
+            const auto& pipeline = pipelines.at(renderPassReference.Name);
+            auto resourceNames = GetRenderPassResourceNames(pipeline);
+
+            // output image is blitted to swapchain on graphics queue, keep its users there
+            bool isAsyncCompute = hasAsyncCompute &&
+                pipeline.GetQueueType() == QueueType::ASYNC_COMPUTE &&
+                pipeline.GetOutputAttachments().empty() &&
+                dynamic_cast<GraphicShader*>(pipeline.Shader.get()) == nullptr &&
+                std::find(resourceNames.begin(), resourceNames.end(), this->outputName) == resourceNames.end();
+
+            renderPassQueues.push_back(isAsyncCompute ? QueueType::ASYNC_COMPUTE : QueueType::GRAPHICS);
+            if (isAsyncCompute) this->statistics.AsyncComputePassCount++;
         }
+        return renderPassQueues;
     }
 
-    bool HasImageWriteDependency(ImageUsage::Bits usage)
+    std::vector<RenderGraphBatch> RenderGraphBuilder::CreateBatches(const PipelineHashMap& pipelines, const std::vector<QueueType>& renderPassQueues)
     {
-        switch (usage)
+        std::vector<RenderGraphBatch> batches;
+        std::vector<std::unordered_set<std::string>> batchResources;
+        size_t firstUnwaitedBatch = 0;
+
+        for (size_t renderPassIndex = 0; renderPassIndex < renderPassQueues.size(); renderPassIndex++)
         {
-        case ImageUsage::TRANSFER_DISTINATION:
-        case ImageUsage::STORAGE:
-        case ImageUsage::COLOR_ATTACHMENT:
-        case ImageUsage::DEPTH_SPENCIL_ATTACHMENT:
-        case ImageUsage::FRAGMENT_SHADING_RATE_ATTACHMENT:
-            return true;
-        default:
-            return false;
+            auto queue = renderPassQueues[renderPassIndex];
+            auto resourceNames = GetRenderPassResourceNames(pipelines.at(this->renderPassReferences[renderPassIndex].Name));
+            std::vector<size_t> waitBatches;
+
+            // graphic pass waits only for the latest compute batch it shares resources with (and all compute batches before it)
+            for (size_t batchIndex = batches.size(); queue == QueueType::GRAPHICS && batchIndex > firstUnwaitedBatch; batchIndex--)
+            {
+                const auto& resources = batchResources[batchIndex - 1];
+                bool isDependent = std::any_of(resourceNames.begin(), resourceNames.end(), [&resources](const std::string& name)
+                {
+                    return resources.count(name) > 0;
+                });
+                if (batches[batchIndex - 1].Queue != QueueType::ASYNC_COMPUTE || !isDependent)
+                    continue;
+
+                for (size_t waitBatch = firstUnwaitedBatch; waitBatch < batchIndex; waitBatch++)
+                {
+                    if (batches[waitBatch].Queue == QueueType::ASYNC_COMPUTE)
+                        waitBatches.push_back(waitBatch);
+                }
+                firstUnwaitedBatch = batchIndex;
+                break;
+            }
+
+            if (batches.empty() || batches.back().Queue != queue || !waitBatches.empty())
+            {
+                batches.push_back(RenderGraphBatch{ queue, renderPassIndex, 0, std::move(waitBatches), false, PipelineBarrier{ } });
+                batchResources.emplace_back();
+            }
+            batches.back().NodeCount++;
+            batchResources.back().insert(resourceNames.begin(), resourceNames.end());
         }
-    }
 
-    bool HasBufferWriteDependency(BufferUsage::Bits usage)
-    {
-        switch (usage)
+        for (size_t batchIndex = firstUnwaitedBatch; batchIndex < batches.size(); batchIndex++)
         {
-        case BufferUsage::TRANSFER_DESTINATION:
-        case BufferUsage::UNIFORM_TEXEL_BUFFER:
-        case BufferUsage::STORAGE_TEXEL_BUFFER:
-        case BufferUsage::STORAGE_BUFFER:
-        case BufferUsage::TRANSFORM_FEEDBACK_BUFFER:
-        case BufferUsage::TRANSFORM_FEEDBACK_COUNTER_BUFFER:
-        case BufferUsage::ACCELERATION_STRUCTURE_STORAGE:
-            return true;
-        default:
-            return false;
+            batches[batchIndex].IsWaitedAtFrameEnd = batches[batchIndex].Queue == QueueType::ASYNC_COMPUTE;
         }
+        return batches;
     }
 
-    vk::ImageMemoryBarrier CreateImageMemoryBarrier(VkImage image, ImageUsage::Bits oldUsage, ImageUsage::Bits newUsage, Format format, uint32_t mipLevelCount, uint32_t layerCount)
+    std::vector<PipelineBarrier> RenderGraphBuilder::CreatePipelineBarriers(const std::vector<QueueType>& renderPassQueues, std::vector<RenderGraphBatch>& batches, const std::vector<size_t>& subpassGroups, const ResourceTransitions& resourceTransitions, std::vector<EventBarrier>& eventBarriers)
     {
-        vk::ImageSubresourceRange subresourceRange;
-        subresourceRange
-            .setAspectMask(ImageFormatToImageAspect(format))
-            .setBaseArrayLayer(0)
-            .setBaseMipLevel(0)
-            .setLayerCount(layerCount)
-            .setLevelCount(mipLevelCount);
+        auto& vulkan = GetCurrentVulkanContext();
+        auto getQueueFamily = [&vulkan](QueueType queue)
+        {
+            return queue == QueueType::ASYNC_COMPUTE ? vulkan.GetComputeQueueFamilyIndex() : vulkan.GetQueueFamilyIndex();
+        };
 
-        vk::ImageMemoryBarrier imageBarrier;
-        imageBarrier
-            .setImage(image)
-            .setOldLayout(ImageUsageToImageLayout(oldUsage))
-            .setNewLayout(ImageUsageToImageLayout(newUsage))
-            .setSrcAccessMask(ImageUsageToAccessFlags(oldUsage))
-            .setDstAccessMask(ImageUsageToAccessFlags(newUsage))
-            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-            .setSubresourceRange(subresourceRange);
+        std::vector<size_t> renderPassBatches(renderPassQueues.size());
+        for (size_t batchIndex = 0; batchIndex < batches.size(); batchIndex++)
+        {
+            for (size_t i = 0; i < batches[batchIndex].NodeCount; i++)
+                renderPassBatches[batches[batchIndex].FirstNode + i] = batchIndex;
+        }
 
-        return imageBarrier;
-    }
+        std::unordered_map<std::string, std::vector<size_t>> bufferUsers;
+        for (size_t renderPassIndex = 0; renderPassIndex < this->renderPassReferences.size(); renderPassIndex++)
+        {
+            const auto& renderPassName = this->renderPassReferences[renderPassIndex].Name;
+            for (const auto& [bufferName, bufferTransition] : resourceTransitions.Buffers.Transitions.at(renderPassName))
+                bufferUsers[bufferName].push_back(renderPassIndex);
+        }
 
-    vk::BufferMemoryBarrier CreateBufferMemoryBarrier(VkBuffer buffer, BufferUsage::Bits oldUsage, BufferUsage::Bits newUsage)
-    {
-        vk::BufferMemoryBarrier bufferBarrier;
-        bufferBarrier
-            .setBuffer(buffer)
-            .setSrcAccessMask(BufferUsageToAccessFlags(oldUsage))
-            .setDstAccessMask(BufferUsageToAccessFlags(newUsage))
-            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-            .setSize(VK_WHOLE_SIZE)
-            .setOffset(0);
+        // first user of resource in frame gets it from the last user of previous frame
+        auto getPreviousUser = [](const std::vector<size_t>& users, size_t renderPassIndex)
+        {
+            auto user = std::find(users.begin(), users.end(), renderPassIndex);
+            return user == users.begin() ? users.back() : *(user - 1);
+        };
 
-        return bufferBarrier;
-    }
+        std::vector<size_t> subpassGroupEnds(subpassGroups.size());
+        for (size_t renderPassIndex = 0; renderPassIndex < subpassGroups.size(); renderPassIndex++)
+            subpassGroupEnds[subpassGroups[renderPassIndex]] = renderPassIndex;
 
-    void EmitPipelineBarrier(CommandBuffer& commandBuffer, const ResolveInfo& resolveInfo, const std::unordered_map<std::string, BufferTransition>& bufferTransitions, const std::unordered_map<std::string, ImageTransition>& imageTransitions)
-    {
-        vk::PipelineStageFlags pipelineSourceFlags = { };
-        vk::PipelineStageFlags pipelineDistanceFlags = { };
+        // event is set after producer render pass ends and waited before consumer one begins, worth it only with passes in between
+        auto isBarrierSplit = [&](size_t previousUser, size_t renderPassIndex)
+        {
+            return this->splitBarriers && previousUser < renderPassIndex &&
+                renderPassQueues[renderPassIndex] == QueueType::GRAPHICS &&
+                renderPassBatches[previousUser] == renderPassBatches[renderPassIndex] &&
+                subpassGroupEnds[subpassGroups[previousUser]] + 1 < subpassGroups[renderPassIndex];
+        };
 
-        std::vector<vk::BufferMemoryBarrier> bufferBarriers;
-        for (const auto& [bufferName, bufferTransition] : bufferTransitions)
+        auto addEventWait = [&eventBarriers](size_t previousUser, size_t renderPassIndex, vk::PipelineStageFlags signalStages)
         {
-            if (!HasBufferWriteDependency(bufferTransition.InitialUsage))
-                continue;
+            auto& waitedPasses = eventBarriers[renderPassIndex].WaitedPasses;
+            if (std::find(waitedPasses.begin(), waitedPasses.end(), previousUser) == waitedPasses.end())
+                waitedPasses.push_back(previousUser);
+            eventBarriers[previousUser].SignalStages |= signalStages;
+        };
 
-            pipelineSourceFlags |= BufferUsageToPipelineStage(bufferTransition.InitialUsage);
-            pipelineDistanceFlags |= BufferUsageToPipelineStage(bufferTransition.FinalUsage);
+        // same queue barrier can be recorded once previous user of resource has finished, but not inside render pass or before its batch
+        auto getEarliestBarrierPoint = [&](size_t previousUser, size_t renderPassIndex)
+        {
+            size_t batchFirstNode = batches[renderPassBatches[renderPassIndex]].FirstNode;
+            if (previousUser >= renderPassIndex) return batchFirstNode; // used last in previous frame
+            return std::max(batchFirstNode, subpassGroupEnds[subpassGroups[previousUser]] + 1);
+        };
 
-            auto buffers = resolveInfo.GetBuffers().at(bufferName);
-            for (const auto& buffer : buffers)
-            {
-                bufferBarriers.push_back(
-                    CreateBufferMemoryBarrier(buffer.get().GetNativeHandle(), bufferTransition.InitialUsage, bufferTransition.FinalUsage)
-                );
-            }
-        }
+        struct QueueLocalTransitions
+        {
+            std::vector<std::pair<std::string, BufferTransition>> Buffers;
+            std::vector<std::pair<std::string, ImageTransition>> Images;
+            size_t EarliestBarrierPoint = 0;
+        };
+        std::vector<QueueLocalTransitions> queueLocalTransitions(renderPassQueues.size());
 
-        std::vector<vk::ImageMemoryBarrier> imageBarriers;
-        for (const auto& [imageName, imageTransition] : imageTransitions)
+        eventBarriers.clear();
+        eventBarriers.resize(renderPassQueues.size());
+
+        std::vector<PipelineBarrier> pipelineBarriers(renderPassQueues.size());
+        for (size_t renderPassIndex = 0; renderPassIndex < this->renderPassReferences.size(); renderPassIndex++)
         {
-            if (imageTransition.InitialUsage == imageTransition.FinalUsage && !HasImageWriteDependency(imageTransition.InitialUsage))
-                continue;
+            const auto& renderPassName = this->renderPassReferences[renderPassIndex].Name;
+            auto& pipelineBarrier = pipelineBarriers[renderPassIndex];
+            auto& localTransitions = queueLocalTransitions[renderPassIndex];
+
+            for (const auto& [bufferName, bufferTransition] : resourceTransitions.Buffers.Transitions.at(renderPassName))
+            {
+                auto previousUser = getPreviousUser(bufferUsers.at(bufferName), renderPassIndex);
+                auto sourceQueueFamily = getQueueFamily(renderPassQueues[previousUser]);
+                auto destinationQueueFamily = getQueueFamily(renderPassQueues[renderPassIndex]);
 
-            pipelineSourceFlags |= ImageUsageToPipelineStage(imageTransition.InitialUsage);
-            pipelineDistanceFlags |= ImageUsageToPipelineStage(imageTransition.FinalUsage);
+                if (isBarrierSplit(previousUser, renderPassIndex))
+                {
+                    if (eventBarriers[renderPassIndex].WaitBarrier.AddTransition(bufferName, bufferTransition))
+                    {
+                        addEventWait(previousUser, renderPassIndex, GetInitialPipelineStages(bufferTransition));
+                        this->statistics.SplitBarrierCount++;
+                    }
+                    continue;
+                }
+                if (sourceQueueFamily == destinationQueueFamily)
+                {
+                    if (!IsSynchronizationNeeded(bufferTransition))
+                        continue;
+                    localTransitions.Buffers.emplace_back(bufferName, bufferTransition);
+                    localTransitions.EarliestBarrierPoint = std::max(localTransitions.EarliestBarrierPoint, getEarliestBarrierPoint(previousUser, renderPassIndex));
+                    continue;
+                }
+                pipelineBarrier.AddAcquireTransition(bufferName, bufferTransition, sourceQueueFamily, destinationQueueFamily, previousUser > renderPassIndex);
+                batches[renderPassBatches[previousUser]].ReleaseBarrier.AddReleaseTransition(bufferName, bufferTransition, sourceQueueFamily, destinationQueueFamily);
+            }
 
-            auto images = resolveInfo.GetImages().at(imageName);
-            for (const auto& image : images)
+            // every subresource range is synchronized with the render pass which used it last
+            for (const auto& [imageName, subresourceTransitions] : resourceTransitions.ImageSubresources.at(renderPassName))
             {
-                imageBarriers.push_back(
-                    CreateImageMemoryBarrier(image.get().GetNativeHandle(), imageTransition.InitialUsage, imageTransition.FinalUsage, image.get().GetFormat(), image.get().GetMipLevelCount(), image.get().GetLayerCount())
-                );
+                for (const auto& [imageTransition, previousUsage] : subresourceTransitions)
+                {
+                    auto previousUser = this->GetRenderPassIndex(previousUsage);
+                    // attachment written by previous subpass of the same render pass, synchronized by subpass dependency
+                    if (previousUser < renderPassIndex && subpassGroups[previousUser] == subpassGroups[renderPassIndex])
+                        continue;
+                    auto sourceQueueFamily = getQueueFamily(renderPassQueues[previousUser]);
+                    auto destinationQueueFamily = getQueueFamily(renderPassQueues[renderPassIndex]);
+
+                    if (isBarrierSplit(previousUser, renderPassIndex))
+                    {
+                        if (eventBarriers[renderPassIndex].WaitBarrier.AddTransition(imageName, imageTransition))
+                        {
+                            addEventWait(previousUser, renderPassIndex, GetInitialPipelineStages(imageTransition));
+                            this->statistics.SplitBarrierCount++;
+                        }
+                        continue;
+                    }
+                    if (sourceQueueFamily == destinationQueueFamily)
+                    {
+                        if (!IsSynchronizationNeeded(imageTransition))
+                            continue;
+                        // memory may still be accessed through aliased image by render passes in between
+                        auto earliestBarrierPoint = imageTransition.AliasedUsage == ImageUsage::UNKNOWN ?
+                            getEarliestBarrierPoint(previousUser, renderPassIndex) : subpassGroups[renderPassIndex];
+                        localTransitions.Images.emplace_back(imageName, imageTransition);
+                        localTransitions.EarliestBarrierPoint = std::max(localTransitions.EarliestBarrierPoint, earliestBarrierPoint);
+                        continue;
+                    }
+                    pipelineBarrier.AddAcquireTransition(imageName, imageTransition, sourceQueueFamily, destinationQueueFamily, previousUser > renderPassIndex);
+                    batches[renderPassBatches[previousUser]].ReleaseBarrier.AddReleaseTransition(imageName, imageTransition, sourceQueueFamily, destinationQueueFamily);
+                }
             }
         }
 
-        if (bufferBarriers.empty() && imageBarriers.empty())
-            return;
+        // transitions of render pass are moved to the latest preceding barrier if all of them are legal there,
+        // so run of independent render passes is synchronized once. Before render callbacks of passes in between
+        // are then recorded after the barrier, they must not access resources declared by later passes
+        const size_t NoBarrierTarget = size_t(-1);
+        size_t barrierTarget = NoBarrierTarget;
+        for (size_t renderPassIndex = 0; renderPassIndex < renderPassQueues.size(); renderPassIndex++)
+        {
+            auto& localTransitions = queueLocalTransitions[renderPassIndex];
+            if (localTransitions.Buffers.empty() && localTransitions.Images.empty())
+                continue;
 
-        commandBuffer.GetNativeHandle().pipelineBarrier(
-            pipelineSourceFlags,
-            pipelineDistanceFlags,
-            { },
-            { },
-            bufferBarriers,
-            imageBarriers
-        );
-    }
+            bool isMerged = this->coalesceBarriers && barrierTarget != NoBarrierTarget &&
+                renderPassBatches[barrierTarget] == renderPassBatches[renderPassIndex] &&
+                localTransitions.EarliestBarrierPoint <= barrierTarget;
+            if (!isMerged)
+                barrierTarget = this->coalesceBarriers ? subpassGroups[renderPassIndex] : renderPassIndex;
+            else
+                this->statistics.CoalescedPipelineBarrierCount++;
+
+            for (const auto& [bufferName, bufferTransition] : localTransitions.Buffers)
+                pipelineBarriers[barrierTarget].AddTransition(bufferName, bufferTransition);
+            for (const auto& [imageName, imageTransition] : localTransitions.Images)
+                pipelineBarriers[barrierTarget].AddTransition(imageName, imageTransition);
+        }
 
-    RenderGraphBuilder::PipelineBarrierCallback RenderGraphBuilder::CreatePipelineBarrierCallback(const std::string& renderPassName, const Pipeline& pipeline, const ResourceTransitions& resourceTransitions)
-    {
-        auto& bufferTransitions = resourceTransitions.Buffers.Transitions.at(renderPassName);
-        auto& imageTransitions = resourceTransitions.Images.Transitions.at(renderPassName);
+        this->statistics.RecordedPipelineBarrierCount = (size_t)std::count_if(pipelineBarriers.begin(), pipelineBarriers.end(), [](const PipelineBarrier& pipelineBarrier)
+        {
+            return !pipelineBarrier.IsEmpty();
+        });
 
-        return [bufferTransitions, imageTransitions](CommandBuffer& commandBuffer, const ResolveInfo& resolveInfo)
+        if (vulkan.GetComputeQueueFamilyIndex() != vulkan.GetQueueFamilyIndex())
         {
-            EmitPipelineBarrier(commandBuffer, resolveInfo, bufferTransitions, imageTransitions);
-        };
+            for (size_t renderPassIndex = 0; renderPassIndex < renderPassQueues.size(); renderPassIndex++)
+            {
+                if (renderPassQueues[renderPassIndex] == QueueType::ASYNC_COMPUTE)
+                    pipelineBarriers[renderPassIndex].RestrictToComputeStages();
+            }
+            for (auto& batch : batches)
+            {
+                if (batch.Queue == QueueType::ASYNC_COMPUTE)
+                    batch.ReleaseBarrier.RestrictToComputeStages();
+            }
+        }
+        return pipelineBarriers;
     }
 
     RenderGraphBuilder::CreateCallback RenderGraphBuilder::CreateCreateCallback(const PipelineHashMap& pipelines, const ResourceTransitions& transitions, const AttachmentHashMap& attachments)
     {
         ResolveInfo resolveInfo;
-        std::unordered_map<std::string, ImageTransition> attachmentTransitions;
-        for (const auto& [renderPassName, pipeline] : pipelines)
+        PipelineBarrier attachmentBarrier;
+        auto addInitialTransitions = [&](const std::string& attachmentName)
+        {
+            for (const auto& initialState : transitions.ImageInitialStates.at(attachmentName))
+            {
+                attachmentBarrier.AddTransition(attachmentName, ImageTransition{
+                    ImageUsage::UNKNOWN,
+                    initialState.Usage,
+                    ImageUsage::UNKNOWN,
+                    initialState.Subresource,
+                    vk::PipelineStageFlags{ },
+                    initialState.Stages
+                });
+            }
+            resolveInfo.Resolve(attachmentName, attachments.at(attachmentName));
+        };
+
+        // every history image is transitioned, as it can be first used as read-only "Name@prev"
+        auto historyDepths = this->GetHistoryAttachmentDepths(pipelines);
+        for (const auto& [attachmentName, historyDepth] : historyDepths)
+        {
+            if (transitions.Images.TotalUsages.find(attachmentName) == transitions.Images.TotalUsages.end())
+                continue;
+            for (uint32_t age = 0; age < historyDepth; age++)
+                addInitialTransitions(GetHistoryAttachmentName(attachmentName, age));
+        }
+
+        for (const auto& renderPassReference : this->renderPassReferences)
         {
+            const auto& renderPassName = renderPassReference.Name;
+            const auto& pipeline = pipelines.at(renderPassName);
             for (const auto& attachment : pipeline.GetOutputAttachments())
             {
-                auto& attachmentTransition = transitions.Images.Transitions.at(renderPassName).at(attachment.Name);
+                if (historyDepths.count(GetHistoryAttachmentBaseName(attachment.Name)))
+                    continue;
                 if (transitions.Images.FirstUsages.at(attachment.Name) == renderPassName)
-                {
-                    attachmentTransitions[attachment.Name] = ImageTransition{
-                        ImageUsage::UNKNOWN,
-                        attachmentTransition.InitialUsage
-                    };
-                    resolveInfo.Resolve(attachment.Name, attachments.at(attachment.Name));
-                }
+                    addInitialTransitions(attachment.Name);
             }
         }
-        return [resolve = std::move(resolveInfo), transitions = std::move(attachmentTransitions)](CommandBuffer& commandBuffer)
+        return [resolve = std::move(resolveInfo), barrier = std::move(attachmentBarrier)](CommandBuffer& commandBuffer) mutable
         {
-            EmitPipelineBarrier(commandBuffer, resolve, { }, transitions);
+            barrier.Emit(commandBuffer, resolve);
         };
     }
 
@@ -366,28 +439,24 @@ namespace VulkanAbstractionLayer
             auto subresourceRange = GetDefaultImageSubresourceRange(outputImage);
             if (outputImageTransition.FinalUsage != ImageUsage::TRANSFER_SOURCE)
             {
-                commandBuffer.GetNativeHandle().pipelineBarrier(
-                    vk::PipelineStageFlagBits::eTransfer,
-                    ImageUsageToPipelineStage(outputImageTransition.FinalUsage),
-                    { }, // dependencies
-                    { }, // memory barriers
-                    { }, // buffer barriers
-                    vk::ImageMemoryBarrier{
-                        vk::AccessFlagBits::eTransferRead,
-                        ImageUsageToAccessFlags(outputImageTransition.FinalUsage),
-                        vk::ImageLayout::eTransferSrcOptimal,
-                        ImageUsageToImageLayout(outputImageTransition.FinalUsage),
-                        VK_QUEUE_FAMILY_IGNORED,
-                        VK_QUEUE_FAMILY_IGNORED,
-                        outputImage.GetNativeHandle(),
-                        subresourceRange
-                    }
-                );
+                vk::ImageMemoryBarrier2KHR outputImageBarrier{
+                    vk::PipelineStageFlagBits2KHR::eBlit,
+                    vk::AccessFlagBits2KHR::eTransferRead,
+                    ImageUsageToPipelineStage2(outputImageTransition.FinalUsage),
+                    ImageUsageToAccessFlags2(outputImageTransition.FinalUsage),
+                    vk::ImageLayout::eTransferSrcOptimal,
+                    ImageUsageToImageLayout(outputImageTransition.FinalUsage),
+                    VK_QUEUE_FAMILY_IGNORED,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    outputImage.GetNativeHandle(),
+                    subresourceRange
+                };
+                commandBuffer.PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ &outputImageBarrier, 1 });
             }
         };
     }
 
-    static vk::Pipeline CreateComputePipeline(const Shader& shader, const vk::PipelineLayout& layout)
+    static vk::Pipeline CreateComputePipeline(const Shader& shader, const vk::PipelineLayout& layout, const vk::PipelineCache& pipelineCache)
     {
         vk::PipelineShaderStageCreateInfo shaderStageCreateInfo{
             vk::PipelineShaderStageCreateFlags{ },
@@ -403,10 +472,10 @@ namespace VulkanAbstractionLayer
             .setBasePipelineHandle(vk::Pipeline{ })
             .setBasePipelineIndex(0);
 
-        return GetCurrentVulkanContext().GetDevice().createComputePipeline(vk::PipelineCache{ }, pipelineCreateInfo).value;
+        return GetCurrentVulkanContext().GetDevice().createComputePipeline(pipelineCache, pipelineCreateInfo).value;
     }
 
-    static vk::Pipeline CreateGraphicPipeline(const Shader& shader, const vk::PipelineLayout& layout, ArrayView<const VertexBinding> vertexBindings, const vk::RenderPass& renderPass,const FillMode& fillMode)
+    static vk::Pipeline CreateGraphicPipeline(const Shader& shader, const vk::PipelineLayout& layout, ArrayView<const VertexBinding> vertexBindings, const vk::RenderPass& renderPass, uint32_t subpass, const FillMode& fillMode, const vk::PipelineCache& pipelineCache, const vk::PipelineRenderingCreateInfoKHR* renderingCreateInfo)
     {
         std::vector<vk::PipelineShaderStageCreateInfo> shaderStageCreateInfos;
         shaderStageCreateInfos.push_back(vk::PipelineShaderStageCreateInfo{
@@ -575,110 +644,262 @@ namespace VulkanAbstractionLayer
             .setPDynamicState(&dynamicStateCreateInfo)
             .setLayout(layout)
             .setRenderPass(renderPass)
-            .setSubpass(0)
+            .setSubpass(subpass)
             .setBasePipelineHandle(vk::Pipeline{ })
             .setBasePipelineIndex(0);
 
         if ((bool)shader.GetNativeShader(ShaderType::TESS_CONTROL))
             pipelineCreateInfo.setPTessellationState(&tessStateCreateInfo);
+        // attachment formats of dynamic rendering replace render pass
+        if (renderingCreateInfo != nullptr)
+            pipelineCreateInfo.setPNext(renderingCreateInfo);
 
-        return GetCurrentVulkanContext().GetDevice().createGraphicsPipeline(vk::PipelineCache{ }, pipelineCreateInfo).value;
+        return GetCurrentVulkanContext().GetDevice().createGraphicsPipeline(pipelineCache, pipelineCreateInfo).value;
     }
 
-    static vk::PipelineLayout CreatePipelineLayout(const vk::DescriptorSetLayout& descriptorSetLayout, vk::PipelineBindPoint pipelineType)
+    static vk::PipelineLayout AcquirePipelineLayout(const vk::DescriptorSetLayout& descriptorSetLayout, vk::PipelineBindPoint pipelineType, bool usesResourceHeap)
     {
+        auto& vulkan = GetCurrentVulkanContext();
+        assert(!usesResourceHeap || vulkan.GetResourceHeap().IsInitialized());
+        auto resourceHeapLayout = usesResourceHeap ? vulkan.GetResourceHeap().GetSetLayout() : vk::DescriptorSetLayout{ };
+
         vk::PushConstantRange pushConstantRange;
         pushConstantRange
             .setOffset(0)
             .setSize(128)
             .setStageFlags(PipelineTypeToShaderStages(pipelineType));
 
-        vk::PipelineLayoutCreateInfo layoutCreateInfo;
-        layoutCreateInfo
-            .setSetLayouts(descriptorSetLayout)
-            .setPushConstantRanges(pushConstantRange);
-
-        return GetCurrentVulkanContext().GetDevice().createPipelineLayout(layoutCreateInfo);
+        // passes with the same uniforms share pipeline layout, so their descriptor sets are compatible
+        return vulkan.GetDescriptorCache().GetPipelineLayout(descriptorSetLayout, ArrayView<const vk::PushConstantRange>{ &pushConstantRange, 1 }, resourceHeapLayout);
     }
 
-    PassNative RenderGraphBuilder::BuildRenderPass(const RenderPassReference& renderPassReference, const PipelineHashMap& pipelines, const AttachmentHashMap& attachments, const ResourceTransitions& resourceTransitions)
+    std::vector<PassNative> RenderGraphBuilder::BuildRenderPasses(size_t firstRenderPass, size_t subpassCount, const PipelineHashMap& pipelines, const AttachmentHashMap& attachments, const ResourceTransitions& resourceTransitions, std::vector<FramebufferAttachment>& framebufferAttachments)
     {
-        PassNative passNative;
+        struct SubpassAttachments
+        {
+            std::vector<vk::AttachmentReference> ColorAttachments;
+            std::vector<vk::AttachmentReference> InputAttachments;
+            std::vector<uint32_t> PreserveAttachments;
+            vk::AttachmentReference DepthStencilAttachment;
+            std::unordered_set<uint32_t> UsedAttachments;
+        };
+
+        std::vector<PassNative> passNatives(subpassCount);
+        vk::RenderPass renderPassHandle;
 
         std::vector<vk::AttachmentDescription> attachmentDescriptions;
-        std::vector<vk::AttachmentReference> attachmentReferences;
         std::vector<vk::ImageView> attachmentViews;
-
+        std::vector<std::string> attachmentNames;
+        std::vector<size_t> attachmentLastSubpasses;
+        std::vector<SubpassAttachments> subpassAttachments(subpassCount);
         uint32_t renderAreaWidth = 0, renderAreaHeight = 0;
 
-        auto& pass = pipelines.at(renderPassReference.Name);
-        auto& renderPassAttachments = pass.GetOutputAttachments();
-        auto& imageTransitions = resourceTransitions.Images.Transitions.at(renderPassReference.Name);
+        auto& leaderPass = pipelines.at(this->renderPassReferences[firstRenderPass].Name);
+        auto& leaderNative = passNatives.front();
+
+        // input attachments and merged subpasses still need render pass object
+        bool usesInputAttachments = std::any_of(leaderPass.GetImageDependencies().begin(), leaderPass.GetImageDependencies().end(), [](const Pipeline::ImageDependency& imageDependency)
+        {
+            return imageDependency.Usage == ImageUsage::INPUT_ATTACHMENT;
+        });
+        bool usesDynamicRendering = GetCurrentVulkanContext().IsDynamicRenderingEnabled() && subpassCount == 1 && !usesInputAttachments;
+
+        // attachment which is not read after this render pass does not need to be written back to memory
+        auto getStoreOp = [&](const std::string& name)
+        {
+            if (this->discardedAttachments.count(name) == 0)
+                return vk::AttachmentStoreOp::eStore;
+            size_t lastRenderPass = this->GetRenderPassIndex(resourceTransitions.Images.LastUsages.at(name));
+            bool isLastUsedHere = lastRenderPass >= firstRenderPass && lastRenderPass < firstRenderPass + subpassCount;
+            return isLastUsedHere ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore;
+        };
 
-        // should render pass be created?
-        if (!renderPassAttachments.empty())
+        if (!leaderPass.GetOutputAttachments().empty() && usesDynamicRendering)
         {
-            vk::AttachmentReference depthStencilAttachmentReference;
-            for (size_t attachmentIndex = 0; attachmentIndex < renderPassAttachments.size(); attachmentIndex++)
+            const auto& imageTransitions = resourceTransitions.Images.Transitions.at(this->renderPassReferences[firstRenderPass].Name);
+            std::optional<FramebufferAttachment> depthStencilAttachment;
+            leaderNative.UsesDynamicRendering = true;
+
+            // views are listed in framebuffer attachments as color ones followed by depth, so graph can update them on resize
+            for (const auto& attachment : leaderPass.GetOutputAttachments())
             {
-                const auto& attachment = renderPassAttachments[attachmentIndex];
                 const auto& imageReference = attachments.at(attachment.Name);
-                const auto& attachmentTransition = imageTransitions.at(attachment.Name);
+                auto attachmentUsage = imageTransitions.at(attachment.Name).FinalUsage;
 
                 if (renderAreaWidth == 0 && renderAreaHeight == 0)
                 {
-                    renderAreaWidth = std::max(renderAreaWidth, (uint32_t)imageReference.GetWidth());
-                    renderAreaHeight = std::max(renderAreaHeight, (uint32_t)imageReference.GetHeight());
+                    renderAreaWidth = (uint32_t)imageReference.GetWidth();
+                    renderAreaHeight = (uint32_t)imageReference.GetHeight();
                 }
 
-                vk::AttachmentDescription attachmentDescription;
-                attachmentDescription
-                    .setFormat(ToNative(imageReference.GetFormat()))
-                    .setSamples(vk::SampleCountFlagBits::e1)
+                vk::RenderingAttachmentInfoKHR renderingAttachment;
+                renderingAttachment
+                    .setImageView(attachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS ?
+                        imageReference.GetNativeView(ImageView::NATIVE) :
+                        imageReference.GetNativeView(ImageView::NATIVE, attachment.Layer)
+                    )
+                    .setImageLayout(ImageUsageToImageLayout(attachmentUsage))
                     .setLoadOp(AttachmentStateToLoadOp(attachment.OnLoad))
-                    .setStoreOp(vk::AttachmentStoreOp::eStore)
-                    .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
-                    .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-                    .setInitialLayout(ImageUsageToImageLayout(attachmentTransition.FinalUsage))
-                    .setFinalLayout(ImageUsageToImageLayout(attachmentTransition.FinalUsage));
-
-                attachmentDescriptions.push_back(std::move(attachmentDescription));
-                if (attachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS)
-                    attachmentViews.push_back(imageReference.GetNativeView(ImageView::NATIVE));
-                else
-                    attachmentViews.push_back(imageReference.GetNativeView(ImageView::NATIVE, attachment.Layer));
-
-                vk::AttachmentReference attachmentReference;
-                attachmentReference
-                    .setAttachment((uint32_t)attachmentIndex)
-                    .setLayout(ImageUsageToImageLayout(attachmentTransition.FinalUsage));
+                    .setStoreOp(getStoreOp(attachment.Name));
 
-                if (attachmentTransition.FinalUsage == ImageUsage::DEPTH_SPENCIL_ATTACHMENT)
+                if (attachmentUsage == ImageUsage::DEPTH_SPENCIL_ATTACHMENT)
                 {
-                    depthStencilAttachmentReference = std::move(attachmentReference);
-                    passNative.ClearValues.push_back(vk::ClearDepthStencilValue{
+                    renderingAttachment.setClearValue(vk::ClearDepthStencilValue{
                         attachment.DepthSpencilClear.Depth, attachment.DepthSpencilClear.Stencil
                     });
+                    leaderNative.DepthStencilAttachment = renderingAttachment;
+                    leaderNative.DepthAttachmentFormat = ToNative(imageReference.GetFormat());
+                    if (ImageFormatToImageAspect(imageReference.GetFormat()) & vk::ImageAspectFlagBits::eStencil)
+                        leaderNative.StencilAttachmentFormat = ToNative(imageReference.GetFormat());
+                    depthStencilAttachment = FramebufferAttachment{ attachment.Name, attachment.Layer };
                 }
                 else
                 {
-                    attachmentReferences.push_back(std::move(attachmentReference));
-                    passNative.ClearValues.push_back(vk::ClearColorValue{
+                    renderingAttachment.setClearValue(vk::ClearColorValue{
                         std::array{ attachment.ColorClear.R, attachment.ColorClear.G, attachment.ColorClear.B, attachment.ColorClear.A }
                     });
+                    leaderNative.ColorAttachments.push_back(renderingAttachment);
+                    leaderNative.ColorAttachmentFormats.push_back(ToNative(imageReference.GetFormat()));
+                    framebufferAttachments.push_back(FramebufferAttachment{ attachment.Name, attachment.Layer });
                 }
             }
+            if (depthStencilAttachment.has_value())
+                framebufferAttachments.push_back(depthStencilAttachment.value());
 
-            vk::SubpassDescription subpassDescription;
-            subpassDescription
-                .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
-                .setColorAttachments(attachmentReferences)
-                .setPDepthStencilAttachment(depthStencilAttachmentReference != vk::AttachmentReference{ } ?
-                    std::addressof(depthStencilAttachmentReference) : nullptr
-                );
+            auto& layeredAttachment = leaderPass.GetOutputAttachments().front();
+            uint32_t layerCount = attachments.at(layeredAttachment.Name).GetLayerCount();
+            if (layerCount > 1 && layeredAttachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS)
+                leaderNative.ViewMask = (1u << layerCount) - 1;
+        }
+        else if (!leaderPass.GetOutputAttachments().empty())
+        {
+            // returns index of attachment in render pass, creating its description on first use
+            auto useAttachment = [&](const std::string& name, size_t subpass, ImageUsage::Bits usage, vk::AttachmentLoadOp loadOp, uint32_t layer)
+            {
+                auto attachmentName = std::find(attachmentNames.begin(), attachmentNames.end(), name);
+                uint32_t attachmentIndex = (uint32_t)std::distance(attachmentNames.begin(), attachmentName);
+                const auto& imageReference = attachments.at(name);
+
+                if (attachmentName == attachmentNames.end())
+                {
+                    // stencil aspect follows depth one, formats without stencil ignore it
+                    auto storeOp = getStoreOp(name);
+                    bool hasStencil = (bool)(ImageFormatToImageAspect(imageReference.GetFormat()) & vk::ImageAspectFlagBits::eStencil);
+
+                    vk::AttachmentDescription attachmentDescription;
+                    attachmentDescription
+                        .setFormat(ToNative(imageReference.GetFormat()))
+                        .setSamples(vk::SampleCountFlagBits::e1)
+                        .setLoadOp(loadOp)
+                        .setStoreOp(storeOp)
+                        .setStencilLoadOp(hasStencil ? loadOp : vk::AttachmentLoadOp::eDontCare)
+                        .setStencilStoreOp(hasStencil ? storeOp : vk::AttachmentStoreOp::eDontCare)
+                        .setInitialLayout(ImageUsageToImageLayout(usage));
+
+                    attachmentDescriptions.push_back(std::move(attachmentDescription));
+                    attachmentNames.push_back(name);
+                    attachmentLastSubpasses.push_back(subpass);
+                    framebufferAttachments.push_back(FramebufferAttachment{ name, layer });
+                    if (layer == Pipeline::OutputAttachment::ALL_LAYERS)
+                        attachmentViews.push_back(imageReference.GetNativeView(ImageView::NATIVE));
+                    else
+                        attachmentViews.push_back(imageReference.GetNativeView(ImageView::NATIVE, layer));
+                }
+                attachmentDescriptions[attachmentIndex].setFinalLayout(ImageUsageToImageLayout(usage));
+                attachmentLastSubpasses[attachmentIndex] = subpass;
+                subpassAttachments[subpass].UsedAttachments.insert(attachmentIndex);
+                return attachmentIndex;
+            };
+
+            for (size_t subpass = 0; subpass < subpassCount; subpass++)
+            {
+                const auto& renderPassName = this->renderPassReferences[firstRenderPass + subpass].Name;
+                const auto& pass = pipelines.at(renderPassName);
+                const auto& imageTransitions = resourceTransitions.Images.Transitions.at(renderPassName);
+                auto& currentAttachments = subpassAttachments[subpass];
+
+                // input attachments are read before outputs are written in the same subpass
+                for (const auto& imageDependency : pass.GetImageDependencies())
+                {
+                    if (imageDependency.Usage != ImageUsage::INPUT_ATTACHMENT)
+                        continue;
+
+                    size_t attachmentCount = attachmentNames.size();
+                    uint32_t attachmentIndex = useAttachment(imageDependency.Name, subpass, imageDependency.Usage, vk::AttachmentLoadOp::eLoad, Pipeline::OutputAttachment::ALL_LAYERS);
+                    if (attachmentCount != attachmentNames.size())
+                        leaderNative.ClearValues.push_back(vk::ClearColorValue{ });
+
+                    currentAttachments.InputAttachments.push_back(vk::AttachmentReference{ attachmentIndex, ImageUsageToImageLayout(imageDependency.Usage) });
+                }
+
+                for (const auto& attachment : pass.GetOutputAttachments())
+                {
+                    const auto& imageReference = attachments.at(attachment.Name);
+                    const auto& attachmentTransition = imageTransitions.at(attachment.Name);
+
+                    if (renderAreaWidth == 0 && renderAreaHeight == 0)
+                    {
+                        renderAreaWidth = std::max(renderAreaWidth, (uint32_t)imageReference.GetWidth());
+                        renderAreaHeight = std::max(renderAreaHeight, (uint32_t)imageReference.GetHeight());
+                    }
+
+                    size_t attachmentCount = attachmentNames.size();
+                    uint32_t attachmentIndex = useAttachment(attachment.Name, subpass, attachmentTransition.FinalUsage, AttachmentStateToLoadOp(attachment.OnLoad), attachment.Layer);
+                    bool isNewAttachment = attachmentCount != attachmentNames.size();
+
+                    vk::AttachmentReference attachmentReference;
+                    attachmentReference
+                        .setAttachment(attachmentIndex)
+                        .setLayout(ImageUsageToImageLayout(attachmentTransition.FinalUsage));
+
+                    if (attachmentTransition.FinalUsage == ImageUsage::DEPTH_SPENCIL_ATTACHMENT)
+                    {
+                        currentAttachments.DepthStencilAttachment = std::move(attachmentReference);
+                        if (isNewAttachment) leaderNative.ClearValues.push_back(vk::ClearDepthStencilValue{
+                            attachment.DepthSpencilClear.Depth, attachment.DepthSpencilClear.Stencil
+                        });
+                    }
+                    else
+                    {
+                        currentAttachments.ColorAttachments.push_back(std::move(attachmentReference));
+                        if (isNewAttachment) leaderNative.ClearValues.push_back(vk::ClearColorValue{
+                            std::array{ attachment.ColorClear.R, attachment.ColorClear.G, attachment.ColorClear.B, attachment.ColorClear.A }
+                        });
+                    }
+                }
+            }
+
+            std::vector<vk::SubpassDescription> subpassDescriptions;
+            for (size_t subpass = 0; subpass < subpassCount; subpass++)
+            {
+                auto& currentAttachments = subpassAttachments[subpass];
+
+                // attachment contents must be preserved by subpasses between its first and last use
+                for (uint32_t attachmentIndex = 0; attachmentIndex < (uint32_t)attachmentNames.size(); attachmentIndex++)
+                {
+                    bool isUsedLater = attachmentLastSubpasses[attachmentIndex] > subpass;
+                    bool isUsedBefore = std::any_of(subpassAttachments.begin(), subpassAttachments.begin() + subpass, [attachmentIndex](const SubpassAttachments& previous)
+                    {
+                        return previous.UsedAttachments.count(attachmentIndex) > 0;
+                    });
+                    if (isUsedBefore && isUsedLater && currentAttachments.UsedAttachments.count(attachmentIndex) == 0)
+                        currentAttachments.PreserveAttachments.push_back(attachmentIndex);
+                }
+
+                vk::SubpassDescription subpassDescription;
+                subpassDescription
+                    .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+                    .setColorAttachments(currentAttachments.ColorAttachments)
+                    .setInputAttachments(currentAttachments.InputAttachments)
+                    .setPreserveAttachments(currentAttachments.PreserveAttachments)
+                    .setPDepthStencilAttachment(currentAttachments.DepthStencilAttachment != vk::AttachmentReference{ } ?
+                        std::addressof(currentAttachments.DepthStencilAttachment) : nullptr
+                    );
+                subpassDescriptions.push_back(std::move(subpassDescription));
+            }
 
-            // TODO
-            std::array subpassDependencies = {
+            // transitions between graph nodes are done by pipeline barriers, here only attachment accesses are synchronized
+            std::vector<vk::SubpassDependency> subpassDependencies = {
                 vk::SubpassDependency {
                     VK_SUBPASS_EXTERNAL,
                     0,
@@ -689,7 +910,7 @@ namespace VulkanAbstractionLayer
                     vk::DependencyFlagBits::eByRegion
                 },
                 vk::SubpassDependency {
-                    0,
+                    (uint32_t)subpassCount - 1,
                     VK_SUBPASS_EXTERNAL,
                     vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
                     vk::PipelineStageFlagBits::eBottomOfPipe,
@@ -698,193 +919,1378 @@ namespace VulkanAbstractionLayer
                     vk::DependencyFlagBits::eByRegion
                 },
             };
+            for (uint32_t subpass = 1; subpass < (uint32_t)subpassCount; subpass++)
+            {
+                for (uint32_t previousSubpass = 0; previousSubpass < subpass; previousSubpass++)
+                {
+                    subpassDependencies.push_back(vk::SubpassDependency{
+                        previousSubpass,
+                        subpass,
+                        vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                        vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
+                        vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                        vk::AccessFlagBits::eInputAttachmentRead | vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite |
+                        vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                        vk::DependencyFlagBits::eByRegion
+                    });
+                }
+            }
 
             vk::RenderPassCreateInfo renderPassCreateInfo;
             renderPassCreateInfo
                 .setAttachments(attachmentDescriptions)
-                .setSubpasses(subpassDescription)
+                .setSubpasses(subpassDescriptions)
                 .setDependencies(subpassDependencies);
 
             vk::RenderPassMultiviewCreateInfo renderPassMultiViewCreateInfo;
-            if (!renderPassAttachments.empty())
+            std::vector<uint32_t> viewMasks;
             {
-                auto& layeredAttachment = renderPassAttachments.front();
+                auto& layeredAttachment = leaderPass.GetOutputAttachments().front();
                 uint32_t layerCount = attachments.at(layeredAttachment.Name).GetLayerCount();
 
                 if (layerCount > 1 && layeredAttachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS)
                 {
                     uint32_t viewMask = (1u << layerCount) - 1; // bits of mask: for example 0b0...011 for 2 views
+                    viewMasks.resize(subpassCount, viewMask);
                     renderPassMultiViewCreateInfo
-                        .setSubpassCount(1)
-                        .setViewMasks(viewMask)
+                        .setViewMasks(viewMasks)
                         .setCorrelationMasks(viewMask);
                     renderPassCreateInfo.setPNext(&renderPassMultiViewCreateInfo);
                 }
             }
-            passNative.RenderPassHandle = GetCurrentVulkanContext().GetDevice().createRenderPass(renderPassCreateInfo);
+            renderPassHandle = GetCurrentVulkanContext().GetDevice().createRenderPass(renderPassCreateInfo);
 
             vk::FramebufferCreateInfo framebufferCreateInfo;
             framebufferCreateInfo
-                .setRenderPass(passNative.RenderPassHandle)
+                .setRenderPass(renderPassHandle)
                 .setAttachments(attachmentViews)
                 .setWidth(renderAreaWidth)
                 .setHeight(renderAreaHeight)
                 .setLayers(1);
-            passNative.Framebuffer = GetCurrentVulkanContext().GetDevice().createFramebuffer(framebufferCreateInfo);
-
-            passNative.RenderArea = vk::Rect2D{ vk::Offset2D{ 0u, 0u }, vk::Extent2D{ renderAreaWidth, renderAreaHeight } };
-        }
-
-        if (dynamic_cast<GraphicShader*>(pass.Shader.get()) != nullptr)
-            passNative.PipelineType = vk::PipelineBindPoint::eGraphics;
-        else if (dynamic_cast<ComputeShader*>(pass.Shader.get()) != nullptr)
-            passNative.PipelineType = vk::PipelineBindPoint::eCompute;
-
-        if ((bool)pass.Shader)
-        {
-            auto descriptor = GetCurrentVulkanContext().GetDescriptorCache().GetDescriptor(pass.Shader->GetShaderUniforms());
-            passNative.DescriptorSet = descriptor.Set;
-            passNative.PipelineLayout = CreatePipelineLayout(descriptor.SetLayout, passNative.PipelineType);
 
-            if(passNative.PipelineType == vk::PipelineBindPoint::eGraphics)
-                passNative.Pipeline = CreateGraphicPipeline(*pass.Shader, passNative.PipelineLayout, pass.VertexBindings, passNative.RenderPassHandle,pass.GetFillMode());
-            if(passNative.PipelineType == vk::PipelineBindPoint::eCompute)
-                passNative.Pipeline = CreateComputePipeline(*pass.Shader, passNative.PipelineLayout);
+            // merged passes share render pass of the first one, which owns it
+            leaderNative.RenderPassHandle = renderPassHandle;
+            leaderNative.Framebuffer = GetCurrentVulkanContext().GetDevice().createFramebuffer(framebufferCreateInfo);
         }
 
-        return passNative;
-    }
-
-    RenderGraphBuilder::ResourceTransitions RenderGraphBuilder::ResolveResourceTransitions(const PipelineHashMap& pipelines)
-    {
-        ResourceTransitions resourceTransitions;
-        std::unordered_map<std::string, BufferUsage::Bits> lastBufferUsages;
-        std::unordered_map<std::string, ImageUsage::Bits> lastImageUsages;
-
-        for (const auto& renderPassReference : this->renderPassReferences)
+        for (size_t subpass = 0; subpass < subpassCount; subpass++)
         {
-            auto& pipeline = pipelines.at(renderPassReference.Name);
-            auto& bufferTransitions = resourceTransitions.Buffers.Transitions[renderPassReference.Name];
-            auto& imageTransitions = resourceTransitions.Images.Transitions[renderPassReference.Name];
+            auto& pass = pipelines.at(this->renderPassReferences[firstRenderPass + subpass].Name);
+            auto& passNative = passNatives[subpass];
+            passNative.SubpassIndex = (uint32_t)subpass;
+            passNative.RenderArea = vk::Rect2D{ vk::Offset2D{ 0u, 0u }, vk::Extent2D{ renderAreaWidth, renderAreaHeight } };
 
-            for (const auto& bufferDependency : pipeline.GetBufferDependencies())
-            {
-                if (lastBufferUsages.find(bufferDependency.Name) == lastBufferUsages.end())
-                {
-                    resourceTransitions.Buffers.FirstUsages[bufferDependency.Name] = renderPassReference.Name;
-                    lastBufferUsages[bufferDependency.Name] = BufferUsage::UNKNOWN; // resolve at the end
-                }
-                auto lastBufferUsage = lastBufferUsages.at(bufferDependency.Name);
-                bufferTransitions[bufferDependency.Name].InitialUsage = lastBufferUsage;
-                bufferTransitions[bufferDependency.Name].FinalUsage = bufferDependency.Usage;
-                resourceTransitions.Buffers.TotalUsages[bufferDependency.Name] |= bufferDependency.Usage;
-                lastBufferUsages[bufferDependency.Name] = bufferDependency.Usage;
-                resourceTransitions.Buffers.LastUsages[bufferDependency.Name] = renderPassReference.Name;
-            }
+            if (dynamic_cast<GraphicShader*>(pass.Shader.get()) != nullptr)
+                passNative.PipelineType = vk::PipelineBindPoint::eGraphics;
+            else if (dynamic_cast<ComputeShader*>(pass.Shader.get()) != nullptr)
+                passNative.PipelineType = vk::PipelineBindPoint::eCompute;
 
-            for (const auto& imageDependency : pipeline.GetImageDependencies())
-            {
-                if (lastImageUsages.find(imageDependency.Name) == lastImageUsages.end())
-                {
-                    resourceTransitions.Images.FirstUsages[imageDependency.Name] = renderPassReference.Name;
-                    lastImageUsages[imageDependency.Name] = ImageUsage::UNKNOWN; // resolve at the end
-                }
-                auto lastImageUsage = lastImageUsages.at(imageDependency.Name);
-                imageTransitions[imageDependency.Name].InitialUsage = lastImageUsage;
-                imageTransitions[imageDependency.Name].FinalUsage = imageDependency.Usage;
-                resourceTransitions.Images.TotalUsages[imageDependency.Name] |= imageDependency.Usage;
-                lastImageUsages[imageDependency.Name] = imageDependency.Usage;
-                resourceTransitions.Images.LastUsages[imageDependency.Name] = renderPassReference.Name;
-            }
+            vk::PipelineRenderingCreateInfoKHR renderingCreateInfo;
+            renderingCreateInfo
+                .setViewMask(leaderNative.ViewMask)
+                .setColorAttachmentFormats(leaderNative.ColorAttachmentFormats)
+                .setDepthAttachmentFormat(leaderNative.DepthAttachmentFormat)
+                .setStencilAttachmentFormat(leaderNative.StencilAttachmentFormat);
 
-            for (const auto& attachmentDependency : pipeline.GetOutputAttachments())
+            if ((bool)pass.Shader)
             {
-                auto attachmentDependencyUsage = AttachmentStateToImageUsage(attachmentDependency.OnLoad);
-
-                if (lastImageUsages.find(attachmentDependency.Name) == lastImageUsages.end())
+                auto& vulkan = GetCurrentVulkanContext();
+                for (size_t frameIndex = 0; frameIndex < vulkan.GetVirtualFrameCount(); frameIndex++)
                 {
-                    resourceTransitions.Images.FirstUsages[attachmentDependency.Name] = renderPassReference.Name;
-                    lastImageUsages[attachmentDependency.Name] = ImageUsage::UNKNOWN; // resolve at the end
+                    auto descriptor = vulkan.GetDescriptorCache().GetDescriptor(pass.Shader->GetShaderUniforms());
+                    passNative.DescriptorSetLayout = descriptor.SetLayout;
+                    passNative.FrameDescriptorSets.push_back(descriptor.Set);
                 }
-                auto lastImageUsage = lastImageUsages.at(attachmentDependency.Name);
-                imageTransitions[attachmentDependency.Name].InitialUsage = lastImageUsage;
-                imageTransitions[attachmentDependency.Name].FinalUsage = attachmentDependencyUsage;
-                resourceTransitions.Images.TotalUsages[attachmentDependency.Name] |= attachmentDependencyUsage;
-                lastImageUsages[attachmentDependency.Name] = attachmentDependencyUsage;
-                resourceTransitions.Images.LastUsages[attachmentDependency.Name] = renderPassReference.Name;
+                passNative.DescriptorSet = passNative.FrameDescriptorSets.front();
+                passNative.PipelineLayout = AcquirePipelineLayout(passNative.DescriptorSetLayout, passNative.PipelineType, pass.Shader->UsesResourceHeap());
+                if (pass.Shader->UsesResourceHeap())
+                    passNative.ResourceHeapSet = vulkan.GetResourceHeap().GetDescriptorSet();
+
+                if(passNative.PipelineType == vk::PipelineBindPoint::eGraphics)
+                    passNative.Pipeline = CreateGraphicPipeline(*pass.Shader, passNative.PipelineLayout, pass.VertexBindings, renderPassHandle, (uint32_t)subpass, pass.GetFillMode(), this->pipelineCache,
+                        leaderNative.UsesDynamicRendering ? &renderingCreateInfo : nullptr);
+                if(passNative.PipelineType == vk::PipelineBindPoint::eCompute)
+                    passNative.Pipeline = CreateComputePipeline(*pass.Shader, passNative.PipelineLayout, this->pipelineCache);
             }
         }
 
-        // resolve first usages using last usages (as render graph is repeated per-frame)
-        for (const auto& [bufferNativeHandle, renderPassName] : resourceTransitions.Buffers.FirstUsages)
-        {
-            auto& firstBufferTransition = resourceTransitions.Buffers.Transitions[renderPassName][bufferNativeHandle];
-            firstBufferTransition.InitialUsage = lastBufferUsages[bufferNativeHandle];
-        }
-        for (const auto& [imageNativeHandle, renderPassName] : resourceTransitions.Images.FirstUsages)
-        {
-            auto& firstImageTransition = resourceTransitions.Images.Transitions[renderPassName][imageNativeHandle];
-            firstImageTransition.InitialUsage = lastImageUsages[imageNativeHandle];
-        }
+        return passNatives;
+    }
 
-        return resourceTransitions;
+    static uint64_t GetSubresourceEnd(uint32_t base, uint32_t count)
+    {
+        return count == ImageSubresource::REMAINING ? std::numeric_limits<uint64_t>::max() : (uint64_t)base + count;
     }
 
-    RenderGraphBuilder::AttachmentHashMap RenderGraphBuilder::AllocateAttachments(const PipelineHashMap& pipelines, const ResourceTransitions& transitions)
+    static ImageSubresource CreateSubresource(uint64_t mipBegin, uint64_t mipEnd, uint64_t layerBegin, uint64_t layerEnd)
     {
-        AttachmentHashMap attachments;
+        constexpr uint64_t End = std::numeric_limits<uint64_t>::max();
+        return ImageSubresource{
+            (uint32_t)mipBegin,
+            mipEnd == End ? ImageSubresource::REMAINING : uint32_t(mipEnd - mipBegin),
+            (uint32_t)layerBegin,
+            layerEnd == End ? ImageSubresource::REMAINING : uint32_t(layerEnd - layerBegin),
+        };
+    }
 
-        auto [surfaceWidth, surfaceHeight] = GetCurrentVulkanContext().GetSurfaceExtent();
+    static std::optional<ImageSubresource> IntersectSubresources(const ImageSubresource& left, const ImageSubresource& right)
+    {
+        auto mipBegin = std::max<uint64_t>(left.BaseMipLevel, right.BaseMipLevel);
+        auto mipEnd = std::min(GetSubresourceEnd(left.BaseMipLevel, left.MipLevelCount), GetSubresourceEnd(right.BaseMipLevel, right.MipLevelCount));
+        auto layerBegin = std::max<uint64_t>(left.BaseLayer, right.BaseLayer);
+        auto layerEnd = std::min(GetSubresourceEnd(left.BaseLayer, left.LayerCount), GetSubresourceEnd(right.BaseLayer, right.LayerCount));
+
+        if (mipBegin >= mipEnd || layerBegin >= layerEnd)
+            return { };
+        return CreateSubresource(mipBegin, mipEnd, layerBegin, layerEnd);
+    }
 
-        for (const auto& [renderPassName, pipeline] : pipelines)
+    // appends at most four ranges which cover part of subresource outside of removed one
+    static void SubtractSubresources(const ImageSubresource& subresource, const ImageSubresource& removed, std::vector<ImageSubresource>& result)
+    {
+        auto intersection = IntersectSubresources(subresource, removed);
+        if (!intersection.has_value())
         {
-            auto& attachmentDeclarations = pipeline.GetAttachmentDeclarations();
-            for (const auto& attachment : attachmentDeclarations)
-            {
-                auto attachmentUsage = transitions.Images.TotalUsages.at(attachment.Name);
-
-                attachments.emplace(attachment.Name, Image(
-                    attachment.Width == 0 ? surfaceWidth : attachment.Width,
-                    attachment.Height == 0 ? surfaceHeight : attachment.Height,
-                    attachment.ImageFormat,
-                    attachmentUsage,
-                    MemoryUsage::GPU_ONLY,
-                    attachment.Options
-                ));
-            }
+            result.push_back(subresource);
+            return;
         }
-        return attachments;
+
+        uint64_t mipBegin = subresource.BaseMipLevel, mipEnd = GetSubresourceEnd(subresource.BaseMipLevel, subresource.MipLevelCount);
+        uint64_t layerBegin = subresource.BaseLayer, layerEnd = GetSubresourceEnd(subresource.BaseLayer, subresource.LayerCount);
+        uint64_t removedMipBegin = intersection->BaseMipLevel, removedMipEnd = GetSubresourceEnd(intersection->BaseMipLevel, intersection->MipLevelCount);
+        uint64_t removedLayerBegin = intersection->BaseLayer, removedLayerEnd = GetSubresourceEnd(intersection->BaseLayer, intersection->LayerCount);
+
+        if (mipBegin < removedMipBegin) result.push_back(CreateSubresource(mipBegin, removedMipBegin, layerBegin, layerEnd));
+        if (removedMipEnd < mipEnd) result.push_back(CreateSubresource(removedMipEnd, mipEnd, layerBegin, layerEnd));
+        if (layerBegin < removedLayerBegin) result.push_back(CreateSubresource(removedMipBegin, removedMipEnd, layerBegin, removedLayerBegin));
+        if (removedLayerEnd < layerEnd) result.push_back(CreateSubresource(removedMipBegin, removedMipEnd, removedLayerEnd, layerEnd));
     }
 
-    void RenderGraphBuilder::SetupOutputImage(ResourceTransitions& transitions, const std::string& outputImage)
+    static ImageSubresource GetOutputAttachmentSubresource(const Pipeline::OutputAttachment& attachment)
     {
-        transitions.Images.TotalUsages.at(outputImage) |= ImageUsage::TRANSFER_SOURCE;
+        if (attachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS)
+            return ImageSubresource{ };
+        return ImageSubresource{ 0, ImageSubresource::REMAINING, attachment.Layer, 1 };
     }
 
-    RenderGraphBuilder& RenderGraphBuilder::AddRenderPass(const std::string& name, std::unique_ptr<RenderPass> renderPass)
+    static vk::PipelineStageFlags ShaderTypeToPipelineStage(ShaderType type)
     {
-        this->renderPassReferences.push_back({ name, std::move(renderPass) });
-        return *this;
+        switch (type)
+        {
+        case ShaderType::VERTEX:
+            return vk::PipelineStageFlagBits::eVertexShader;
+        case ShaderType::TESS_CONTROL:
+            return vk::PipelineStageFlagBits::eTessellationControlShader;
+        case ShaderType::TESS_EVALUATION:
+            return vk::PipelineStageFlagBits::eTessellationEvaluationShader;
+        case ShaderType::GEOMETRY:
+            return vk::PipelineStageFlagBits::eGeometryShader;
+        case ShaderType::FRAGMENT:
+            return vk::PipelineStageFlagBits::eFragmentShader;
+        case ShaderType::COMPUTE:
+            return vk::PipelineStageFlagBits::eComputeShader;
+        case ShaderType::RAY_GEN:
+        case ShaderType::INTERSECT:
+        case ShaderType::ANY_HIT:
+        case ShaderType::CLOSEST_HIT:
+        case ShaderType::MISS:
+        case ShaderType::CALLABLE:
+            return vk::PipelineStageFlagBits::eRayTracingShaderKHR;
+        case ShaderType::TASK_NV:
+            return vk::PipelineStageFlagBits::eTaskShaderNV;
+        case ShaderType::MESH_NV:
+            return vk::PipelineStageFlagBits::eMeshShaderNV;
+        default:
+            assert(false);
+            return vk::PipelineStageFlags{ };
+        }
     }
 
-    RenderGraphBuilder& RenderGraphBuilder::SetOutputName(const std::string& name)
+    static vk::PipelineStageFlags GetShaderPipelineStages(const Shader& shader)
     {
-        this->outputName = name;
-        return *this;
+        vk::PipelineStageFlags stages;
+        for (const auto& shaderUniforms : shader.GetShaderUniforms())
+            stages |= ShaderTypeToPipelineStage(shaderUniforms.ShaderStage);
+        return stages;
     }
 
-    RenderGraphBuilder::PipelineHashMap RenderGraphBuilder::CreatePipelines()
+    // only stages which declare descriptor binding access resource bound to it
+    static vk::PipelineStageFlags GetBindingPipelineStages(const Shader& shader, uint32_t binding)
     {
-        PipelineHashMap pipelines;
+        vk::PipelineStageFlags stages;
+        for (const auto& shaderUniforms : shader.GetShaderUniforms())
+        {
+            for (const auto& uniform : shaderUniforms.Uniforms)
+            {
+                if (uniform.Binding == binding)
+                    stages |= ShaderTypeToPipelineStage(shaderUniforms.ShaderStage);
+            }
+        }
+        return (bool)stages ? stages : GetShaderPipelineStages(shader);
+    }
+
+    static bool IsShaderAccess(BufferUsage::Bits usage)
+    {
+        switch (usage)
+        {
+        case BufferUsage::UNIFORM_TEXEL_BUFFER:
+        case BufferUsage::STORAGE_TEXEL_BUFFER:
+        case BufferUsage::UNIFORM_BUFFER:
+        case BufferUsage::STORAGE_BUFFER:
+        case BufferUsage::SHADER_DEVICE_ADDRESS:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool IsShaderAccess(ImageUsage::Bits usage)
+    {
+        return usage == ImageUsage::SHADER_READ || usage == ImageUsage::STORAGE;
+    }
+
+    // empty stages of non-shader usages are deduced from usage when barrier is created
+    template<typename Usage>
+    static vk::PipelineStageFlags GetDependencyPipelineStages(const Pipeline& pipeline, Usage usage, vk::PipelineStageFlags stages)
+    {
+        if ((bool)stages || !IsShaderAccess(usage) || !(bool)pipeline.Shader)
+            return stages;
+        return GetShaderPipelineStages(*pipeline.Shader);
+    }
+
+    std::unordered_map<std::string, uint32_t> RenderGraphBuilder::GetHistoryAttachmentDepths(const PipelineHashMap& pipelines)
+    {
+        std::unordered_map<std::string, uint32_t> historyDepths;
+        for (const auto& renderPassReference : this->renderPassReferences)
+        {
+            for (const auto& attachment : pipelines.at(renderPassReference.Name).GetAttachmentDeclarations())
+            {
+                if (attachment.HistoryDepth > 1)
+                    historyDepths[attachment.Name] = attachment.HistoryDepth;
+            }
+        }
+        return historyDepths;
+    }
+
+    RenderGraphBuilder::ResourceTransitions RenderGraphBuilder::ResolveResourceTransitions(const PipelineHashMap& pipelines)
+    {
+        ResourceTransitions resourceTransitions;
+        std::unordered_map<std::string, BufferTransition> lastBufferUsages; // final usage and stages of last transition
+        std::unordered_map<std::string, std::vector<ImageSubresourceState>> imageStates;
+
+        auto updateImageStates = [&imageStates](const std::string& imageName, const ImageSubresource& subresource, ImageUsage::Bits usage, vk::PipelineStageFlags stages, const RenderPassName& renderPassName)
+        {
+            auto& states = imageStates.try_emplace(imageName, std::vector{ ImageSubresourceState{ ImageSubresource{ }, ImageUsage::UNKNOWN, RenderPassName{ }, vk::PipelineStageFlags{ } } }).first->second;
+            std::vector<ImageSubresourceState> updatedStates;
+            std::vector<ImageSubresource> remainingSubresources;
+            for (const auto& state : states)
+            {
+                remainingSubresources.clear();
+                SubtractSubresources(state.Subresource, subresource, remainingSubresources);
+                for (const auto& remainingSubresource : remainingSubresources)
+                    updatedStates.push_back(ImageSubresourceState{ remainingSubresource, state.Usage, state.LastUsage, state.Stages });
+            }
+            updatedStates.push_back(ImageSubresourceState{ subresource, usage, renderPassName, stages });
+            states = std::move(updatedStates);
+        };
+
+        // subresources used at the end of frame are used first in the next one (as render graph is repeated per-frame)
+        for (const auto& renderPassReference : this->renderPassReferences)
+        {
+            auto& pipeline = pipelines.at(renderPassReference.Name);
+            for (const auto& imageDependency : pipeline.GetImageDependencies())
+            {
+                auto stages = GetDependencyPipelineStages(pipeline, imageDependency.Usage, imageDependency.Stages);
+                updateImageStates(imageDependency.Name, imageDependency.Subresource, imageDependency.Usage, stages, renderPassReference.Name);
+            }
+            for (const auto& attachmentDependency : pipeline.GetOutputAttachments())
+                updateImageStates(attachmentDependency.Name, GetOutputAttachmentSubresource(attachmentDependency), AttachmentStateToImageUsage(attachmentDependency.OnLoad), { }, renderPassReference.Name);
+        }
+
+        // history images are rotated at the end of frame, each one starts in state of one frame younger image
+        for (const auto& [attachmentName, historyDepth] : this->GetHistoryAttachmentDepths(pipelines))
+        {
+            std::vector<std::vector<ImageSubresourceState>> finalStates(historyDepth);
+            for (uint32_t age = 0; age < historyDepth; age++)
+            {
+                auto states = imageStates.find(GetHistoryAttachmentName(attachmentName, age));
+                if (states != imageStates.end()) finalStates[age] = states->second;
+            }
+            if (std::all_of(finalStates.begin(), finalStates.end(), [](const auto& states) { return states.empty(); }))
+                continue;
+            assert(!finalStates.front().empty()); // history is read, but current frame image is never written
+
+            for (uint32_t age = 0; age < historyDepth; age++)
+            {
+                // image which is not used passes state of younger one through
+                uint32_t previousAge = (age + historyDepth - 1) % historyDepth;
+                while (finalStates[previousAge].empty())
+                    previousAge = (previousAge + historyDepth - 1) % historyDepth;
+                imageStates[GetHistoryAttachmentName(attachmentName, age)] = finalStates[previousAge];
+            }
+        }
+        resourceTransitions.ImageInitialStates = imageStates;
+
+        auto useImage = [&](const RenderPassName& renderPassName, const std::string& imageName, const ImageSubresource& subresource, ImageUsage::Bits usage, vk::PipelineStageFlags stages)
+        {
+            auto& subresourceTransitions = resourceTransitions.ImageSubresources[renderPassName][imageName];
+            // later dependency of the same render pass overrides earlier one for shared subresources
+            subresourceTransitions.erase(std::remove_if(subresourceTransitions.begin(), subresourceTransitions.end(), [&subresource](const ImageSubresourceTransition& subresourceTransition)
+            {
+                return IntersectSubresources(subresourceTransition.Transition.Subresource, subresource).has_value();
+            }), subresourceTransitions.end());
+
+            for (const auto& state : imageStates.at(imageName))
+            {
+                auto intersection = IntersectSubresources(state.Subresource, subresource);
+                if (intersection.has_value())
+                {
+                    subresourceTransitions.push_back(ImageSubresourceTransition{
+                        ImageTransition{ state.Usage, usage, ImageUsage::UNKNOWN, intersection.value(), state.Stages, stages }, state.LastUsage
+                    });
+                }
+            }
+
+            if (resourceTransitions.Images.FirstUsages.find(imageName) == resourceTransitions.Images.FirstUsages.end())
+                resourceTransitions.Images.FirstUsages[imageName] = renderPassName;
+            auto& imageTransition = resourceTransitions.Images.Transitions[renderPassName][imageName];
+            imageTransition.InitialUsage = subresourceTransitions.back().Transition.InitialUsage;
+            imageTransition.FinalUsage = usage;
+            imageTransition.InitialStages = subresourceTransitions.back().Transition.InitialStages;
+            imageTransition.FinalStages = stages;
+            resourceTransitions.Images.TotalUsages[imageName] |= usage;
+            resourceTransitions.Images.LastUsages[imageName] = renderPassName;
+            updateImageStates(imageName, subresource, usage, stages, renderPassName);
+        };
+
+        for (const auto& renderPassReference : this->renderPassReferences)
+        {
+            auto& pipeline = pipelines.at(renderPassReference.Name);
+            auto& bufferTransitions = resourceTransitions.Buffers.Transitions[renderPassReference.Name];
+            resourceTransitions.Images.Transitions[renderPassReference.Name];
+            resourceTransitions.ImageSubresources[renderPassReference.Name];
+
+            for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+            {
+                if (lastBufferUsages.find(bufferDependency.Name) == lastBufferUsages.end())
+                {
+                    resourceTransitions.Buffers.FirstUsages[bufferDependency.Name] = renderPassReference.Name;
+                    lastBufferUsages[bufferDependency.Name] = BufferTransition{ BufferUsage::UNKNOWN, BufferUsage::UNKNOWN }; // resolve at the end
+                }
+                const auto& lastBufferUsage = lastBufferUsages.at(bufferDependency.Name);
+                auto stages = GetDependencyPipelineStages(pipeline, bufferDependency.Usage, bufferDependency.Stages);
+                bufferTransitions[bufferDependency.Name] = BufferTransition{ lastBufferUsage.FinalUsage, bufferDependency.Usage, lastBufferUsage.FinalStages, stages };
+                resourceTransitions.Buffers.TotalUsages[bufferDependency.Name] |= bufferDependency.Usage;
+                lastBufferUsages[bufferDependency.Name] = bufferTransitions[bufferDependency.Name];
+                resourceTransitions.Buffers.LastUsages[bufferDependency.Name] = renderPassReference.Name;
+            }
+
+            for (const auto& imageDependency : pipeline.GetImageDependencies())
+                useImage(renderPassReference.Name, imageDependency.Name, imageDependency.Subresource, imageDependency.Usage, GetDependencyPipelineStages(pipeline, imageDependency.Usage, imageDependency.Stages));
+
+            for (const auto& attachmentDependency : pipeline.GetOutputAttachments())
+                useImage(renderPassReference.Name, attachmentDependency.Name, GetOutputAttachmentSubresource(attachmentDependency), AttachmentStateToImageUsage(attachmentDependency.OnLoad), { });
+        }
+
+        // resolve first usages using last usages (as render graph is repeated per-frame)
+        for (const auto& [bufferNativeHandle, renderPassName] : resourceTransitions.Buffers.FirstUsages)
+        {
+            auto& firstBufferTransition = resourceTransitions.Buffers.Transitions[renderPassName][bufferNativeHandle];
+            firstBufferTransition.InitialUsage = lastBufferUsages[bufferNativeHandle].FinalUsage;
+            firstBufferTransition.InitialStages = lastBufferUsages[bufferNativeHandle].FinalStages;
+        }
+
+        return resourceTransitions;
+    }
+
+    static bool IsRenderPassWritingAny(const Pipeline& pipeline, const std::unordered_set<std::string>& resources)
+    {
+        for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+        {
+            if (HasBufferWriteDependency(bufferDependency.Usage) && resources.count(bufferDependency.Name))
+                return true;
+        }
+        for (const auto& imageDependency : pipeline.GetImageDependencies())
+        {
+            if (HasImageWriteDependency(imageDependency.Usage) && resources.count(imageDependency.Name))
+                return true;
+        }
+        for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+        {
+            if (resources.count(outputAttachment.Name))
+                return true;
+        }
+        return false;
+    }
+
+    static void CollectRenderPassReads(const Pipeline& pipeline, std::unordered_set<std::string>& resources)
+    {
+        for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+        {
+            if (bufferDependency.Usage != BufferUsage::TRANSFER_DESTINATION)
+                resources.insert(bufferDependency.Name);
+        }
+        for (const auto& imageDependency : pipeline.GetImageDependencies())
+        {
+            // reading history image consumes what was written to attachment in previous frames
+            if (imageDependency.Usage != ImageUsage::TRANSFER_DISTINATION)
+                resources.insert(GetHistoryAttachmentBaseName(imageDependency.Name));
+        }
+        for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+        {
+            if (outputAttachment.OnLoad == AttachmentState::LOAD_COLOR || outputAttachment.OnLoad == AttachmentState::LOAD_DEPTH_SPENCIL)
+                resources.insert(GetHistoryAttachmentBaseName(outputAttachment.Name));
+        }
+    }
+
+    void RenderGraphBuilder::CullRenderPasses(const PipelineHashMap& pipelines)
+    {
+        std::unordered_set<std::string> consumedResources{ this->outputName };
+        std::vector<bool> isRenderPassAlive(this->renderPassReferences.size(), false);
+
+        // resources written at the end of frame can be consumed by earlier passes of the next frame, so iterate until nothing changes
+        bool hasChanged = true;
+        while (hasChanged)
+        {
+            hasChanged = false;
+            for (size_t i = this->renderPassReferences.size(); i > 0; i--)
+            {
+                size_t renderPassIndex = i - 1;
+                const auto& pipeline = pipelines.at(this->renderPassReferences[renderPassIndex].Name);
+                if (isRenderPassAlive[renderPassIndex])
+                    continue;
+                if (!pipeline.HasSideEffect() && !IsRenderPassWritingAny(pipeline, consumedResources))
+                    continue;
+
+                isRenderPassAlive[renderPassIndex] = true;
+                CollectRenderPassReads(pipeline, consumedResources);
+                hasChanged = true;
+            }
+        }
+
+        std::vector<RenderPassReference> aliveRenderPassReferences;
+        for (size_t renderPassIndex = 0; renderPassIndex < this->renderPassReferences.size(); renderPassIndex++)
+        {
+            if (isRenderPassAlive[renderPassIndex])
+                aliveRenderPassReferences.push_back(std::move(this->renderPassReferences[renderPassIndex]));
+            else
+                this->statistics.CulledPassCount++;
+        }
+        this->renderPassReferences = std::move(aliveRenderPassReferences);
+    }
+
+    static void CollectRenderPassWrites(const Pipeline& pipeline, std::unordered_set<std::string>& resources)
+    {
+        for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+        {
+            if (HasBufferWriteDependency(bufferDependency.Usage))
+                resources.insert(bufferDependency.Name);
+        }
+        for (const auto& imageDependency : pipeline.GetImageDependencies())
+        {
+            if (HasImageWriteDependency(imageDependency.Usage))
+                resources.insert(imageDependency.Name);
+        }
+        for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+        {
+            resources.insert(outputAttachment.Name);
+        }
+    }
+
+    static bool HasIntersection(const std::unordered_set<std::string>& left, const std::unordered_set<std::string>& right)
+    {
+        return std::any_of(left.begin(), left.end(), [&right](const std::string& name) { return right.count(name) > 0; });
+    }
+
+    static bool IsPipelineBarrierNeeded(const Pipeline& pipeline, const std::unordered_map<std::string, BufferUsage::Bits>& lastBufferUsages, const std::unordered_map<std::string, ImageUsage::Bits>& lastImageUsages)
+    {
+        for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+        {
+            auto lastUsage = lastBufferUsages.find(bufferDependency.Name);
+            if (lastUsage != lastBufferUsages.end() && HasBufferWriteDependency(lastUsage->second))
+                return true;
+        }
+        for (const auto& imageDependency : pipeline.GetImageDependencies())
+        {
+            auto lastUsage = lastImageUsages.find(imageDependency.Name);
+            if (lastUsage != lastImageUsages.end() && (lastUsage->second != imageDependency.Usage || HasImageWriteDependency(lastUsage->second)))
+                return true;
+        }
+        for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+        {
+            if (lastImageUsages.find(outputAttachment.Name) != lastImageUsages.end())
+                return true;
+        }
+        return false;
+    }
+
+    void RenderGraphBuilder::ReorderRenderPasses(const PipelineHashMap& pipelines)
+    {
+        size_t renderPassCount = this->renderPassReferences.size();
+        std::vector<std::unordered_set<std::string>> renderPassReads(renderPassCount);
+        std::vector<std::unordered_set<std::string>> renderPassWrites(renderPassCount);
+        for (size_t renderPassIndex = 0; renderPassIndex < renderPassCount; renderPassIndex++)
+        {
+            const auto& pipeline = pipelines.at(this->renderPassReferences[renderPassIndex].Name);
+            CollectRenderPassReads(pipeline, renderPassReads[renderPassIndex]);
+            CollectRenderPassWrites(pipeline, renderPassWrites[renderPassIndex]);
+        }
+
+        // pass depends on every earlier pass it has read-write, write-read or write-write conflict with
+        std::vector<std::vector<size_t>> predecessors(renderPassCount);
+        std::vector<std::vector<size_t>> successors(renderPassCount);
+        for (size_t second = 0; second < renderPassCount; second++)
+        {
+            const auto& secondPipeline = pipelines.at(this->renderPassReferences[second].Name);
+            for (size_t first = 0; first < second; first++)
+            {
+                const auto& firstPipeline = pipelines.at(this->renderPassReferences[first].Name);
+                bool isDependent =
+                    HasIntersection(renderPassWrites[first], renderPassReads[second]) ||
+                    HasIntersection(renderPassWrites[first], renderPassWrites[second]) ||
+                    HasIntersection(renderPassReads[first], renderPassWrites[second]) ||
+                    (firstPipeline.HasSideEffect() && secondPipeline.HasSideEffect()); // side effects are not declared, keep their order
+
+                if (isDependent)
+                {
+                    predecessors[second].push_back(first);
+                    successors[first].push_back(second);
+                }
+            }
+        }
+
+        // greedy list scheduling: prefer passes which need no barrier, then passes whose producers executed earliest
+        std::vector<size_t> unscheduledPredecessors(renderPassCount);
+        std::vector<size_t> positions(renderPassCount, renderPassCount);
+        for (size_t renderPassIndex = 0; renderPassIndex < renderPassCount; renderPassIndex++)
+            unscheduledPredecessors[renderPassIndex] = predecessors[renderPassIndex].size();
+
+        std::unordered_map<std::string, BufferUsage::Bits> lastBufferUsages;
+        std::unordered_map<std::string, ImageUsage::Bits> lastImageUsages;
+        std::vector<RenderPassReference> orderedRenderPassReferences;
+
+        for (size_t position = 0; position < renderPassCount; position++)
+        {
+            size_t bestRenderPass = renderPassCount;
+            bool bestNeedsBarrier = true;
+            size_t bestProducerDistance = 0;
+
+            for (size_t renderPassIndex = 0; renderPassIndex < renderPassCount; renderPassIndex++)
+            {
+                if (positions[renderPassIndex] != renderPassCount || unscheduledPredecessors[renderPassIndex] != 0)
+                    continue;
+
+                const auto& pipeline = pipelines.at(this->renderPassReferences[renderPassIndex].Name);
+                bool needsBarrier = IsPipelineBarrierNeeded(pipeline, lastBufferUsages, lastImageUsages);
+                size_t producerDistance = renderPassCount;
+                for (size_t predecessor : predecessors[renderPassIndex])
+                    producerDistance = std::min(producerDistance, position - positions[predecessor]);
+
+                bool isBetter = bestRenderPass == renderPassCount ||
+                    (needsBarrier != bestNeedsBarrier ? !needsBarrier : producerDistance > bestProducerDistance);
+                if (isBetter)
+                {
+                    bestRenderPass = renderPassIndex;
+                    bestNeedsBarrier = needsBarrier;
+                    bestProducerDistance = producerDistance;
+                }
+            }
+            assert(bestRenderPass != renderPassCount);
+
+            positions[bestRenderPass] = position;
+            for (size_t successor : successors[bestRenderPass])
+                unscheduledPredecessors[successor]--;
+
+            const auto& pipeline = pipelines.at(this->renderPassReferences[bestRenderPass].Name);
+            for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+                lastBufferUsages[bufferDependency.Name] = bufferDependency.Usage;
+            for (const auto& imageDependency : pipeline.GetImageDependencies())
+                lastImageUsages[imageDependency.Name] = imageDependency.Usage;
+            for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+                lastImageUsages[outputAttachment.Name] = AttachmentStateToImageUsage(outputAttachment.OnLoad);
+        }
+
+        orderedRenderPassReferences.resize(renderPassCount);
+        for (size_t renderPassIndex = 0; renderPassIndex < renderPassCount; renderPassIndex++)
+            orderedRenderPassReferences[positions[renderPassIndex]] = std::move(this->renderPassReferences[renderPassIndex]);
+        this->renderPassReferences = std::move(orderedRenderPassReferences);
+    }
+
+    size_t RenderGraphBuilder::CountPipelineBarriers(const ResourceTransitions& resourceTransitions)
+    {
+        size_t pipelineBarrierCount = 0;
+        for (const auto& renderPassReference : this->renderPassReferences)
+        {
+            PipelineBarrier pipelineBarrier;
+            for (const auto& [bufferName, bufferTransition] : resourceTransitions.Buffers.Transitions.at(renderPassReference.Name))
+                pipelineBarrier.AddTransition(bufferName, bufferTransition);
+            for (const auto& [imageName, imageTransition] : resourceTransitions.Images.Transitions.at(renderPassReference.Name))
+                pipelineBarrier.AddTransition(imageName, imageTransition);
+
+            if (!pipelineBarrier.IsEmpty()) pipelineBarrierCount++;
+        }
+        return pipelineBarrierCount;
+    }
+
+    std::vector<size_t> RenderGraphBuilder::GetSubpassGroups(const PipelineHashMap& pipelines, const AttachmentHashMap& attachments, const std::vector<RenderGraphBatch>& batches)
+    {
+        std::vector<size_t> subpassGroups(this->renderPassReferences.size());
+        std::unordered_set<size_t> batchFirstNodes;
+        for (const auto& batch : batches)
+            batchFirstNodes.insert(batch.FirstNode);
+
+        // only full single-layer attachments of the same size can be shared between subpasses
+        auto isMergeable = [&attachments](const Pipeline& pipeline, uint32_t width, uint32_t height)
+        {
+            // cacheable pass needs its own render pass to be skipped
+            if (pipeline.GetOutputAttachments().empty() || dynamic_cast<GraphicShader*>(pipeline.Shader.get()) == nullptr || pipeline.IsCacheable())
+                return false;
+
+            return std::all_of(pipeline.GetOutputAttachments().begin(), pipeline.GetOutputAttachments().end(), [&](const auto& outputAttachment)
+            {
+                const auto& image = attachments.at(outputAttachment.Name);
+                return outputAttachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS && image.GetLayerCount() == 1 &&
+                    image.GetWidth() == width && image.GetHeight() == height;
+            });
+        };
+
+        std::unordered_set<std::string> groupReads, groupWrites, groupAttachments, groupInputAttachments;
+        uint32_t groupWidth = 0, groupHeight = 0;
+
+        for (size_t renderPassIndex = 0; renderPassIndex < this->renderPassReferences.size(); renderPassIndex++)
+        {
+            const auto& pipeline = pipelines.at(this->renderPassReferences[renderPassIndex].Name);
+            subpassGroups[renderPassIndex] = renderPassIndex;
+
+            if (!pipeline.GetOutputAttachments().empty())
+            {
+                const auto& image = attachments.at(pipeline.GetOutputAttachments().front().Name);
+                bool canBeMerged = this->mergeSubpasses && renderPassIndex > 0 &&
+                    batchFirstNodes.count(renderPassIndex) == 0 &&
+                    isMergeable(pipelines.at(this->renderPassReferences[renderPassIndex - 1].Name), groupWidth, groupHeight) &&
+                    isMergeable(pipeline, groupWidth, groupHeight);
+
+                // pass can access attachments of previous subpasses only as input attachments (same pixel reads) or loaded outputs
+                std::unordered_set<std::string> subpassAccesses;
+                bool hasInputAttachments = false;
+                for (const auto& imageDependency : pipeline.GetImageDependencies())
+                {
+                    if (imageDependency.Usage == ImageUsage::INPUT_ATTACHMENT && groupAttachments.count(imageDependency.Name))
+                    {
+                        subpassAccesses.insert(imageDependency.Name);
+                        hasInputAttachments = true;
+                    }
+                }
+                for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+                {
+                    bool isLoaded = outputAttachment.OnLoad == AttachmentState::LOAD_COLOR || outputAttachment.OnLoad == AttachmentState::LOAD_DEPTH_SPENCIL;
+                    if (isLoaded && groupAttachments.count(outputAttachment.Name) && !groupInputAttachments.count(outputAttachment.Name) && !subpassAccesses.count(outputAttachment.Name))
+                        subpassAccesses.insert(outputAttachment.Name);
+                }
+
+                std::unordered_set<std::string> reads, writes;
+                CollectRenderPassReads(pipeline, reads);
+                CollectRenderPassWrites(pipeline, writes);
+                auto isConflicting = [&subpassAccesses](const std::unordered_set<std::string>& resources, const std::unordered_set<std::string>& groupResources)
+                {
+                    return std::any_of(resources.begin(), resources.end(), [&](const std::string& name)
+                    {
+                        return groupResources.count(name) > 0 && subpassAccesses.count(name) == 0;
+                    });
+                };
+                canBeMerged = canBeMerged && hasInputAttachments &&
+                    !isConflicting(reads, groupWrites) &&
+                    !isConflicting(writes, groupWrites) &&
+                    !isConflicting(writes, groupReads);
+
+                if (canBeMerged)
+                {
+                    subpassGroups[renderPassIndex] = subpassGroups[renderPassIndex - 1];
+                    this->statistics.MergedSubpassCount++;
+                }
+                else
+                {
+                    groupReads.clear();
+                    groupWrites.clear();
+                    groupAttachments.clear();
+                    groupInputAttachments.clear();
+                    groupWidth = image.GetWidth();
+                    groupHeight = image.GetHeight();
+                }
+
+                CollectRenderPassReads(pipeline, groupReads);
+                CollectRenderPassWrites(pipeline, groupWrites);
+                for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+                    groupAttachments.insert(outputAttachment.Name);
+                for (const auto& imageDependency : pipeline.GetImageDependencies())
+                {
+                    if (imageDependency.Usage == ImageUsage::INPUT_ATTACHMENT)
+                        groupInputAttachments.insert(imageDependency.Name);
+                }
+            }
+            else
+            {
+                groupAttachments.clear();
+            }
+        }
+        return subpassGroups;
+    }
+
+    RenderGraphBuilder::AttachmentHashMap RenderGraphBuilder::AllocateAttachments(const PipelineHashMap& pipelines, const std::vector<QueueType>& renderPassQueues, ResourceTransitions& transitions)
+    {
+        struct TransientAttachment
+        {
+            const Pipeline::AttachmentDeclaration* Declaration;
+            uint32_t Width;
+            uint32_t Height;
+            ImageUsage::Value Usage;
+            vk::MemoryRequirements MemoryRequirements;
+            size_t FirstUsage;
+            size_t LastUsage;
+        };
+
+        struct AliasedMemoryBlock
+        {
+            std::vector<size_t> Attachments;
+            vk::MemoryRequirements MemoryRequirements;
+            bool IsSurfaceSized;
+        };
+
+        AttachmentHashMap attachments;
+        std::vector<TransientAttachment> transientAttachments;
+
+        auto [surfaceWidth, surfaceHeight] = GetCurrentVulkanContext().GetSurfaceExtent();
+        auto& device = GetCurrentVulkanContext().GetDevice();
+
+        std::unordered_map<std::string, size_t> renderPassIndices;
+        for (size_t i = 0; i < this->renderPassReferences.size(); i++)
+            renderPassIndices[this->renderPassReferences[i].Name] = i;
+
+        // compute batches are waited only at the end of frame, so lifetimes in pass order do not hold for their resources
+        std::unordered_set<std::string> asyncComputeResources;
+        for (size_t i = 0; i < this->renderPassReferences.size(); i++)
+        {
+            if (renderPassQueues[i] != QueueType::ASYNC_COMPUTE)
+                continue;
+            for (auto& resourceName : GetRenderPassResourceNames(pipelines.at(this->renderPassReferences[i].Name)))
+                asyncComputeResources.insert(std::move(resourceName));
+        }
+
+        // attachment can share memory only if its content is not needed before its first usage in frame
+        auto isTransientAttachment = [this, &pipelines, &transitions, &asyncComputeResources](const Pipeline::AttachmentDeclaration& attachment)
+        {
+            if (attachment.Name == this->outputName || (attachment.Options & ImageOptions::MIPMAPS))
+                return false;
+            if (asyncComputeResources.count(attachment.Name))
+                return false;
+
+            // output of cacheable pass is kept between frames
+            for (const auto& [renderPassName, pipeline] : pipelines)
+            {
+                std::unordered_set<std::string> writes;
+                if (pipeline.IsCacheable()) CollectRenderPassWrites(pipeline, writes);
+                if (writes.count(attachment.Name)) return false;
+            }
+
+            const auto& firstRenderPassName = transitions.Images.FirstUsages.at(attachment.Name);
+            const auto& firstPipeline = pipelines.at(firstRenderPassName);
+            for (const auto& imageDependency : firstPipeline.GetImageDependencies())
+            {
+                if (imageDependency.Name == attachment.Name) return false;
+            }
+            for (const auto& outputAttachment : firstPipeline.GetOutputAttachments())
+            {
+                if (outputAttachment.Name == attachment.Name)
+                {
+                    return outputAttachment.Layer == Pipeline::OutputAttachment::ALL_LAYERS &&
+                        outputAttachment.OnLoad != AttachmentState::LOAD_COLOR &&
+                        outputAttachment.OnLoad != AttachmentState::LOAD_DEPTH_SPENCIL;
+                }
+            }
+            return false;
+        };
+
+        // memoryless image lives only inside single render pass and is used only as its attachment
+        const ImageUsage::Value MemorylessUsages = ImageUsage::COLOR_ATTACHMENT | ImageUsage::DEPTH_SPENCIL_ATTACHMENT | ImageUsage::INPUT_ATTACHMENT;
+        auto memoryProperties = GetCurrentVulkanContext().GetPhysicalDevice().getMemoryProperties();
+        bool isLazilyAllocatedMemorySupported = std::any_of(memoryProperties.memoryTypes.begin(), memoryProperties.memoryTypes.begin() + memoryProperties.memoryTypeCount, [](const vk::MemoryType& memoryType)
+        {
+            return (bool)(memoryType.propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated);
+        });
+
+        auto addSurfaceAttachment = [this](const std::string& name, const Pipeline::AttachmentDeclaration& attachment, ImageUsage::Value usage, size_t memoryIndex, size_t memorySize, MemoryUsage memoryUsage = MemoryUsage::GPU_ONLY)
+        {
+            this->surfaceAttachments.push_back(SurfaceAttachment{
+                name,
+                attachment.ImageFormat,
+                attachment.Width,
+                attachment.Height,
+                usage,
+                attachment.Options,
+                { }, // resolved when all transitions are known
+                memoryIndex,
+                memorySize,
+                memoryUsage,
+            });
+        };
+
+        for (const auto& [renderPassName, pipeline] : pipelines)
+        {
+            auto& attachmentDeclarations = pipeline.GetAttachmentDeclarations();
+            for (const auto& attachment : attachmentDeclarations)
+            {
+                // attachment is not used by any alive render pass
+                if (transitions.Images.TotalUsages.find(attachment.Name) == transitions.Images.TotalUsages.end())
+                    continue;
+
+                auto attachmentUsage = transitions.Images.TotalUsages.at(attachment.Name);
+                uint32_t width = attachment.Width == 0 ? surfaceWidth : attachment.Width;
+                uint32_t height = attachment.Height == 0 ? surfaceHeight : attachment.Height;
+
+                // one image per frame of history, all of them are used under each name as images are rotated
+                if (attachment.HistoryDepth > 1)
+                {
+                    for (uint32_t age = 1; age < attachment.HistoryDepth; age++)
+                    {
+                        auto historyUsage = transitions.Images.TotalUsages.find(GetHistoryAttachmentName(attachment.Name, age));
+                        if (historyUsage != transitions.Images.TotalUsages.end())
+                            attachmentUsage |= historyUsage->second;
+                    }
+
+                    for (uint32_t age = 0; age < attachment.HistoryDepth; age++)
+                    {
+                        auto historyName = GetHistoryAttachmentName(attachment.Name, age);
+                        auto& image = attachments.emplace(historyName, Image(
+                            width,
+                            height,
+                            attachment.ImageFormat,
+                            attachmentUsage,
+                            MemoryUsage::GPU_ONLY,
+                            attachment.Options
+                        )).first->second;
+
+                        auto memorySize = (size_t)device.getImageMemoryRequirements(image.GetNativeHandle()).size;
+                        this->statistics.AttachmentMemoryRequired += memorySize;
+                        this->statistics.AttachmentMemoryAllocated += memorySize;
+
+                        if (attachment.Width == 0 || attachment.Height == 0)
+                            addSurfaceAttachment(historyName, attachment, attachmentUsage, SurfaceAttachment::NOT_ALIASED, memorySize);
+                    }
+                    continue;
+                }
+
+                // content of transient attachment is not needed after its last usage either
+                bool isTransient = isTransientAttachment(attachment);
+                if (isTransient)
+                    this->discardedAttachments.insert(attachment.Name);
+
+                if (isTransient && isLazilyAllocatedMemorySupported && (attachmentUsage & ~MemorylessUsages) == 0 &&
+                    transitions.Images.FirstUsages.at(attachment.Name) == transitions.Images.LastUsages.at(attachment.Name))
+                {
+                    auto memorylessUsage = attachmentUsage | ImageUsage::TRANSIENT;
+                    attachments.emplace(attachment.Name, Image(
+                        width,
+                        height,
+                        attachment.ImageFormat,
+                        memorylessUsage,
+                        MemoryUsage::GPU_LAZILY_ALLOCATED,
+                        attachment.Options
+                    ));
+
+                    auto memorySize = (size_t)GetImageMemoryRequirements(width, height, attachment.ImageFormat, memorylessUsage, attachment.Options).size;
+                    this->statistics.AttachmentMemoryRequired += memorySize;
+                    this->statistics.LazilyAllocatedAttachmentCount++;
+
+                    if (attachment.Width == 0 || attachment.Height == 0)
+                        addSurfaceAttachment(attachment.Name, attachment, memorylessUsage, SurfaceAttachment::NOT_ALIASED, memorySize, MemoryUsage::GPU_LAZILY_ALLOCATED);
+                    continue;
+                }
+
+                if (isTransient)
+                {
+                    transientAttachments.push_back(TransientAttachment{
+                        &attachment,
+                        width,
+                        height,
+                        attachmentUsage,
+                        GetImageMemoryRequirements(width, height, attachment.ImageFormat, attachmentUsage, attachment.Options),
+                        renderPassIndices.at(transitions.Images.FirstUsages.at(attachment.Name)),
+                        renderPassIndices.at(transitions.Images.LastUsages.at(attachment.Name)),
+                    });
+                    continue;
+                }
+
+                auto& image = attachments.emplace(attachment.Name, Image(
+                    width,
+                    height,
+                    attachment.ImageFormat,
+                    attachmentUsage,
+                    MemoryUsage::GPU_ONLY,
+                    attachment.Options
+                )).first->second;
+
+                auto memorySize = (size_t)device.getImageMemoryRequirements(image.GetNativeHandle()).size;
+                this->statistics.AttachmentMemoryRequired += memorySize;
+                this->statistics.AttachmentMemoryAllocated += memorySize;
+
+                if (attachment.Width == 0 || attachment.Height == 0)
+                    addSurfaceAttachment(attachment.Name, attachment, attachmentUsage, SurfaceAttachment::NOT_ALIASED, memorySize);
+            }
+        }
+
+        // greedy packing: largest attachments first, each goes to the first block it does not overlap with in time
+        std::sort(transientAttachments.begin(), transientAttachments.end(), [](const TransientAttachment& a1, const TransientAttachment& a2)
+        {
+            if (a1.MemoryRequirements.size != a2.MemoryRequirements.size)
+                return a1.MemoryRequirements.size > a2.MemoryRequirements.size;
+            return a1.FirstUsage < a2.FirstUsage;
+        });
+
+        std::vector<AliasedMemoryBlock> memoryBlocks;
+        for (size_t attachmentIndex = 0; attachmentIndex < transientAttachments.size(); attachmentIndex++)
+        {
+            const auto& attachment = transientAttachments[attachmentIndex];
+            bool isSurfaceSized = attachment.Declaration->Width == 0 || attachment.Declaration->Height == 0;
+
+            auto fittingBlock = std::find_if(memoryBlocks.begin(), memoryBlocks.end(), [&](const AliasedMemoryBlock& block)
+            {
+                if (block.IsSurfaceSized != isSurfaceSized) return false;
+                if ((block.MemoryRequirements.memoryTypeBits & attachment.MemoryRequirements.memoryTypeBits) == 0) return false;
+                for (size_t blockAttachmentIndex : block.Attachments)
+                {
+                    const auto& other = transientAttachments[blockAttachmentIndex];
+                    if (attachment.FirstUsage <= other.LastUsage && other.FirstUsage <= attachment.LastUsage)
+                        return false;
+                }
+                return true;
+            });
+
+            if (fittingBlock == memoryBlocks.end())
+            {
+                memoryBlocks.push_back(AliasedMemoryBlock{ { attachmentIndex }, attachment.MemoryRequirements, isSurfaceSized });
+                continue;
+            }
+
+            fittingBlock->Attachments.push_back(attachmentIndex);
+            fittingBlock->MemoryRequirements.size = std::max(fittingBlock->MemoryRequirements.size, attachment.MemoryRequirements.size);
+            fittingBlock->MemoryRequirements.alignment = std::max(fittingBlock->MemoryRequirements.alignment, attachment.MemoryRequirements.alignment);
+            fittingBlock->MemoryRequirements.memoryTypeBits &= attachment.MemoryRequirements.memoryTypeBits;
+        }
+
+        for (auto& block : memoryBlocks)
+        {
+            for (size_t attachmentIndex : block.Attachments)
+                this->statistics.AttachmentMemoryRequired += (size_t)transientAttachments[attachmentIndex].MemoryRequirements.size;
+            this->statistics.AttachmentMemoryAllocated += (size_t)block.MemoryRequirements.size;
+
+            if (block.Attachments.size() == 1)
+            {
+                const auto& attachment = transientAttachments[block.Attachments.front()];
+                attachments.emplace(attachment.Declaration->Name, Image(
+                    attachment.Width,
+                    attachment.Height,
+                    attachment.Declaration->ImageFormat,
+                    attachment.Usage,
+                    MemoryUsage::GPU_ONLY,
+                    attachment.Declaration->Options
+                ));
+
+                if (block.IsSurfaceSized)
+                    addSurfaceAttachment(attachment.Declaration->Name, *attachment.Declaration, attachment.Usage, SurfaceAttachment::NOT_ALIASED, (size_t)attachment.MemoryRequirements.size);
+                continue;
+            }
+
+            if (block.IsSurfaceSized)
+            {
+                for (size_t attachmentIndex : block.Attachments)
+                {
+                    const auto& attachment = transientAttachments[attachmentIndex];
+                    addSurfaceAttachment(attachment.Declaration->Name, *attachment.Declaration, attachment.Usage, this->attachmentMemory.size(), (size_t)attachment.MemoryRequirements.size);
+                }
+            }
+
+            auto memory = AllocateMemory(block.MemoryRequirements, MemoryUsage::GPU_ONLY);
+            this->attachmentMemory.push_back(memory);
+            this->statistics.AliasedAttachmentCount += block.Attachments.size();
+
+            std::sort(block.Attachments.begin(), block.Attachments.end(), [&transientAttachments](size_t index1, size_t index2)
+            {
+                return transientAttachments[index1].FirstUsage < transientAttachments[index2].FirstUsage;
+            });
+
+            for (size_t i = 0; i < block.Attachments.size(); i++)
+            {
+                const auto& attachment = transientAttachments[block.Attachments[i]];
+                const auto& previousAttachment = transientAttachments[block.Attachments[(i + block.Attachments.size() - 1) % block.Attachments.size()]];
+                const auto& attachmentName = attachment.Declaration->Name;
+                const auto& previousAttachmentName = previousAttachment.Declaration->Name;
+
+                attachments.emplace(attachmentName, Image(
+                    attachment.Width,
+                    attachment.Height,
+                    attachment.Declaration->ImageFormat,
+                    attachment.Usage,
+                    attachment.Declaration->Options,
+                    memory,
+                    0
+                ));
+
+                // memory was used by previous attachment in the same block, its content is discarded
+                auto& previousLastTransition = transitions.Images.Transitions.at(transitions.Images.LastUsages.at(previousAttachmentName)).at(previousAttachmentName);
+                auto& firstTransition = transitions.Images.Transitions.at(transitions.Images.FirstUsages.at(attachmentName)).at(attachmentName);
+                firstTransition.InitialUsage = ImageUsage::UNKNOWN;
+                firstTransition.AliasedUsage = previousLastTransition.FinalUsage;
+
+                for (auto& initialState : transitions.ImageInitialStates.at(attachmentName))
+                    initialState.Usage = ImageUsage::UNKNOWN;
+
+                // every subresource which would keep its content from previous frame is discarded
+                for (auto& [renderPassName, subresourceTransitions] : transitions.ImageSubresources)
+                {
+                    auto imageSubresourceTransitions = subresourceTransitions.find(attachmentName);
+                    if (imageSubresourceTransitions == subresourceTransitions.end())
+                        continue;
+
+                    auto renderPassIndex = this->GetRenderPassIndex(renderPassName);
+                    for (auto& subresourceTransition : imageSubresourceTransitions->second)
+                    {
+                        if (this->GetRenderPassIndex(subresourceTransition.PreviousUsage) < renderPassIndex)
+                            continue;
+                        subresourceTransition.Transition.InitialUsage = ImageUsage::UNKNOWN;
+                        subresourceTransition.Transition.AliasedUsage = previousLastTransition.FinalUsage;
+                    }
+                }
+            }
+        }
+
+        for (auto& surfaceAttachment : this->surfaceAttachments)
+        {
+            surfaceAttachment.InitialTransitions.clear();
+            for (const auto& initialState : transitions.ImageInitialStates.at(surfaceAttachment.Name))
+            {
+                surfaceAttachment.InitialTransitions.push_back(ImageTransition{
+                    ImageUsage::UNKNOWN, initialState.Usage, ImageUsage::UNKNOWN, initialState.Subresource, vk::PipelineStageFlags{ }, initialState.Stages
+                });
+            }
+        }
+
+        this->statistics.AttachmentMemorySaved = this->statistics.AttachmentMemoryRequired - this->statistics.AttachmentMemoryAllocated;
+        return attachments;
+    }
+
+    void RenderGraphBuilder::SetupOutputImage(ResourceTransitions& transitions, const std::string& outputImage)
+    {
+        transitions.Images.TotalUsages.at(outputImage) |= ImageUsage::TRANSFER_SOURCE;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::AddRenderPass(const std::string& name, std::unique_ptr<RenderPass> renderPass)
+    {
+        this->renderPassReferences.push_back({ name, std::move(renderPass) });
+        return *this;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::SetOutputName(const std::string& name)
+    {
+        this->outputName = name;
+        return *this;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::SetPassCulling(bool enabled)
+    {
+        this->cullPasses = enabled;
+        return *this;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::SetPassReordering(bool enabled)
+    {
+        this->reorderPasses = enabled;
+        return *this;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::SetSubpassMerging(bool enabled)
+    {
+        this->mergeSubpasses = enabled;
+        return *this;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::SetBarrierSplitting(bool enabled)
+    {
+        this->splitBarriers = enabled;
+        return *this;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::SetBarrierCoalescing(bool enabled)
+    {
+        this->coalesceBarriers = enabled;
+        return *this;
+    }
+
+    RenderGraphBuilder& RenderGraphBuilder::SetCacheFile(const std::string& filepath)
+    {
+        this->cacheFilepath = filepath;
+        return *this;
+    }
+
+    static std::array<uint32_t, 4> ToSubresourceArray(const ImageSubresource& subresource)
+    {
+        return { subresource.BaseMipLevel, subresource.MipLevelCount, subresource.BaseLayer, subresource.LayerCount };
+    }
+
+    uint64_t RenderGraphBuilder::ComputeDeclarationHash(const PipelineHashMap& pipelines)
+    {
+        DeclarationHash hash;
+        hash.Add(this->outputName);
+        hash.Add(this->cullPasses);
+        hash.Add(this->reorderPasses);
+
+        for (const auto& renderPassReference : this->renderPassReferences)
+        {
+            const auto& pipeline = pipelines.at(renderPassReference.Name);
+            hash.Add(renderPassReference.Name);
+            hash.Add(pipeline.GetFillMode());
+            hash.Add(pipeline.GetQueueType());
+            hash.Add(pipeline.HasSideEffect());
+
+            hash.Add(pipeline.GetBufferDependencies().size());
+            for (const auto& bufferDependency : pipeline.GetBufferDependencies())
+            {
+                hash.Add(bufferDependency.Name);
+                hash.Add(bufferDependency.Usage);
+                hash.Add((uint32_t)bufferDependency.Stages);
+            }
+            hash.Add(pipeline.GetImageDependencies().size());
+            for (const auto& imageDependency : pipeline.GetImageDependencies())
+            {
+                hash.Add(imageDependency.Name);
+                hash.Add(imageDependency.Usage);
+                hash.Add(ToSubresourceArray(imageDependency.Subresource));
+                hash.Add((uint32_t)imageDependency.Stages);
+            }
+            hash.Add(pipeline.GetAttachmentDeclarations().size());
+            for (const auto& attachmentDeclaration : pipeline.GetAttachmentDeclarations())
+            {
+                hash.Add(attachmentDeclaration.Name);
+                hash.Add(attachmentDeclaration.ImageFormat);
+                hash.Add(attachmentDeclaration.Width);
+                hash.Add(attachmentDeclaration.Height);
+                hash.Add(attachmentDeclaration.Options);
+                hash.Add(attachmentDeclaration.HistoryDepth);
+            }
+            hash.Add(pipeline.GetOutputAttachments().size());
+            for (const auto& outputAttachment : pipeline.GetOutputAttachments())
+            {
+                hash.Add(outputAttachment.Name);
+                hash.Add(outputAttachment.OnLoad);
+                hash.Add(outputAttachment.Layer);
+            }
+
+            // pipeline state keys, shader code itself is validated by pipeline cache
+            hash.Add(pipeline.VertexBindings.size());
+            for (const auto& vertexBinding : pipeline.VertexBindings)
+            {
+                hash.Add(vertexBinding.InputRate);
+                hash.Add(vertexBinding.BindingRange);
+            }
+            if ((bool)pipeline.Shader)
+            {
+                for (const auto& inputAttribute : pipeline.Shader->GetInputAttributes())
+                {
+                    hash.Add(inputAttribute.LayoutFormat);
+                    hash.Add(inputAttribute.ComponentCount);
+                }
+            }
+        }
+        return hash.GetValue();
+    }
+
+    bool RenderGraphBuilder::RestoreCompiledRenderGraph(const CompiledRenderGraph& compiledGraph, ResourceTransitions& resourceTransitions)
+    {
+        // cached order is validated before any reference is moved, so graph can still be compiled from scratch if it does not match
+        std::vector<size_t> renderPassIndices;
+        std::vector<bool> isRenderPassRestored(this->renderPassReferences.size(), false);
+        for (const auto& renderPassName : compiledGraph.RenderPassOrder)
+        {
+            auto renderPassReference = std::find_if(this->renderPassReferences.begin(), this->renderPassReferences.end(), [&renderPassName](const RenderPassReference& reference)
+            {
+                return reference.Name == renderPassName;
+            });
+            if (renderPassReference == this->renderPassReferences.end()) return false;
+            size_t renderPassIndex = (size_t)std::distance(this->renderPassReferences.begin(), renderPassReference);
+            if (isRenderPassRestored[renderPassIndex]) return false;
+            isRenderPassRestored[renderPassIndex] = true;
+            renderPassIndices.push_back(renderPassIndex);
+        }
+
+        // transitions may only refer to restored passes and single usages, which barriers can be created from
+        std::unordered_set<std::string> restoredRenderPassNames(compiledGraph.RenderPassOrder.begin(), compiledGraph.RenderPassOrder.end());
+        auto isRestoredRenderPass = [&restoredRenderPassNames](const RenderPassName& renderPassName)
+        {
+            return restoredRenderPassNames.find(renderPassName) != restoredRenderPassNames.end();
+        };
+        auto isSingleUsage = [](uint32_t usage, uint32_t knownUsages)
+        {
+            return (usage & (usage - 1)) == 0 && (usage & knownUsages) == usage;
+        };
+        constexpr uint32_t KnownBufferUsages =
+            BufferUsage::TRANSFER_SOURCE | BufferUsage::TRANSFER_DESTINATION | BufferUsage::UNIFORM_TEXEL_BUFFER | BufferUsage::STORAGE_TEXEL_BUFFER |
+            BufferUsage::UNIFORM_BUFFER | BufferUsage::STORAGE_BUFFER | BufferUsage::INDEX_BUFFER | BufferUsage::VERTEX_BUFFER |
+            BufferUsage::INDIRECT_BUFFER | BufferUsage::SHADER_DEVICE_ADDRESS | BufferUsage::TRANSFORM_FEEDBACK_BUFFER |
+            BufferUsage::TRANSFORM_FEEDBACK_COUNTER_BUFFER | BufferUsage::CONDITIONAL_RENDERING |
+            BufferUsage::ACCELERATION_STRUCTURE_BUILD_INPUT_READONLY | BufferUsage::ACCELERATION_STRUCTURE_STORAGE | BufferUsage::SHADER_BINDING_TABLE;
+        constexpr uint32_t KnownImageUsages =
+            ImageUsage::TRANSFER_SOURCE | ImageUsage::TRANSFER_DISTINATION | ImageUsage::SHADER_READ | ImageUsage::STORAGE |
+            ImageUsage::COLOR_ATTACHMENT | ImageUsage::DEPTH_SPENCIL_ATTACHMENT | ImageUsage::INPUT_ATTACHMENT | ImageUsage::FRAGMENT_SHADING_RATE_ATTACHMENT;
+
+        for (const auto& transition : compiledGraph.BufferTransitions)
+        {
+            if (!isRestoredRenderPass(transition.RenderPassName)) return false;
+            if (!isSingleUsage(transition.InitialUsage, KnownBufferUsages) || !isSingleUsage(transition.FinalUsage, KnownBufferUsages)) return false;
+        }
+        for (const auto& transition : compiledGraph.ImageTransitions)
+        {
+            if (!isRestoredRenderPass(transition.RenderPassName)) return false;
+            // subresource which is not used before has no previous pass
+            if (!transition.PreviousRenderPassName.empty() && !isRestoredRenderPass(transition.PreviousRenderPassName)) return false;
+            if (!isSingleUsage(transition.InitialUsage, KnownImageUsages) || !isSingleUsage(transition.FinalUsage, KnownImageUsages)) return false;
+        }
+        for (const auto& initialState : compiledGraph.ImageInitialStates)
+        {
+            if (!initialState.RenderPassName.empty() && !isRestoredRenderPass(initialState.RenderPassName)) return false;
+            if (!isSingleUsage(initialState.FinalUsage, KnownImageUsages)) return false;
+        }
+
+        std::vector<RenderPassReference> orderedRenderPassReferences;
+        for (size_t renderPassIndex : renderPassIndices)
+        {
+            orderedRenderPassReferences.push_back(std::move(this->renderPassReferences[renderPassIndex]));
+        }
+        this->renderPassReferences = std::move(orderedRenderPassReferences);
+        this->statistics.CulledPassCount = (size_t)compiledGraph.CulledPassCount;
+        this->statistics.PipelineBarrierCountBeforeReordering = (size_t)compiledGraph.PipelineBarrierCountBeforeReordering;
+
+        resourceTransitions = ResourceTransitions{ };
+        for (const auto& renderPassReference : this->renderPassReferences)
+        {
+            resourceTransitions.Buffers.Transitions[renderPassReference.Name];
+            resourceTransitions.Images.Transitions[renderPassReference.Name];
+            resourceTransitions.ImageSubresources[renderPassReference.Name];
+        }
+
+        auto toSubresource = [](const std::array<uint32_t, 4>& subresource)
+        {
+            return ImageSubresource{ subresource[0], subresource[1], subresource[2], subresource[3] };
+        };
+        auto toStages = [](uint32_t stages)
+        {
+            return vk::PipelineStageFlags{ (vk::PipelineStageFlags::MaskType)stages };
+        };
+
+        // transitions are stored in render pass order, so first and last usages can be restored from it
+        for (const auto& transition : compiledGraph.BufferTransitions)
+        {
+            resourceTransitions.Buffers.Transitions[transition.RenderPassName][transition.ResourceName] = BufferTransition{
+                (BufferUsage::Bits)transition.InitialUsage, (BufferUsage::Bits)transition.FinalUsage, toStages(transition.InitialStages), toStages(transition.FinalStages)
+            };
+            resourceTransitions.Buffers.TotalUsages[transition.ResourceName] |= transition.FinalUsage;
+            resourceTransitions.Buffers.FirstUsages.emplace(transition.ResourceName, transition.RenderPassName);
+            resourceTransitions.Buffers.LastUsages[transition.ResourceName] = transition.RenderPassName;
+        }
+
+        for (const auto& transition : compiledGraph.ImageTransitions)
+        {
+            auto& subresourceTransitions = resourceTransitions.ImageSubresources[transition.RenderPassName][transition.ResourceName];
+            subresourceTransitions.push_back(ImageSubresourceTransition{
+                ImageTransition{
+                    (ImageUsage::Bits)transition.InitialUsage, (ImageUsage::Bits)transition.FinalUsage, ImageUsage::UNKNOWN,
+                    toSubresource(transition.Subresource), toStages(transition.InitialStages), toStages(transition.FinalStages)
+                },
+                transition.PreviousRenderPassName
+            });
+            // segments are stored in resolve order, whole image transition is the one of the last segment
+            resourceTransitions.Images.Transitions[transition.RenderPassName][transition.ResourceName] = subresourceTransitions.back().Transition;
+            resourceTransitions.Images.Transitions[transition.RenderPassName][transition.ResourceName].Subresource = ImageSubresource{ };
+            resourceTransitions.Images.TotalUsages[transition.ResourceName] |= transition.FinalUsage;
+            resourceTransitions.Images.FirstUsages.emplace(transition.ResourceName, transition.RenderPassName);
+            resourceTransitions.Images.LastUsages[transition.ResourceName] = transition.RenderPassName;
+        }
+        for (const auto& initialState : compiledGraph.ImageInitialStates)
+        {
+            resourceTransitions.ImageInitialStates[initialState.ResourceName].push_back(ImageSubresourceState{
+                toSubresource(initialState.Subresource), (ImageUsage::Bits)initialState.FinalUsage, initialState.RenderPassName, toStages(initialState.FinalStages)
+            });
+        }
+        return true;
+    }
+
+    void RenderGraphBuilder::StoreCompiledRenderGraph(const ResourceTransitions& resourceTransitions, CompiledRenderGraph& compiledGraph)
+    {
+        compiledGraph.RenderPassOrder.clear();
+        compiledGraph.BufferTransitions.clear();
+        compiledGraph.ImageTransitions.clear();
+        compiledGraph.ImageInitialStates.clear();
+        compiledGraph.CulledPassCount = (uint64_t)this->statistics.CulledPassCount;
+        compiledGraph.PipelineBarrierCountBeforeReordering = (uint64_t)this->statistics.PipelineBarrierCountBeforeReordering;
+
+        for (const auto& renderPassReference : this->renderPassReferences)
+        {
+            compiledGraph.RenderPassOrder.push_back(renderPassReference.Name);
+            for (const auto& [bufferName, bufferTransition] : resourceTransitions.Buffers.Transitions.at(renderPassReference.Name))
+            {
+                compiledGraph.BufferTransitions.push_back(CompiledRenderGraph::Transition{
+                    renderPassReference.Name, bufferName, (uint32_t)bufferTransition.InitialUsage, (uint32_t)bufferTransition.FinalUsage,
+                    { }, { }, (uint32_t)bufferTransition.InitialStages, (uint32_t)bufferTransition.FinalStages
+                });
+            }
+            for (const auto& [imageName, subresourceTransitions] : resourceTransitions.ImageSubresources.at(renderPassReference.Name))
+            {
+                for (const auto& [imageTransition, previousUsage] : subresourceTransitions)
+                {
+                    compiledGraph.ImageTransitions.push_back(CompiledRenderGraph::Transition{
+                        renderPassReference.Name, imageName, (uint32_t)imageTransition.InitialUsage, (uint32_t)imageTransition.FinalUsage,
+                        previousUsage, ToSubresourceArray(imageTransition.Subresource), (uint32_t)imageTransition.InitialStages, (uint32_t)imageTransition.FinalStages
+                    });
+                }
+            }
+        }
+        for (const auto& [imageName, initialStates] : resourceTransitions.ImageInitialStates)
+        {
+            for (const auto& initialState : initialStates)
+            {
+                compiledGraph.ImageInitialStates.push_back(CompiledRenderGraph::Transition{
+                    initialState.LastUsage, imageName, (uint32_t)ImageUsage::UNKNOWN, (uint32_t)initialState.Usage,
+                    { }, ToSubresourceArray(initialState.Subresource), 0, (uint32_t)initialState.Stages
+                });
+            }
+        }
+    }
+
+    size_t RenderGraphBuilder::GetRenderPassIndex(const RenderPassName& renderPassName) const
+    {
+        auto renderPassReference = std::find_if(this->renderPassReferences.begin(), this->renderPassReferences.end(), [&renderPassName](const RenderPassReference& reference)
+        {
+            return reference.Name == renderPassName;
+        });
+        assert(renderPassReference != this->renderPassReferences.end());
+        return (size_t)std::distance(this->renderPassReferences.begin(), renderPassReference);
+    }
+
+    RenderGraphBuilder::PipelineHashMap RenderGraphBuilder::CreatePipelines()
+    {
+        PipelineHashMap pipelines;
         for (const auto& renderPassReference : this->renderPassReferences)
         {  
             auto& pipeline = pipelines[renderPassReference.Name];
             renderPassReference.Pass->SetupPipeline(pipeline);
 
+            // pass without shader leaves stages empty, they are deduced from usage when barrier is created
+            auto getBindingStages = [&pipeline](uint32_t binding)
+            {
+                return (bool)pipeline.Shader ? GetBindingPipelineStages(*pipeline.Shader, binding) : vk::PipelineStageFlags{ };
+            };
             for (const auto& boundBuffer : pipeline.DescriptorBindings.GetBoundBuffers())
-                pipeline.AddDependency(boundBuffer.Name, boundBuffer.Usage);
+                pipeline.AddDependency(boundBuffer.Name, boundBuffer.Usage, getBindingStages(boundBuffer.Binding));
             for (const auto& boundImage : pipeline.DescriptorBindings.GetBoundImages())
-                pipeline.AddDependency(boundImage.Name, boundImage.Usage);
+                pipeline.AddDependency(boundImage.Name, boundImage.Usage, getBindingStages(boundImage.Binding));
         }
         return pipelines;
     }
@@ -912,6 +2318,26 @@ namespace VulkanAbstractionLayer
         return attachmentNames;
     }
 
+    void RenderGraphBuilder::SetupNodeVersions(RenderGraphNode& node, const Pipeline& pipeline, const std::unordered_map<std::string, uint32_t>& historyAttachmentDepths)
+    {
+        std::unordered_set<std::string> reads, writes;
+        CollectRenderPassReads(pipeline, reads);
+        CollectRenderPassWrites(pipeline, writes);
+        node.VersionedOutputs.assign(writes.begin(), writes.end());
+
+        // history images are rotated every frame, pass accessing them cannot keep its outputs
+        bool usesHistory = std::any_of(reads.begin(), reads.end(), [&](const std::string& name) { return historyAttachmentDepths.count(name) > 0; }) ||
+            std::any_of(writes.begin(), writes.end(), [&](const std::string& name) { return historyAttachmentDepths.count(GetHistoryAttachmentBaseName(name)) > 0; });
+        node.IsCacheable = pipeline.IsCacheable() && !usesHistory;
+        if (!node.IsCacheable)
+            return;
+
+        // outputs are checked too, pass is executed again if any other pass wrote to them
+        reads.insert(writes.begin(), writes.end());
+        reads.insert(pipeline.GetCacheParameters().begin(), pipeline.GetCacheParameters().end());
+        node.VersionedInputs.assign(reads.begin(), reads.end());
+    }
+
     DescriptorBinding RenderGraphBuilder::GetRenderPassDescriptorBinding(const std::string& renderPassName, const PipelineHashMap& pipelines)
     {
         return pipelines.at(renderPassName).DescriptorBindings;
@@ -919,29 +2345,98 @@ namespace VulkanAbstractionLayer
 
     std::unique_ptr<RenderGraph> RenderGraphBuilder::Build()
     {
+        this->statistics = RenderGraphStatistics{ };
+        this->surfaceAttachments.clear();
+        this->discardedAttachments.clear();
         PipelineHashMap pipelines = this->CreatePipelines();
-        ResourceTransitions resourceTransitions = this->ResolveResourceTransitions(pipelines);
+
+        // pipeline cache is useful even if declaration has changed, analysis results are not
+        CompiledRenderGraph compiledGraph;
+        bool isCompiledGraphLoaded = !this->cacheFilepath.empty() && LoadCompiledRenderGraph(this->cacheFilepath, compiledGraph);
+        uint64_t declarationHash = !this->cacheFilepath.empty() ? this->ComputeDeclarationHash(pipelines) : 0;
+        if (!this->cacheFilepath.empty())
+        {
+            vk::PipelineCacheCreateInfo pipelineCacheCreateInfo;
+            pipelineCacheCreateInfo.setInitialData<uint8_t>(compiledGraph.PipelineCacheData);
+            this->pipelineCache = GetCurrentVulkanContext().GetDevice().createPipelineCache(pipelineCacheCreateInfo);
+        }
+
+        ResourceTransitions resourceTransitions;
+        bool isCompiledGraphRestored = isCompiledGraphLoaded && compiledGraph.DeclarationHash == declarationHash &&
+            this->RestoreCompiledRenderGraph(compiledGraph, resourceTransitions);
+        if (!isCompiledGraphRestored)
+        {
+            if (this->cullPasses && !this->outputName.empty()) this->CullRenderPasses(pipelines);
+            resourceTransitions = this->ResolveResourceTransitions(pipelines);
+            this->statistics.PipelineBarrierCountBeforeReordering = this->CountPipelineBarriers(resourceTransitions);
+            if (this->reorderPasses)
+            {
+                this->ReorderRenderPasses(pipelines);
+                resourceTransitions = this->ResolveResourceTransitions(pipelines);
+            }
+            compiledGraph.DeclarationHash = declarationHash;
+        }
+        this->statistics.PipelineBarrierCount = this->CountPipelineBarriers(resourceTransitions);
+        if (!this->cacheFilepath.empty()) this->StoreCompiledRenderGraph(resourceTransitions, compiledGraph);
         if (!this->outputName.empty()) this->SetupOutputImage(resourceTransitions, this->outputName);
-        AttachmentHashMap attachments = this->AllocateAttachments(pipelines, resourceTransitions);
+        auto renderPassQueues = this->GetRenderPassQueues(pipelines);
+        AttachmentHashMap attachments = this->AllocateAttachments(pipelines, renderPassQueues, resourceTransitions);
+
+        auto batches = this->CreateBatches(pipelines, renderPassQueues);
+        auto subpassGroups = this->GetSubpassGroups(pipelines, attachments, batches);
+        std::vector<EventBarrier> eventBarriers;
+        auto pipelineBarriers = this->CreatePipelineBarriers(renderPassQueues, batches, subpassGroups, resourceTransitions, eventBarriers);
 
         std::vector<RenderGraphNode> nodes;
+        auto historyAttachmentDepths = this->GetHistoryAttachmentDepths(pipelines);
 
-        for (auto& renderPassReference : this->renderPassReferences)
+        for (size_t renderPassIndex = 0; renderPassIndex < this->renderPassReferences.size();)
         {
-            auto renderPass = this->BuildRenderPass(renderPassReference, pipelines, attachments, resourceTransitions);
+            size_t subpassCount = std::count(subpassGroups.begin(), subpassGroups.end(), renderPassIndex);
+            std::vector<FramebufferAttachment> framebufferAttachments;
+            auto renderPasses = this->BuildRenderPasses(renderPassIndex, subpassCount, pipelines, attachments, resourceTransitions, framebufferAttachments);
 
-            nodes.push_back(RenderGraphNode{
-                renderPassReference.Name,
-                renderPass,
-                std::move(renderPassReference.Pass),
-                this->GetRenderPassAttachmentNames(renderPassReference.Name, pipelines),
-                this->CreatePipelineBarrierCallback(renderPassReference.Name, pipelines.at(renderPassReference.Name), resourceTransitions),
-                this->GetRenderPassDescriptorBinding(renderPassReference.Name, pipelines),
-            });
+            for (auto& renderPass : renderPasses)
+            {
+                auto& renderPassReference = this->renderPassReferences[renderPassIndex];
+                nodes.push_back(RenderGraphNode{
+                    renderPassReference.Name,
+                    std::move(renderPass),
+                    std::move(renderPassReference.Pass),
+                    this->GetRenderPassAttachmentNames(renderPassReference.Name, pipelines),
+                    std::move(pipelineBarriers[renderPassIndex]),
+                    this->GetRenderPassDescriptorBinding(renderPassReference.Name, pipelines),
+                    std::move(framebufferAttachments),
+                    std::move(eventBarriers[renderPassIndex].WaitBarrier),
+                    std::move(eventBarriers[renderPassIndex].WaitedPasses),
+                    eventBarriers[renderPassIndex].SignalStages,
+                });
+                this->SetupNodeVersions(nodes.back(), pipelines.at(renderPassReference.Name), historyAttachmentDepths);
+                renderPassIndex++;
+            }
+        }
+
+        if ((bool)this->pipelineCache)
+        {
+            auto& device = GetCurrentVulkanContext().GetDevice();
+            compiledGraph.PipelineCacheData = device.getPipelineCacheData(this->pipelineCache);
+            SaveCompiledRenderGraph(this->cacheFilepath, compiledGraph);
+            device.destroyPipelineCache(this->pipelineCache);
+            this->pipelineCache = vk::PipelineCache{ };
         }
 
         auto OnCreate = this->CreateCreateCallback(pipelines, resourceTransitions, attachments);
 
+        std::vector<std::vector<std::string>> historyAttachments;
+        for (const auto& [attachmentName, historyDepth] : historyAttachmentDepths)
+        {
+            if (attachments.find(attachmentName) == attachments.end())
+                continue;
+            auto& historyNames = historyAttachments.emplace_back();
+            for (uint32_t age = 0; age < historyDepth; age++)
+                historyNames.push_back(GetHistoryAttachmentName(attachmentName, age));
+        }
+
         auto OnPresent = !this->outputName.empty() ?
             this->CreatePresentCallback(this->outputName, resourceTransitions) :
             DefaultPresentCallback;
@@ -951,7 +2446,12 @@ namespace VulkanAbstractionLayer
             std::move(attachments), 
             std::move(this->outputName), 
             std::move(OnPresent),
-            std::move(OnCreate)
+            std::move(OnCreate),
+            std::move(this->attachmentMemory),
+            std::move(this->surfaceAttachments),
+            this->statistics,
+            std::move(batches),
+            std::move(historyAttachments)
         );
     }
 }
\ No newline at end of file
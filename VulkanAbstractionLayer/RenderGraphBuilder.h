@@ -33,25 +33,15 @@
 #include <array>
 #include <optional>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "RenderGraph.h"
+#include "RenderGraphCache.h"
 #include "Shader.h"
 #include "DescriptorBinding.h"
 
 namespace VulkanAbstractionLayer
 {
-    struct ImageTransition
-    {
-        ImageUsage::Bits InitialUsage;
-        ImageUsage::Bits FinalUsage;
-    };
-
-    struct BufferTransition
-    {
-        BufferUsage::Bits InitialUsage;
-        BufferUsage::Bits FinalUsage;
-    };
-
     class RenderGraphBuilder
     {
         struct RenderPassReference
@@ -75,35 +65,96 @@ namespace VulkanAbstractionLayer
             std::unordered_map<ResourceType, RenderPassName> LastUsages;
         };
 
+        struct ImageSubresourceState
+        {
+            ImageSubresource Subresource;
+            ImageUsage::Bits Usage;
+            RenderPassName LastUsage; // may be render pass of previous frame
+            vk::PipelineStageFlags Stages;
+        };
+
+        struct ImageSubresourceTransition
+        {
+            ImageTransition Transition;
+            RenderPassName PreviousUsage;
+        };
+
+        using ImageSubresourceTransitionHashMap = std::unordered_map<std::string, std::vector<ImageSubresourceTransition>>;
+
         struct ResourceTransitions
         {
             ResourceTypeTransitions<std::string, BufferTransition> Buffers;
-            ResourceTypeTransitions<std::string, ImageTransition> Images;
+            ResourceTypeTransitions<std::string, ImageTransition> Images; // whole image, barriers are created from subresource transitions
+            std::unordered_map<RenderPassName, ImageSubresourceTransitionHashMap> ImageSubresources;
+            std::unordered_map<std::string, std::vector<ImageSubresourceState>> ImageInitialStates; // at the beginning of frame
+        };
+
+        // barrier split into event signal after producer pass and event wait before consumer pass
+        struct EventBarrier
+        {
+            PipelineBarrier WaitBarrier;
+            std::vector<size_t> WaitedPasses;
+            vk::PipelineStageFlags SignalStages = { };
         };
 
         using AttachmentHashMap = std::unordered_map<std::string, Image>;
         using PipelineHashMap = std::unordered_map<RenderPassName, Pipeline>;
-        using PipelineBarrierCallback = std::function<void(CommandBuffer&, const ResolveInfo&)>;
         using PresentCallback = std::function<void(CommandBuffer&, const Image&, const Image&)>;
         using CreateCallback = std::function<void(CommandBuffer&)>;
 
         std::vector<RenderPassReference> renderPassReferences;
         std::string outputName;
+        std::vector<VmaAllocation> attachmentMemory;
+        std::vector<SurfaceAttachment> surfaceAttachments;
+        std::unordered_set<std::string> discardedAttachments; // content is not needed after last usage in frame
+        bool cullPasses = false;
+        bool reorderPasses = false;
+        bool mergeSubpasses = false;
+        bool splitBarriers = false;
+        bool coalesceBarriers = false;
+        std::string cacheFilepath;
+        vk::PipelineCache pipelineCache;
+        RenderGraphStatistics statistics;
         
-        PassNative BuildRenderPass(const RenderPassReference& renderPassReference, const PipelineHashMap& pipelines, const AttachmentHashMap& attachments, const ResourceTransitions& resourceTransitions);
-        PipelineBarrierCallback CreatePipelineBarrierCallback(const std::string& renderPassName, const Pipeline& pipeline, const ResourceTransitions& resourceTransitions);
+        std::vector<PassNative> BuildRenderPasses(size_t firstRenderPass, size_t subpassCount, const PipelineHashMap& pipelines, const AttachmentHashMap& attachments, const ResourceTransitions& resourceTransitions, std::vector<FramebufferAttachment>& framebufferAttachments);
+        std::vector<QueueType> GetRenderPassQueues(const PipelineHashMap& pipelines);
+        std::vector<RenderGraphBatch> CreateBatches(const PipelineHashMap& pipelines, const std::vector<QueueType>& renderPassQueues);
+        std::vector<size_t> GetSubpassGroups(const PipelineHashMap& pipelines, const AttachmentHashMap& attachments, const std::vector<RenderGraphBatch>& batches);
+        std::vector<PipelineBarrier> CreatePipelineBarriers(const std::vector<QueueType>& renderPassQueues, std::vector<RenderGraphBatch>& batches, const std::vector<size_t>& subpassGroups, const ResourceTransitions& resourceTransitions, std::vector<EventBarrier>& eventBarriers);
         PresentCallback CreatePresentCallback(const std::string& outputName, const ResourceTransitions& transitions);
         CreateCallback CreateCreateCallback(const PipelineHashMap& pipelines, const ResourceTransitions& transitions, const AttachmentHashMap& attachments);
+        void CullRenderPasses(const PipelineHashMap& pipelines);
+        void ReorderRenderPasses(const PipelineHashMap& pipelines);
+        size_t CountPipelineBarriers(const ResourceTransitions& resourceTransitions);
         ResourceTransitions ResolveResourceTransitions(const PipelineHashMap& pipelines);
-        AttachmentHashMap AllocateAttachments(const PipelineHashMap& pipelines, const ResourceTransitions& transitions);
+        AttachmentHashMap AllocateAttachments(const PipelineHashMap& pipelines, const std::vector<QueueType>& renderPassQueues, ResourceTransitions& transitions);
         void SetupOutputImage(ResourceTransitions& transitions, const std::string& outputImage);
         PipelineHashMap CreatePipelines();
+        size_t GetRenderPassIndex(const RenderPassName& renderPassName) const;
+        uint64_t ComputeDeclarationHash(const PipelineHashMap& pipelines);
+        bool RestoreCompiledRenderGraph(const CompiledRenderGraph& compiledGraph, ResourceTransitions& resourceTransitions);
+        void StoreCompiledRenderGraph(const ResourceTransitions& resourceTransitions, CompiledRenderGraph& compiledGraph);
         ImageTransition GetOutputImageFinalTransition(const std::string& outputName, const ResourceTransitions& resourceTransitions);
+        std::unordered_map<std::string, uint32_t> GetHistoryAttachmentDepths(const PipelineHashMap& pipelines);
         std::vector<std::string> GetRenderPassAttachmentNames(const std::string& renderPassName, const PipelineHashMap& pipelines);
+        void SetupNodeVersions(RenderGraphNode& node, const Pipeline& pipeline, const std::unordered_map<std::string, uint32_t>& historyAttachmentDepths);
         DescriptorBinding GetRenderPassDescriptorBinding(const std::string& renderPassName, const PipelineHashMap& pipelines);
     public:
         RenderGraphBuilder& AddRenderPass(const std::string& name, std::unique_ptr<RenderPass> renderPass);
         RenderGraphBuilder& SetOutputName(const std::string& name);
+        // passes without side effect whose results never reach output are removed, they cannot be looked up in built graph
+        RenderGraphBuilder& SetPassCulling(bool enabled);
+        RenderGraphBuilder& SetPassReordering(bool enabled);
+        // BeforeRender callbacks of merged passes are all invoked before first subpass begins
+        RenderGraphBuilder& SetSubpassMerging(bool enabled);
+        // transitions between distant passes are split into set and wait of per frame events,
+        // waits are recorded with vkCmdWaitEvents even when synchronization2 is available
+        RenderGraphBuilder& SetBarrierSplitting(bool enabled);
+        // transitions of adjacent independent render passes are recorded with single pipeline barrier,
+        // BeforeRender callbacks of passes in between then run after it, so they must not access resources declared by later passes
+        RenderGraphBuilder& SetBarrierCoalescing(bool enabled);
+        // compiled graph and pipeline cache are loaded from and saved to this file on Build
+        RenderGraphBuilder& SetCacheFile(const std::string& filepath);
         std::unique_ptr<RenderGraph> Build();
     };
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "RenderGraphCache.h"
+
+#include <fstream>
+
+namespace VulkanAbstractionLayer
+{
+    constexpr uint32_t RenderGraphCacheMagic = 0x47524C56; // VLRG
+    constexpr uint32_t RenderGraphCacheVersion = 3; // increment on any format change
+
+    void DeclarationHash::Add(const void* data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            this->value ^= ((const uint8_t*)data)[i];
+            this->value *= 1099511628211ull;
+        }
+    }
+
+    void DeclarationHash::Add(const std::string& value)
+    {
+        // length is included so concatenated strings do not collide
+        this->Add((uint64_t)value.size());
+        this->Add(value.data(), value.size());
+    }
+
+    template<typename T>
+    static void Write(std::ofstream& file, const T& value)
+    {
+        file.write((const char*)&value, sizeof(T));
+    }
+
+    static void Write(std::ofstream& file, const std::string& value)
+    {
+        Write(file, (uint64_t)value.size());
+        file.write(value.data(), value.size());
+    }
+
+    static void Write(std::ofstream& file, const std::vector<CompiledRenderGraph::Transition>& transitions)
+    {
+        Write(file, (uint64_t)transitions.size());
+        for (const auto& transition : transitions)
+        {
+            Write(file, transition.RenderPassName);
+            Write(file, transition.ResourceName);
+            Write(file, transition.InitialUsage);
+            Write(file, transition.FinalUsage);
+            Write(file, transition.PreviousRenderPassName);
+            Write(file, transition.Subresource);
+            Write(file, transition.InitialStages);
+            Write(file, transition.FinalStages);
+        }
+    }
+
+    template<typename T>
+    static bool Read(std::ifstream& file, T& value)
+    {
+        return (bool)file.read((char*)&value, sizeof(T));
+    }
+
+    // element count is validated against rest of file, so corrupted cache fails to load instead of allocating arbitrary amount of memory
+    static bool ReadSize(std::ifstream& file, uint64_t& size, uint64_t minimumElementSize)
+    {
+        if (!Read(file, size)) return false;
+        std::streamoff position = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff end = file.tellg();
+        file.seekg(position);
+        if (position < 0 || end < position) return false;
+        return size <= uint64_t(end - position) / minimumElementSize;
+    }
+
+    static bool Read(std::ifstream& file, std::string& value)
+    {
+        uint64_t size = 0;
+        if (!ReadSize(file, size, sizeof(char))) return false;
+        value.resize(size);
+        return (bool)file.read(value.data(), size);
+    }
+
+    static bool Read(std::ifstream& file, std::vector<CompiledRenderGraph::Transition>& transitions)
+    {
+        uint64_t size = 0;
+        // every transition stores at least sizes of its three names
+        if (!ReadSize(file, size, 3 * sizeof(uint64_t))) return false;
+        transitions.resize(size);
+        for (auto& transition : transitions)
+        {
+            if (!Read(file, transition.RenderPassName) || !Read(file, transition.ResourceName) ||
+                !Read(file, transition.InitialUsage) || !Read(file, transition.FinalUsage) ||
+                !Read(file, transition.PreviousRenderPassName) || !Read(file, transition.Subresource) ||
+                !Read(file, transition.InitialStages) || !Read(file, transition.FinalStages))
+                return false;
+        }
+        return true;
+    }
+
+    bool LoadCompiledRenderGraph(const std::string& filepath, CompiledRenderGraph& compiledGraph)
+    {
+        std::ifstream file(filepath, std::ios::binary);
+        if (!file.good()) return false;
+
+        uint32_t magic = 0, version = 0;
+        if (!Read(file, magic) || !Read(file, version)) return false;
+        if (magic != RenderGraphCacheMagic || version != RenderGraphCacheVersion) return false;
+
+        uint64_t renderPassCount = 0;
+        if (!Read(file, compiledGraph.DeclarationHash) || !ReadSize(file, renderPassCount, sizeof(uint64_t))) return false;
+        compiledGraph.RenderPassOrder.resize(renderPassCount);
+        for (auto& renderPassName : compiledGraph.RenderPassOrder)
+        {
+            if (!Read(file, renderPassName)) return false;
+        }
+
+        if (!Read(file, compiledGraph.CulledPassCount) || !Read(file, compiledGraph.PipelineBarrierCountBeforeReordering)) return false;
+        if (!Read(file, compiledGraph.BufferTransitions) || !Read(file, compiledGraph.ImageTransitions) || !Read(file, compiledGraph.ImageInitialStates)) return false;
+
+        uint64_t pipelineCacheSize = 0;
+        if (!ReadSize(file, pipelineCacheSize, sizeof(uint8_t))) return false;
+        compiledGraph.PipelineCacheData.resize(pipelineCacheSize);
+        return (bool)file.read((char*)compiledGraph.PipelineCacheData.data(), pipelineCacheSize);
+    }
+
+    void SaveCompiledRenderGraph(const std::string& filepath, const CompiledRenderGraph& compiledGraph)
+    {
+        std::ofstream file(filepath, std::ios::binary);
+        if (!file.good()) return;
+
+        Write(file, RenderGraphCacheMagic);
+        Write(file, RenderGraphCacheVersion);
+        Write(file, compiledGraph.DeclarationHash);
+
+        Write(file, (uint64_t)compiledGraph.RenderPassOrder.size());
+        for (const auto& renderPassName : compiledGraph.RenderPassOrder)
+            Write(file, renderPassName);
+
+        Write(file, compiledGraph.CulledPassCount);
+        Write(file, compiledGraph.PipelineBarrierCountBeforeReordering);
+        Write(file, compiledGraph.BufferTransitions);
+        Write(file, compiledGraph.ImageTransitions);
+        Write(file, compiledGraph.ImageInitialStates);
+
+        Write(file, (uint64_t)compiledGraph.PipelineCacheData.size());
+        file.write((const char*)compiledGraph.PipelineCacheData.data(), compiledGraph.PipelineCacheData.size());
+    }
+}
@@ -0,0 +1,84 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <array>
+#include <type_traits>
+
+namespace VulkanAbstractionLayer
+{
+    // FNV-1a hash of render graph declaration, stable between application runs
+    class DeclarationHash
+    {
+        uint64_t value = 14695981039346656037ull;
+    public:
+        void Add(const void* data, size_t size);
+        void Add(const std::string& value);
+
+        template<typename T>
+        void Add(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            this->Add((const void*)&value, sizeof(T));
+        }
+
+        uint64_t GetValue() const { return this->value; }
+    };
+
+    // result of render graph analysis, reused by builder if declaration hash matches
+    struct CompiledRenderGraph
+    {
+        struct Transition
+        {
+            std::string RenderPassName;
+            std::string ResourceName;
+            uint32_t InitialUsage;
+            uint32_t FinalUsage;
+            std::string PreviousRenderPassName; // images only, last user of subresource range
+            std::array<uint32_t, 4> Subresource = { }; // base mip, mip count, base layer, layer count
+            uint32_t InitialStages = 0; // vk::PipelineStageFlags reflected from shaders
+            uint32_t FinalStages = 0;
+        };
+
+        uint64_t DeclarationHash = 0;
+        std::vector<std::string> RenderPassOrder; // after culling and reordering
+        uint64_t CulledPassCount = 0;
+        uint64_t PipelineBarrierCountBeforeReordering = 0;
+        std::vector<Transition> BufferTransitions; // in render pass order
+        std::vector<Transition> ImageTransitions; // one per subresource range
+        std::vector<Transition> ImageInitialStates; // final usage is state at the beginning of frame
+        std::vector<uint8_t> PipelineCacheData;
+    };
+
+    // returns false if file is missing, corrupted or written by another version
+    bool LoadCompiledRenderGraph(const std::string& filepath, CompiledRenderGraph& compiledGraph);
+    void SaveCompiledRenderGraph(const std::string& filepath, const CompiledRenderGraph& compiledGraph);
+}
@@ -0,0 +1,246 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "RenderGraphProfiler.h"
+#include "VulkanContext.h"
+
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <numeric>
+
+namespace VulkanAbstractionLayer
+{
+    RenderGraphProfiler::CpuScope::CpuScope(RenderGraphProfiler* profiler, size_t node, CpuStage stage)
+        : profiler(profiler), node(node), stage(stage)
+    {
+        if (this->profiler != nullptr)
+            this->begin = Clock::now();
+    }
+
+    RenderGraphProfiler::CpuScope::~CpuScope()
+    {
+        if (this->profiler != nullptr)
+            this->profiler->SetCpuInterval(this->node, this->stage, this->begin, Clock::now());
+    }
+
+    RenderGraphProfiler::RenderGraphProfiler(std::vector<std::string> nodeNames)
+        : nodeNames(std::move(nodeNames)), creationTime(Clock::now())
+    {
+        auto& vulkan = GetCurrentVulkanContext();
+        auto queueFamilies = vulkan.GetPhysicalDevice().getQueueFamilyProperties();
+        auto graphicsValidBits = queueFamilies[vulkan.GetQueueFamilyIndex()].timestampValidBits;
+        auto computeValidBits = queueFamilies[vulkan.GetComputeQueueFamilyIndex()].timestampValidBits;
+
+        this->nodeSamples.resize(this->nodeNames.size());
+        this->nodeProfiles.resize(this->nodeNames.size());
+        // storage of whole sample window is reserved, so profiling does not allocate during frame
+        for (auto& samples : this->nodeSamples)
+        {
+            for (auto& timingSamples : samples.Samples)
+                timingSamples.reserve(SAMPLE_WINDOW);
+        }
+        this->traceEvents.reserve(SAMPLE_WINDOW * TIMING_COUNT * this->nodeNames.size());
+
+        // only cpu time is measured if any used queue cannot write timestamps
+        if (graphicsValidBits == 0 || computeValidBits == 0 || this->nodeNames.empty())
+            return;
+
+        auto validBits = std::min(graphicsValidBits, computeValidBits);
+        this->timestampMask = validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits) - 1;
+        this->timestampPeriod = vulkan.GetPhysicalDeviceProperties().limits.timestampPeriod;
+
+        vk::QueryPoolCreateInfo queryPoolCreateInfo;
+        queryPoolCreateInfo
+            .setQueryType(vk::QueryType::eTimestamp)
+            .setQueryCount(uint32_t(this->nodeNames.size() * 2));
+
+        for (size_t frameIndex = 0; frameIndex < vulkan.GetVirtualFrameCount(); frameIndex++)
+            this->queryPools.push_back(vulkan.GetDevice().createQueryPool(queryPoolCreateInfo));
+        this->hasPendingQueries.resize(this->queryPools.size(), false);
+    }
+
+    RenderGraphProfiler::~RenderGraphProfiler()
+    {
+        auto& device = GetCurrentVulkanContext().GetDevice();
+        for (const auto& queryPool : this->queryPools)
+            device.destroyQueryPool(queryPool);
+    }
+
+    void RenderGraphProfiler::AddSample(size_t node, size_t timing, double start, double duration)
+    {
+        auto& samples = this->nodeSamples[node].Samples[timing];
+        auto& nextSample = this->nodeSamples[node].NextSamples[timing];
+        float milliseconds = float(duration / 1000.0);
+
+        if (samples.size() < SAMPLE_WINDOW)
+            samples.push_back(milliseconds);
+        else
+            samples[nextSample] = milliseconds;
+        nextSample = (nextSample + 1) % SAMPLE_WINDOW;
+
+        auto& profile = this->nodeProfiles[node];
+        std::array<TimingStatistics*, TIMING_COUNT> statistics = {
+            &profile.GpuTime, &profile.BeforeRenderCpuTime, &profile.OnRenderCpuTime, &profile.AfterRenderCpuTime
+        };
+        auto& statistic = *statistics[timing];
+        statistic.Last = milliseconds;
+        statistic.Min = *std::min_element(samples.begin(), samples.end());
+        statistic.Max = *std::max_element(samples.begin(), samples.end());
+        statistic.Average = std::accumulate(samples.begin(), samples.end(), 0.0f) / (float)samples.size();
+
+        size_t traceEventCapacity = SAMPLE_WINDOW * TIMING_COUNT * this->nodeNames.size();
+        if (this->traceEvents.size() < traceEventCapacity)
+            this->traceEvents.push_back(TraceEvent{ node, timing, start, duration });
+        else
+            this->traceEvents[this->nextTraceEvent] = TraceEvent{ node, timing, start, duration };
+        this->nextTraceEvent = (this->nextTraceEvent + 1) % traceEventCapacity;
+    }
+
+    void RenderGraphProfiler::ReadQueryResults(size_t frameIndex)
+    {
+        // each query is followed by its availability, nodes which were not executed are skipped
+        this->queryResults.resize(this->nodeNames.size() * 4);
+        (void)GetCurrentVulkanContext().GetDevice().getQueryPoolResults(
+            this->queryPools[frameIndex],
+            0,
+            uint32_t(this->nodeNames.size() * 2),
+            this->queryResults.size() * sizeof(uint64_t),
+            this->queryResults.data(),
+            2 * sizeof(uint64_t),
+            vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability
+        );
+
+        for (size_t node = 0; node < this->nodeNames.size(); node++)
+        {
+            const uint64_t* results = &this->queryResults[node * 4];
+            if (results[1] == 0 || results[3] == 0)
+                continue;
+
+            uint64_t begin = results[0] & this->timestampMask;
+            uint64_t end = results[2] & this->timestampMask;
+            if (this->firstGpuTimestamp == 0)
+                this->firstGpuTimestamp = begin;
+
+            double start = double(begin - this->firstGpuTimestamp) * this->timestampPeriod / 1000.0;
+            double duration = double((end - begin) & this->timestampMask) * this->timestampPeriod / 1000.0;
+            this->AddSample(node, 0, start, duration);
+        }
+    }
+
+    void RenderGraphProfiler::BeginFrame(CommandBuffer& commandBuffer)
+    {
+        for (auto& samples : this->nodeSamples)
+            samples.FrameCpuIntervals.fill(CpuInterval{ });
+
+        if (this->queryPools.empty())
+            return;
+
+        auto frameIndex = GetCurrentVulkanContext().GetCurrentVirtualFrameIndex();
+        if (this->hasPendingQueries[frameIndex])
+            this->ReadQueryResults(frameIndex);
+
+        commandBuffer.GetNativeHandle().resetQueryPool(this->queryPools[frameIndex], 0, uint32_t(this->nodeNames.size() * 2));
+        this->hasPendingQueries[frameIndex] = true;
+    }
+
+    void RenderGraphProfiler::EndFrame()
+    {
+        for (size_t node = 0; node < this->nodeSamples.size(); node++)
+        {
+            const auto& intervals = this->nodeSamples[node].FrameCpuIntervals;
+            for (size_t stage = 0; stage < intervals.size(); stage++)
+            {
+                if (intervals[stage].Begin == Clock::time_point{ })
+                    continue;
+
+                double start = std::chrono::duration<double, std::micro>(intervals[stage].Begin - this->creationTime).count();
+                double duration = std::chrono::duration<double, std::micro>(intervals[stage].End - intervals[stage].Begin).count();
+                this->AddSample(node, stage + 1, start, duration);
+            }
+        }
+    }
+
+    void RenderGraphProfiler::WriteBeginTimestamp(CommandBuffer& commandBuffer, size_t node)
+    {
+        if (this->queryPools.empty())
+            return;
+
+        auto frameIndex = GetCurrentVulkanContext().GetCurrentVirtualFrameIndex();
+        commandBuffer.GetNativeHandle().writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, this->queryPools[frameIndex], uint32_t(node * 2));
+    }
+
+    void RenderGraphProfiler::WriteEndTimestamp(CommandBuffer& commandBuffer, size_t node)
+    {
+        if (this->queryPools.empty())
+            return;
+
+        auto frameIndex = GetCurrentVulkanContext().GetCurrentVirtualFrameIndex();
+        commandBuffer.GetNativeHandle().writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, this->queryPools[frameIndex], uint32_t(node * 2 + 1));
+    }
+
+    void RenderGraphProfiler::SetCpuInterval(size_t node, CpuStage stage, Clock::time_point begin, Clock::time_point end)
+    {
+        // nodes are recorded by at most one thread, so no synchronization is needed
+        this->nodeSamples[node].FrameCpuIntervals[(size_t)stage] = CpuInterval{ begin, end };
+    }
+
+    static std::string EscapeJson(const std::string& value)
+    {
+        std::string escaped;
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\') escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+
+    void RenderGraphProfiler::WriteChromeTrace(const std::string& filepath) const
+    {
+        constexpr std::array<const char*, TIMING_COUNT> TrackNames = { "GPU", "BeforeRender", "OnRender", "AfterRender" };
+
+        std::ofstream file(filepath);
+        if (!file.good()) return;
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\"traceEvents\":[\n";
+        for (size_t track = 0; track < TrackNames.size(); track++)
+        {
+            file << (track > 0 ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << track
+                << ",\"args\":{\"name\":\"" << TrackNames[track] << "\"}}";
+        }
+
+        for (size_t eventIndex = 0; eventIndex < this->traceEvents.size(); eventIndex++)
+        {
+            const auto& event = this->traceEvents[(this->nextTraceEvent + eventIndex) % this->traceEvents.size()];
+            file << ",\n{\"name\":\"" << EscapeJson(this->nodeNames[event.Node]) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.Timing
+                << ",\"ts\":" << event.Start << ",\"dur\":" << event.Duration << "}";
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+}
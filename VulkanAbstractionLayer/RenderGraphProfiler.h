@@ -0,0 +1,139 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <vector>
+#include <string>
+#include <array>
+#include <chrono>
+
+#include "CommandBuffer.h"
+
+namespace VulkanAbstractionLayer
+{
+    // milliseconds, rolling over last RenderGraphProfiler::SAMPLE_WINDOW frames
+    struct TimingStatistics
+    {
+        float Last = 0.0f;
+        float Min = 0.0f;
+        float Average = 0.0f;
+        float Max = 0.0f;
+    };
+
+    struct RenderGraphNodeProfile
+    {
+        TimingStatistics GpuTime;
+        TimingStatistics BeforeRenderCpuTime;
+        TimingStatistics OnRenderCpuTime;
+        TimingStatistics AfterRenderCpuTime;
+    };
+
+    class RenderGraphProfiler
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+        constexpr static size_t SAMPLE_WINDOW = 128;
+
+        enum class CpuStage
+        {
+            BEFORE_RENDER = 0,
+            ON_RENDER,
+            AFTER_RENDER,
+        };
+
+        // measures callback from construction to destruction, does nothing without profiler
+        class CpuScope
+        {
+            RenderGraphProfiler* profiler;
+            size_t node;
+            CpuStage stage;
+            Clock::time_point begin;
+        public:
+            CpuScope(RenderGraphProfiler* profiler, size_t node, CpuStage stage);
+            ~CpuScope();
+            CpuScope(const CpuScope&) = delete;
+            CpuScope& operator=(const CpuScope&) = delete;
+        };
+
+    private:
+        constexpr static size_t TIMING_COUNT = 4; // gpu time and every cpu stage
+
+        struct CpuInterval
+        {
+            Clock::time_point Begin;
+            Clock::time_point End;
+        };
+
+        struct NodeSamples
+        {
+            std::array<std::vector<float>, TIMING_COUNT> Samples;
+            std::array<size_t, TIMING_COUNT> NextSamples = { };
+            std::array<CpuInterval, TIMING_COUNT - 1> FrameCpuIntervals;
+        };
+
+        struct TraceEvent
+        {
+            size_t Node;
+            size_t Timing;
+            double Start; // microseconds
+            double Duration;
+        };
+
+        std::vector<std::string> nodeNames;
+        std::vector<vk::QueryPool> queryPools; // one per virtual frame, empty if queues do not support timestamps
+        std::vector<bool> hasPendingQueries;
+        std::vector<uint64_t> queryResults;
+        uint64_t timestampMask = 0;
+        float timestampPeriod = 0.0f;
+        std::vector<NodeSamples> nodeSamples;
+        std::vector<RenderGraphNodeProfile> nodeProfiles;
+        std::vector<TraceEvent> traceEvents; // ring buffer, oldest event is at nextTraceEvent once it is full
+        size_t nextTraceEvent = 0;
+        Clock::time_point creationTime;
+        uint64_t firstGpuTimestamp = 0;
+
+        void AddSample(size_t node, size_t timing, double start, double duration);
+        void ReadQueryResults(size_t frameIndex);
+    public:
+        RenderGraphProfiler(std::vector<std::string> nodeNames);
+        ~RenderGraphProfiler();
+        RenderGraphProfiler(const RenderGraphProfiler&) = delete;
+        RenderGraphProfiler& operator=(const RenderGraphProfiler&) = delete;
+
+        // collects results written by the same virtual frame, its fence must be already waited
+        void BeginFrame(CommandBuffer& commandBuffer);
+        void EndFrame();
+        void WriteBeginTimestamp(CommandBuffer& commandBuffer, size_t node);
+        void WriteEndTimestamp(CommandBuffer& commandBuffer, size_t node);
+        void SetCpuInterval(size_t node, CpuStage stage, Clock::time_point begin, Clock::time_point end);
+
+        const RenderGraphNodeProfile& GetNodeProfile(size_t node) const { return this->nodeProfiles[node]; }
+        // gpu and cpu events are placed on separate tracks, their clocks are not synchronized
+        void WriteChromeTrace(const std::string& filepath) const;
+    };
+}
@@ -38,13 +38,26 @@ namespace VulkanAbstractionLayer
     struct PassNative
     {
         vk::RenderPass RenderPassHandle;
-        vk::DescriptorSet DescriptorSet;
+        vk::DescriptorSetLayout DescriptorSetLayout; // shared with other passes, owned by descriptor cache
+        vk::DescriptorSet DescriptorSet; // set of current virtual frame
+        std::vector<vk::DescriptorSet> FrameDescriptorSets; // one per virtual frame, sets of frames in flight are not written
+        vk::DescriptorSet ResourceHeapSet; // owned by context, empty if shader does not index resource heap
         vk::Framebuffer Framebuffer;
         vk::Pipeline Pipeline;
         vk::PipelineLayout PipelineLayout;
         vk::PipelineBindPoint PipelineType = { };
         vk::Rect2D RenderArea = { };
+        uint32_t SubpassIndex = 0; // non-zero if pass is merged into render pass of previous node
         std::vector<vk::ClearValue> ClearValues;
+
+        // dynamic rendering: attachments are described here instead of render pass handle and framebuffer
+        bool UsesDynamicRendering = false;
+        std::vector<vk::RenderingAttachmentInfoKHR> ColorAttachments;
+        vk::RenderingAttachmentInfoKHR DepthStencilAttachment;
+        std::vector<vk::Format> ColorAttachmentFormats;
+        vk::Format DepthAttachmentFormat = vk::Format::eUndefined;
+        vk::Format StencilAttachmentFormat = vk::Format::eUndefined;
+        uint32_t ViewMask = 0;
     };
 
     struct RenderPassState
@@ -65,8 +78,10 @@ namespace VulkanAbstractionLayer
         virtual ~RenderPass() = default;
 
         virtual void SetupPipeline(PipelineState state) { }
+        // called for every node in graph order before any node is recorded, descriptors of frame are written together
         virtual void ResolveResources(ResolveState resolve) { }
 
+        // invoked outside of render pass instance, for merged subpasses before first subpass begins, so it must not depend on earlier merged pass output
         virtual void BeforeRender(RenderPassState state) { }
         virtual void OnRender(RenderPassState state) { }
         virtual void AfterRender(RenderPassState state) { }
@@ -0,0 +1,240 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ResourceHeap.h"
+#include "VulkanContext.h"
+
+#include <algorithm>
+
+namespace VulkanAbstractionLayer
+{
+    static vk::DescriptorType GetBindingDescriptorType(ResourceHeapBinding binding)
+    {
+        switch (binding)
+        {
+        case ResourceHeapBinding::SAMPLED_IMAGES:
+            return vk::DescriptorType::eCombinedImageSampler;
+        case ResourceHeapBinding::STORAGE_IMAGES:
+            return vk::DescriptorType::eStorageImage;
+        case ResourceHeapBinding::STORAGE_BUFFERS:
+            return vk::DescriptorType::eStorageBuffer;
+        default:
+            assert(false);
+            return vk::DescriptorType::eCombinedImageSampler;
+        }
+    }
+
+    void ResourceHeap::Init(uint32_t sampledImageCount, uint32_t storageImageCount, uint32_t storageBufferCount, uint32_t reservedPassDescriptorCount, size_t virtualFrameCount)
+    {
+        if (sampledImageCount == 0 && storageImageCount == 0 && storageBufferCount == 0)
+            return;
+
+        // update after bind limits count descriptors of all sets in pipeline layout, so set of pass is subtracted from them
+        auto& vulkan = GetCurrentVulkanContext();
+        auto properties = vulkan.GetPhysicalDevice().getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+        const auto& limits = properties.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+        auto getCapacity = [reservedPassDescriptorCount](uint32_t requestedCount, uint32_t perStageLimit, uint32_t perSetLimit)
+        {
+            uint32_t limit = std::min(perStageLimit, perSetLimit);
+            return std::min(requestedCount, limit > reservedPassDescriptorCount ? limit - reservedPassDescriptorCount : 0u);
+        };
+
+        // combined image sampler counts as both sampled image and sampler
+        this->slotAllocators[(size_t)ResourceHeapBinding::SAMPLED_IMAGES].Capacity = getCapacity(sampledImageCount,
+            std::min(limits.maxPerStageDescriptorUpdateAfterBindSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSamplers),
+            std::min(limits.maxDescriptorSetUpdateAfterBindSampledImages, limits.maxDescriptorSetUpdateAfterBindSamplers));
+        this->slotAllocators[(size_t)ResourceHeapBinding::STORAGE_IMAGES].Capacity = getCapacity(storageImageCount,
+            limits.maxPerStageDescriptorUpdateAfterBindStorageImages, limits.maxDescriptorSetUpdateAfterBindStorageImages);
+        this->slotAllocators[(size_t)ResourceHeapBinding::STORAGE_BUFFERS].Capacity = getCapacity(storageBufferCount,
+            limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers);
+
+        // all bindings are visible to every stage, together they also must fit into per stage resource limit
+        uint32_t remainingResourceCount = limits.maxPerStageUpdateAfterBindResources > reservedPassDescriptorCount ? limits.maxPerStageUpdateAfterBindResources - reservedPassDescriptorCount : 0u;
+        for (auto& allocator : this->slotAllocators)
+        {
+            allocator.Capacity = std::min(allocator.Capacity, remainingResourceCount);
+            remainingResourceCount -= allocator.Capacity;
+        }
+        this->reservedPassDescriptorCount = reservedPassDescriptorCount;
+
+        std::vector<vk::DescriptorSetLayoutBinding> layoutBindings;
+        std::vector<vk::DescriptorBindingFlags> bindingFlags;
+        std::vector<vk::DescriptorPoolSize> poolSizes;
+        for (uint32_t binding = 0; binding < BindingCount; binding++)
+        {
+            auto descriptorType = GetBindingDescriptorType((ResourceHeapBinding)binding);
+            auto capacity = this->slotAllocators[binding].Capacity;
+            layoutBindings.push_back(vk::DescriptorSetLayoutBinding{ binding, descriptorType, capacity, vk::ShaderStageFlagBits::eAll });
+            // registered slots are written while frames in flight read other ones
+            bindingFlags.push_back(vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending);
+            if (capacity > 0)
+                poolSizes.push_back(vk::DescriptorPoolSize{ descriptorType, capacity });
+        }
+
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo;
+        bindingFlagsCreateInfo.setBindingFlags(bindingFlags);
+
+        vk::DescriptorSetLayoutCreateInfo layoutCreateInfo;
+        layoutCreateInfo
+            .setBindings(layoutBindings)
+            .setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+            .setPNext(&bindingFlagsCreateInfo);
+        this->setLayout = vulkan.GetDevice().createDescriptorSetLayout(layoutCreateInfo);
+
+        vk::DescriptorPoolCreateInfo poolCreateInfo;
+        poolCreateInfo
+            .setPoolSizes(poolSizes)
+            .setMaxSets(1)
+            .setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind);
+        this->descriptorPool = vulkan.GetDevice().createDescriptorPool(poolCreateInfo);
+
+        vk::DescriptorSetAllocateInfo allocateInfo;
+        allocateInfo
+            .setDescriptorPool(this->descriptorPool)
+            .setSetLayouts(this->setLayout);
+        this->descriptorSet = vulkan.GetDevice().allocateDescriptorSets(allocateInfo).front();
+
+        this->pendingFrees.resize(virtualFrameCount);
+    }
+
+    void ResourceHeap::Destroy()
+    {
+        auto& device = GetCurrentVulkanContext().GetDevice();
+        if ((bool)this->descriptorPool) device.destroyDescriptorPool(this->descriptorPool);
+        if ((bool)this->setLayout) device.destroyDescriptorSetLayout(this->setLayout);
+        this->descriptorPool = vk::DescriptorPool{ };
+        this->setLayout = vk::DescriptorSetLayout{ };
+        this->descriptorSet = vk::DescriptorSet{ };
+        this->slotAllocators = { };
+        this->reservedPassDescriptorCount = 0;
+        this->pendingFrees.clear();
+    }
+
+    ResourceHeapIndex ResourceHeap::AllocateSlot(ResourceHeapBinding binding)
+    {
+        assert(this->IsInitialized());
+        auto& allocator = this->slotAllocators[(size_t)binding];
+        if (!allocator.FreeSlots.empty())
+        {
+            auto index = allocator.FreeSlots.back();
+            allocator.FreeSlots.pop_back();
+            return index;
+        }
+
+        assert(allocator.UsedCount < allocator.Capacity);
+        return allocator.UsedCount++;
+    }
+
+    void ResourceHeap::WriteImage(ResourceHeapBinding binding, ResourceHeapIndex index, const vk::DescriptorImageInfo& imageInfo)
+    {
+        vk::WriteDescriptorSet writeDescriptorSet;
+        writeDescriptorSet
+            .setDstSet(this->descriptorSet)
+            .setDstBinding((uint32_t)binding)
+            .setDstArrayElement(index)
+            .setDescriptorType(GetBindingDescriptorType(binding))
+            .setImageInfo(imageInfo);
+        GetCurrentVulkanContext().GetDevice().updateDescriptorSets(writeDescriptorSet, { });
+    }
+
+    ResourceHeapIndex ResourceHeap::RegisterImage(const Image& image, const Sampler& sampler, ImageView view)
+    {
+        auto index = this->AllocateSlot(ResourceHeapBinding::SAMPLED_IMAGES);
+        this->WriteImage(ResourceHeapBinding::SAMPLED_IMAGES, index, vk::DescriptorImageInfo{
+            sampler.GetNativeHandle(),
+            image.GetNativeView(view),
+            ImageUsageToImageLayout(ImageUsage::SHADER_READ),
+        });
+        return index;
+    }
+
+    ResourceHeapIndex ResourceHeap::RegisterStorageImage(const Image& image, ImageView view)
+    {
+        auto index = this->AllocateSlot(ResourceHeapBinding::STORAGE_IMAGES);
+        this->WriteImage(ResourceHeapBinding::STORAGE_IMAGES, index, vk::DescriptorImageInfo{
+            vk::Sampler{ },
+            image.GetNativeView(view),
+            ImageUsageToImageLayout(ImageUsage::STORAGE),
+        });
+        return index;
+    }
+
+    ResourceHeapIndex ResourceHeap::RegisterBuffer(const Buffer& buffer)
+    {
+        auto index = this->AllocateSlot(ResourceHeapBinding::STORAGE_BUFFERS);
+        vk::DescriptorBufferInfo bufferInfo{ buffer.GetNativeHandle(), 0, buffer.GetByteSize() };
+
+        vk::WriteDescriptorSet writeDescriptorSet;
+        writeDescriptorSet
+            .setDstSet(this->descriptorSet)
+            .setDstBinding((uint32_t)ResourceHeapBinding::STORAGE_BUFFERS)
+            .setDstArrayElement(index)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setBufferInfo(bufferInfo);
+        GetCurrentVulkanContext().GetDevice().updateDescriptorSets(writeDescriptorSet, { });
+        return index;
+    }
+
+    void ResourceHeap::Free(ResourceHeapBinding binding, ResourceHeapIndex index)
+    {
+        assert(index < this->slotAllocators[(size_t)binding].UsedCount);
+        this->pendingFrees[this->currentFrame].push_back(PendingFree{ binding, index });
+    }
+
+    void ResourceHeap::ReleaseFreedSlots(size_t virtualFrameIndex)
+    {
+        this->currentFrame = virtualFrameIndex;
+        if (this->pendingFrees.empty())
+            return;
+
+        // descriptor is left as is, partially bound slot is not accessed until it is registered again
+        for (const auto& pendingFree : this->pendingFrees[virtualFrameIndex])
+            this->slotAllocators[(size_t)pendingFree.Binding].FreeSlots.push_back(pendingFree.Index);
+        this->pendingFrees[virtualFrameIndex].clear();
+    }
+
+    ResourceHeapStatistics ResourceHeap::GetStatistics() const
+    {
+        auto getAllocatedCount = [this](ResourceHeapBinding binding)
+        {
+            const auto& allocator = this->slotAllocators[(size_t)binding];
+            return allocator.UsedCount - (uint32_t)allocator.FreeSlots.size();
+        };
+
+        ResourceHeapStatistics statistics;
+        statistics.SampledImageCount = getAllocatedCount(ResourceHeapBinding::SAMPLED_IMAGES);
+        statistics.SampledImageCapacity = this->slotAllocators[(size_t)ResourceHeapBinding::SAMPLED_IMAGES].Capacity;
+        statistics.StorageImageCount = getAllocatedCount(ResourceHeapBinding::STORAGE_IMAGES);
+        statistics.StorageImageCapacity = this->slotAllocators[(size_t)ResourceHeapBinding::STORAGE_IMAGES].Capacity;
+        statistics.StorageBufferCount = getAllocatedCount(ResourceHeapBinding::STORAGE_BUFFERS);
+        statistics.StorageBufferCapacity = this->slotAllocators[(size_t)ResourceHeapBinding::STORAGE_BUFFERS].Capacity;
+        for (const auto& framePendingFrees : this->pendingFrees)
+            statistics.PendingFreeCount += (uint32_t)framePendingFrees.size();
+        return statistics;
+    }
+}
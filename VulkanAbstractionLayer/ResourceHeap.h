@@ -0,0 +1,113 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <array>
+
+#include "Buffer.h"
+#include "Image.h"
+#include "Sampler.h"
+
+namespace VulkanAbstractionLayer
+{
+    // shaders which index the heap declare its bindings as unbounded arrays in this set, pass descriptors stay in set 0
+    constexpr uint32_t RESOURCE_HEAP_SET = 1;
+
+    enum class ResourceHeapBinding : uint32_t
+    {
+        SAMPLED_IMAGES = 0,
+        STORAGE_IMAGES,
+        STORAGE_BUFFERS,
+    };
+
+    using ResourceHeapIndex = uint32_t;
+    constexpr ResourceHeapIndex INVALID_RESOURCE_HEAP_INDEX = ResourceHeapIndex(-1);
+
+    struct ResourceHeapStatistics
+    {
+        uint32_t SampledImageCount = 0;
+        uint32_t SampledImageCapacity = 0;
+        uint32_t StorageImageCount = 0;
+        uint32_t StorageImageCapacity = 0;
+        uint32_t StorageBufferCount = 0;
+        uint32_t StorageBufferCapacity = 0;
+        uint32_t PendingFreeCount = 0; // freed, but possibly read by frames in flight
+    };
+
+    // global bindless descriptor set, registered resources keep their index until freed
+    // render graph does not see accesses through the heap, passes still declare them with AddDependency for synchronization
+    class ResourceHeap
+    {
+        constexpr static size_t BindingCount = 3;
+
+        struct SlotAllocator
+        {
+            uint32_t Capacity = 0;
+            uint32_t UsedCount = 0; // slots above it were never allocated
+            std::vector<ResourceHeapIndex> FreeSlots;
+        };
+
+        struct PendingFree
+        {
+            ResourceHeapBinding Binding;
+            ResourceHeapIndex Index;
+        };
+
+        vk::DescriptorSetLayout setLayout;
+        vk::DescriptorPool descriptorPool;
+        vk::DescriptorSet descriptorSet;
+        std::array<SlotAllocator, BindingCount> slotAllocators;
+        std::vector<std::vector<PendingFree>> pendingFrees; // per virtual frame
+        uint32_t reservedPassDescriptorCount = 0;
+        size_t currentFrame = 0;
+
+        ResourceHeapIndex AllocateSlot(ResourceHeapBinding binding);
+        void WriteImage(ResourceHeapBinding binding, ResourceHeapIndex index, const vk::DescriptorImageInfo& imageInfo);
+    public:
+        // capacities are clamped to update after bind limits of device minus descriptors reserved for set of pass
+        void Init(uint32_t sampledImageCount, uint32_t storageImageCount, uint32_t storageBufferCount, uint32_t reservedPassDescriptorCount, size_t virtualFrameCount);
+        void Destroy();
+
+        ResourceHeapIndex RegisterImage(const Image& image, const Sampler& sampler, ImageView view = ImageView::NATIVE);
+        ResourceHeapIndex RegisterStorageImage(const Image& image, ImageView view = ImageView::NATIVE);
+        ResourceHeapIndex RegisterBuffer(const Buffer& buffer);
+        // index is reused only after frames which could still read it are finished
+        void Free(ResourceHeapBinding binding, ResourceHeapIndex index);
+        // called after frame fence is waited, slots freed during previous use of this virtual frame become available
+        void ReleaseFreedSlots(size_t virtualFrameIndex);
+
+        bool IsInitialized() const { return (bool)this->setLayout; }
+        const vk::DescriptorSetLayout& GetSetLayout() const { return this->setLayout; }
+        const vk::DescriptorSet& GetDescriptorSet() const { return this->descriptorSet; }
+        uint32_t GetReservedPassDescriptorCount() const { return this->reservedPassDescriptorCount; }
+        ResourceHeapStatistics GetStatistics() const;
+    };
+}
@@ -49,5 +49,7 @@ namespace VulkanAbstractionLayer
         virtual ArrayView<const TypeSPIRV> GetInputAttributes() const = 0;
         virtual ArrayView<const ShaderUniforms> GetShaderUniforms() const = 0;
         virtual const vk::ShaderModule& GetNativeShader(ShaderType type) const = 0;
+        // shader declares bindings of global resource heap in its second descriptor set
+        virtual bool UsesResourceHeap() const = 0;
     };
 }
\ No newline at end of file
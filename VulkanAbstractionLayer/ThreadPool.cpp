@@ -0,0 +1,96 @@
+// Copyright(c) 2021, #Momo
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met :
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and /or other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ThreadPool.h"
+
+namespace VulkanAbstractionLayer
+{
+    ThreadPool::ThreadPool(size_t workerCount)
+    {
+        for (size_t workerIndex = 0; workerIndex < workerCount; workerIndex++)
+            this->workers.emplace_back(&ThreadPool::RunWorker, this, workerIndex);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->isStopping = true;
+        }
+        this->taskAvailable.notify_all();
+
+        for (auto& worker : this->workers)
+            worker.join();
+    }
+
+    void ThreadPool::RunWorker(size_t workerIndex)
+    {
+        while (true)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->taskAvailable.wait(lock, [this]() { return this->isStopping || this->nextTask < this->tasks.size(); });
+                if (this->nextTask == this->tasks.size())
+                    return;
+
+                task = std::move(this->tasks[this->nextTask++]);
+                this->runningTaskCount++;
+            }
+
+            task(workerIndex);
+
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->runningTaskCount--;
+            }
+            this->tasksFinished.notify_all();
+        }
+    }
+
+    void ThreadPool::Submit(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            // all previous tasks were taken, their storage can be reused
+            if (this->nextTask == this->tasks.size())
+            {
+                this->tasks.clear();
+                this->nextTask = 0;
+            }
+            this->tasks.push_back(std::move(task));
+        }
+        this->taskAvailable.notify_one();
+    }
+
+    void ThreadPool::Wait()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->tasksFinished.wait(lock, [this]() { return this->nextTask == this->tasks.size() && this->runningTaskCount == 0; });
+    }
+}
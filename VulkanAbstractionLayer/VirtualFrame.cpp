@@ -52,6 +52,7 @@ namespace VulkanAbstractionLayer
                 CommandBuffer{ commandBuffers[i] },
                 StageBuffer(stageBufferSize),
                 fence,
+                { commandBuffers[i] },
             });
         }
     }
@@ -80,6 +81,8 @@ namespace VulkanAbstractionLayer
         assert(waitFenceResult == vk::Result::eSuccess);
         vulkanContext.GetDevice().resetFences(frame.CommandQueueFence);
 
+        frame.CurrentCommandBuffer = 0;
+        frame.Commands = CommandBuffer{ frame.CommandBuffers[frame.CurrentCommandBuffer] };
         frame.Commands.Begin();
 
         this->isFrameRunning = true;
@@ -97,10 +100,12 @@ namespace VulkanAbstractionLayer
         auto subresourceRange = GetDefaultImageSubresourceRange(presentImage);
 
         // here we assume that present image is not written directly, but transfered from other image
-        vk::ImageMemoryBarrier presentImageTransferDstToPresent;
+        vk::ImageMemoryBarrier2KHR presentImageTransferDstToPresent;
         presentImageTransferDstToPresent
-            .setSrcAccessMask(ImageUsageToAccessFlags(lastPresentImageUsage))
-            .setDstAccessMask(vk::AccessFlagBits::eMemoryRead)
+            .setSrcStageMask(ImageUsageToPipelineStage2(lastPresentImageUsage))
+            .setSrcAccessMask(ImageUsageToAccessFlags2(lastPresentImageUsage))
+            .setDstStageMask(vk::PipelineStageFlagBits2KHR::eBottomOfPipe)
+            .setDstAccessMask(vk::AccessFlagBits2KHR::eMemoryRead)
             .setOldLayout(ImageUsageToImageLayout(lastPresentImageUsage))
             .setNewLayout(vk::ImageLayout::ePresentSrcKHR)
             .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
@@ -108,30 +113,26 @@ namespace VulkanAbstractionLayer
             .setImage(presentImage.GetNativeHandle())
             .setSubresourceRange(subresourceRange);
 
-        frame.Commands.GetNativeHandle().pipelineBarrier(
-            ImageUsageToPipelineStage(lastPresentImageUsage),
-            vk::PipelineStageFlagBits::eBottomOfPipe,
-            { }, // dependency flags
-            { }, // memory barriers
-            { }, // buffer barriers
-            presentImageTransferDstToPresent
-        );
+        frame.Commands.PipelineBarrier({ }, ArrayView<const vk::ImageMemoryBarrier2KHR>{ &presentImageTransferDstToPresent, 1 });
 
         frame.Commands.End();
 
         frame.StagingBuffer.Flush();
         frame.StagingBuffer.Reset();
 
-        std::array waitDstStageMask = { (vk::PipelineStageFlags)vk::PipelineStageFlagBits::eTransfer };
+        frame.WaitSemaphores.push_back(vulkanContext.GetImageAvailableSemaphore());
+        frame.WaitStages.push_back(vk::PipelineStageFlagBits::eTransfer);
 
         vk::SubmitInfo submitInfo;
         submitInfo
-            .setWaitSemaphores(vulkanContext.GetImageAvailableSemaphore())
-            .setWaitDstStageMask(waitDstStageMask)
+            .setWaitSemaphores(frame.WaitSemaphores)
+            .setWaitDstStageMask(frame.WaitStages)
             .setSignalSemaphores(vulkanContext.GetRenderingFinishedSemaphore())
             .setCommandBuffers(frame.Commands.GetNativeHandle());
 
         GetCurrentVulkanContext().GetGraphicsQueue().submit(std::array{ submitInfo }, frame.CommandQueueFence);
+        frame.WaitSemaphores.clear();
+        frame.WaitStages.clear();
 
         vk::PresentInfoKHR presentInfo;
         presentInfo
@@ -146,6 +147,47 @@ namespace VulkanAbstractionLayer
         this->isFrameRunning = false;
     }
 
+    void VirtualFrameProvider::SubmitCurrentCommands(ArrayView<const vk::Semaphore> signalSemaphores)
+    {
+        auto& frame = this->GetCurrentFrame();
+        auto& vulkanContext = GetCurrentVulkanContext();
+
+        frame.Commands.End();
+        frame.StagingBuffer.Flush();
+
+        vk::SubmitInfo submitInfo;
+        submitInfo
+            .setWaitSemaphores(frame.WaitSemaphores)
+            .setWaitDstStageMask(frame.WaitStages)
+            .setSignalSemaphores(signalSemaphores)
+            .setCommandBuffers(frame.Commands.GetNativeHandle());
+
+        // frame fence is signaled by the last submit, which also covers all earlier ones in the queue
+        vulkanContext.GetGraphicsQueue().submit(std::array{ submitInfo }, vk::Fence{ });
+        frame.WaitSemaphores.clear();
+        frame.WaitStages.clear();
+
+        frame.CurrentCommandBuffer++;
+        if (frame.CurrentCommandBuffer == frame.CommandBuffers.size())
+        {
+            vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
+            commandBufferAllocateInfo
+                .setCommandPool(vulkanContext.GetCommandPool())
+                .setCommandBufferCount(1)
+                .setLevel(vk::CommandBufferLevel::ePrimary);
+            frame.CommandBuffers.push_back(vulkanContext.GetDevice().allocateCommandBuffers(commandBufferAllocateInfo).front());
+        }
+        frame.Commands = CommandBuffer{ frame.CommandBuffers[frame.CurrentCommandBuffer] };
+        frame.Commands.Begin();
+    }
+
+    void VirtualFrameProvider::AddWaitSemaphore(const vk::Semaphore& semaphore, vk::PipelineStageFlags waitStage)
+    {
+        auto& frame = this->GetCurrentFrame();
+        frame.WaitSemaphores.push_back(semaphore);
+        frame.WaitStages.push_back(waitStage);
+    }
+
     VirtualFrame& VirtualFrameProvider::GetCurrentFrame()
     {
         return this->virtualFrames[this->currentFrame];
@@ -176,6 +218,11 @@ namespace VulkanAbstractionLayer
         return this->virtualFrames.size();
     }
 
+    size_t VirtualFrameProvider::GetCurrentFrameIndex() const
+    {
+        return this->currentFrame;
+    }
+
     uint32_t VirtualFrameProvider::GetPresentImageIndex() const
     {
         return this->presentImageIndex;
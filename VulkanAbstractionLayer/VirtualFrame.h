@@ -41,6 +41,10 @@ namespace VulkanAbstractionLayer
         CommandBuffer Commands{ vk::CommandBuffer{ } };
         StageBuffer StagingBuffer;
         vk::Fence CommandQueueFence;
+        std::vector<vk::CommandBuffer> CommandBuffers;
+        size_t CurrentCommandBuffer = 0;
+        std::vector<vk::Semaphore> WaitSemaphores;
+        std::vector<vk::PipelineStageFlags> WaitStages;
     };
 
     class VirtualFrameProvider
@@ -61,6 +65,9 @@ namespace VulkanAbstractionLayer
         uint32_t GetPresentImageIndex() const;
         bool IsFrameRunning() const;
         size_t GetFrameCount() const;
+        size_t GetCurrentFrameIndex() const;
+        void SubmitCurrentCommands(ArrayView<const vk::Semaphore> signalSemaphores);
+        void AddWaitSemaphore(const vk::Semaphore& semaphore, vk::PipelineStageFlags waitStage);
         void EndFrame();
     };
 }
\ No newline at end of file
@@ -129,6 +129,23 @@ namespace VulkanAbstractionLayer
         return { };
     }
 
+    std::optional<uint32_t> DetermineComputeQueueFamilyIndex(const vk::PhysicalDevice device)
+    {
+        auto queueFamilyProperties = device.getQueueFamilyProperties();
+        uint32_t index = 0;
+        for (const auto& property : queueFamilyProperties)
+        {
+            if ((property.queueCount > 0) &&
+                (property.queueFlags & vk::QueueFlagBits::eCompute) &&
+                !(property.queueFlags & vk::QueueFlagBits::eGraphics))
+            {
+                return index;
+            }
+            index++;
+        }
+        return { };
+    }
+
     VulkanContext::VulkanContext(const VulkanContextCreateOptions& options)
     {
         vk::ApplicationInfo applicationInfo;
@@ -171,9 +188,11 @@ namespace VulkanAbstractionLayer
         this->device.waitIdle();
 
         this->virtualFrames.Destroy();
+        this->resourceHeap.Destroy();
         this->descriptorCache.Destroy();
        
         if ((bool)this->commandPool) this->device.destroyCommandPool(this->commandPool);
+        if ((bool)this->computeCommandPool) this->device.destroyCommandPool(this->computeCommandPool);
 
         this->swapchainImages.clear();
 
@@ -191,6 +210,7 @@ namespace VulkanAbstractionLayer
         if ((bool)this->instance) this->instance.destroy();
         this->presentImageCount = { };
         this->queueFamilyIndex = { };
+        this->computeQueueFamilyIndex = { };
         this->apiVersion = { };
     }
 
@@ -280,10 +300,39 @@ namespace VulkanAbstractionLayer
 
         // logical device and device queue
 
+        // async compute: dedicated compute family if present, otherwise second queue of main family
+        auto computeQueueFamilyIndex = DetermineComputeQueueFamilyIndex(this->physicalDevice);
+        auto mainQueueCount = this->physicalDevice.getQueueFamilyProperties()[this->queueFamilyIndex].queueCount;
+        uint32_t computeQueueIndex = 0;
+
+        std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateInfos;
+        std::array queuePriorities = { 1.0f, 1.0f };
+
         vk::DeviceQueueCreateInfo deviceQueueCreateInfo;
-        std::array queuePriorities = { 1.0f };
         deviceQueueCreateInfo.setQueueFamilyIndex(this->queueFamilyIndex);
-        deviceQueueCreateInfo.setQueuePriorities(queuePriorities);
+        deviceQueueCreateInfo.setQueueCount(1);
+        deviceQueueCreateInfo.setPQueuePriorities(queuePriorities.data());
+
+        if (computeQueueFamilyIndex.has_value())
+        {
+            this->computeQueueFamilyIndex = computeQueueFamilyIndex.value();
+
+            vk::DeviceQueueCreateInfo computeQueueCreateInfo;
+            computeQueueCreateInfo.setQueueFamilyIndex(this->computeQueueFamilyIndex);
+            computeQueueCreateInfo.setQueueCount(1);
+            computeQueueCreateInfo.setPQueuePriorities(queuePriorities.data());
+            deviceQueueCreateInfos.push_back(computeQueueCreateInfo);
+        }
+        else
+        {
+            this->computeQueueFamilyIndex = this->queueFamilyIndex;
+            if (mainQueueCount > 1)
+            {
+                deviceQueueCreateInfo.setQueueCount(2);
+                computeQueueIndex = 1;
+            }
+        }
+        deviceQueueCreateInfos.push_back(deviceQueueCreateInfo);
 
         auto deviceExtensions = options.DeviceExtensions;
         deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
@@ -294,7 +343,58 @@ namespace VulkanAbstractionLayer
         deviceExtensions.push_back("VK_KHR_portability_subset");
 #endif
 
+        auto supportedExtensions = this->physicalDevice.enumerateDeviceExtensionProperties();
+        auto isExtensionSupported = [&supportedExtensions](const char* extensionName)
+        {
+            return std::any_of(supportedExtensions.begin(), supportedExtensions.end(), [extensionName](const vk::ExtensionProperties& extension)
+            {
+                return std::strcmp(extension.extensionName.data(), extensionName) == 0;
+            });
+        };
+
+        if (options.EnableSynchronization2)
+        {
+            this->synchronization2Enabled = isExtensionSupported(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+            if (this->synchronization2Enabled)
+                deviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+            else
+                options.InfoCallback("synchronization2 is not supported by device, falling back to legacy barriers");
+        }
+
+        if (options.EnableDynamicRendering)
+        {
+            // dynamic rendering depends on depth stencil resolve, which depends on create render pass 2
+            this->dynamicRenderingEnabled =
+                isExtensionSupported(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) &&
+                isExtensionSupported(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) &&
+                isExtensionSupported(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+            if (this->dynamicRenderingEnabled)
+            {
+                deviceExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+                deviceExtensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+                deviceExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+            }
+            else
+            {
+                options.InfoCallback("dynamic rendering is not supported by device, falling back to render pass objects");
+            }
+        }
+
+        // resource heap writes unbounded arrays while frames in flight use the set
+        auto supportedFeatures = this->physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeatures>();
+        const auto& supportedDescriptorIndexing = supportedFeatures.get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+        bool isResourceHeapSupported =
+            supportedDescriptorIndexing.runtimeDescriptorArray &&
+            supportedDescriptorIndexing.descriptorBindingPartiallyBound &&
+            supportedDescriptorIndexing.descriptorBindingUpdateUnusedWhilePending &&
+            supportedDescriptorIndexing.descriptorBindingSampledImageUpdateAfterBind &&
+            supportedDescriptorIndexing.descriptorBindingStorageImageUpdateAfterBind &&
+            supportedDescriptorIndexing.descriptorBindingStorageBufferUpdateAfterBind;
+        if (!isResourceHeapSupported)
+            options.InfoCallback("descriptor indexing features required by resource heap are not supported by device, resource heap is disabled");
+
         vk::PhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures;
+        descriptorIndexingFeatures.runtimeDescriptorArray                             = isResourceHeapSupported;
         descriptorIndexingFeatures.descriptorBindingPartiallyBound                    = true;
         descriptorIndexingFeatures.shaderInputAttachmentArrayDynamicIndexing          = true;
         descriptorIndexingFeatures.shaderUniformTexelBufferArrayDynamicIndexing       = true;
@@ -317,6 +417,20 @@ namespace VulkanAbstractionLayer
         descriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind      = true;
         descriptorIndexingFeatures.descriptorBindingUniformTexelBufferUpdateAfterBind = true;
         descriptorIndexingFeatures.descriptorBindingStorageTexelBufferUpdateAfterBind = true;
+        descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending          = isResourceHeapSupported;
+
+        vk::PhysicalDeviceSynchronization2FeaturesKHR synchronization2Features;
+        synchronization2Features.synchronization2 = true;
+        if (this->synchronization2Enabled)
+            descriptorIndexingFeatures.pNext = &synchronization2Features;
+
+        vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures;
+        dynamicRenderingFeatures.dynamicRendering = true;
+        if (this->dynamicRenderingEnabled)
+        {
+            dynamicRenderingFeatures.pNext = descriptorIndexingFeatures.pNext;
+            descriptorIndexingFeatures.pNext = &dynamicRenderingFeatures;
+        }
 
         vk::PhysicalDeviceMultiviewFeatures multiviewFeatures;
         multiviewFeatures.multiview = true;
@@ -329,12 +443,16 @@ namespace VulkanAbstractionLayer
         vk::DeviceCreateInfo deviceCreateInfo;
         deviceCreateInfo
             .setPEnabledFeatures(&features)
-            .setQueueCreateInfos(deviceQueueCreateInfo)
+            .setQueueCreateInfos(deviceQueueCreateInfos)
             .setPEnabledExtensionNames(deviceExtensions)
             .setPNext(&multiviewFeatures);
 
         this->device = this->physicalDevice.createDevice(deviceCreateInfo);
         this->deviceQueue = this->device.getQueue(this->queueFamilyIndex, 0);
+        this->computeQueue = this->device.getQueue(this->computeQueueFamilyIndex, computeQueueIndex);
+
+        if (this->HasAsyncCompute())
+            options.InfoCallback("async compute queue family index: " + std::to_string(this->computeQueueFamilyIndex));
 
         options.InfoCallback("created logical device and device queues");
 
@@ -374,6 +492,13 @@ namespace VulkanAbstractionLayer
 
         this->commandPool = this->device.createCommandPool(commandPoolCreateInfo);
 
+        vk::CommandPoolCreateInfo computeCommandPoolCreateInfo;
+        computeCommandPoolCreateInfo
+            .setQueueFamilyIndex(this->computeQueueFamilyIndex)
+            .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient);
+
+        this->computeCommandPool = this->device.createCommandPool(computeCommandPoolCreateInfo);
+
         vk::CommandBufferAllocateInfo commandBufferAllocateInfo;
         commandBufferAllocateInfo
             .setLevel(vk::CommandBufferLevel::ePrimary)
@@ -384,6 +509,11 @@ namespace VulkanAbstractionLayer
         options.InfoCallback("created command buffer pool");
 
         this->descriptorCache.Init();
+        if (isResourceHeapSupported)
+        {
+            this->resourceHeap.Init(options.ResourceHeapSampledImageCount, options.ResourceHeapStorageImageCount, options.ResourceHeapStorageBufferCount,
+                options.ResourceHeapReservedPassDescriptorCount, options.VirtualFrameCount);
+        }
         this->virtualFrames.Init(options.VirtualFrameCount, options.MaxStageBufferSize);
 
         options.InfoCallback("initialization finished");
@@ -459,6 +589,7 @@ namespace VulkanAbstractionLayer
     void VulkanContext::StartFrame()
     {
         this->virtualFrames.StartFrame();
+        this->resourceHeap.ReleaseFreedSlots(this->GetCurrentVirtualFrameIndex());
     }
 
     const Image& VulkanContext::AcquireCurrentSwapchainImage(ImageUsage::Bits usage)
@@ -491,6 +622,16 @@ namespace VulkanAbstractionLayer
         this->device.resetFences(this->immediateFence);
     }
 
+    void VulkanContext::SubmitCurrentCommandBuffer(ArrayView<const vk::Semaphore> signalSemaphores)
+    {
+        this->virtualFrames.SubmitCurrentCommands(signalSemaphores);
+    }
+
+    void VulkanContext::AddFrameWaitSemaphore(const vk::Semaphore& semaphore, vk::PipelineStageFlags waitStage)
+    {
+        this->virtualFrames.AddWaitSemaphore(semaphore, waitStage);
+    }
+
     bool VulkanContext::IsFrameRunning() const
     {
         return this->virtualFrames.IsFrameRunning();
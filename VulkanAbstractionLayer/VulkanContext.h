@@ -34,6 +34,7 @@
 
 #include "VirtualFrame.h"
 #include "DescriptorCache.h"
+#include "ResourceHeap.h"
 #include "Image.h"
 #include "CommandBuffer.h"
 
@@ -75,6 +76,13 @@ namespace VulkanAbstractionLayer
         std::vector<const char*> DeviceExtensions;
         size_t VirtualFrameCount = 3;
         size_t MaxStageBufferSize = 64 * 1024 * 1024;
+        bool EnableSynchronization2 = false; // VK_KHR_synchronization2 barriers, ignored if device does not support it
+        bool EnableDynamicRendering = false; // VK_KHR_dynamic_rendering instead of render pass and framebuffer objects, ignored if device does not support it
+        // capacities of bindless resource heap, clamped to device limits, heap is not created if all are zero or device lacks required descriptor indexing features
+        uint32_t ResourceHeapSampledImageCount = 4096;
+        uint32_t ResourceHeapStorageImageCount = 512;
+        uint32_t ResourceHeapStorageBufferCount = 1024;
+        uint32_t ResourceHeapReservedPassDescriptorCount = 64; // left in update after bind limits for set 0 of passes which use heap
     };
 
     class VulkanContext
@@ -89,10 +97,12 @@ namespace VulkanAbstractionLayer
         vk::PhysicalDeviceProperties physicalDeviceProperties;
         vk::Device device;
         vk::Queue deviceQueue;
+        vk::Queue computeQueue;
         vk::Semaphore imageAvailableSemaphore;
         vk::Semaphore renderingFinishedSemaphore;
         vk::Fence immediateFence;
         vk::CommandPool commandPool;
+        vk::CommandPool computeCommandPool;
         CommandBuffer immediateCommandBuffer{ { } };
         vk::SwapchainKHR swapchain;
         vk::DebugUtilsMessengerEXT debugUtilsMessenger;
@@ -102,9 +112,13 @@ namespace VulkanAbstractionLayer
         std::vector<ImageUsage::Bits> swapchainImageUsages;
         VirtualFrameProvider virtualFrames;
         DescriptorCache descriptorCache;
+        ResourceHeap resourceHeap;
         uint32_t queueFamilyIndex = { };
+        uint32_t computeQueueFamilyIndex = { };
         uint32_t apiVersion = { };
         bool renderingEnabled = true;
+        bool synchronization2Enabled = false;
+        bool dynamicRenderingEnabled = false;
 
     public:
         VulkanContext(const VulkanContextCreateOptions& options);
@@ -119,18 +133,27 @@ namespace VulkanAbstractionLayer
         const Format GetSurfaceFormat() const { return FromNative(this->surfaceFormat.format); }
         const vk::Extent2D& GetSurfaceExtent() const { return this->surfaceExtent; }
         const vk::PhysicalDevice& GetPhysicalDevice() const { return this->physicalDevice; }
+        const vk::PhysicalDeviceProperties& GetPhysicalDeviceProperties() const { return this->physicalDeviceProperties; }
         const vk::Device& GetDevice() const { return this->device; }
         const vk::Queue& GetPresentQueue() const { return this->deviceQueue; }
         const vk::Queue& GetGraphicsQueue() const { return this->deviceQueue; }
+        const vk::Queue& GetComputeQueue() const { return this->computeQueue; }
         const vk::Semaphore& GetRenderingFinishedSemaphore() const { return this->renderingFinishedSemaphore; }
         const vk::Semaphore& GetImageAvailableSemaphore() const { return this->imageAvailableSemaphore; }
         const vk::SwapchainKHR& GetSwapchain() const { return this->swapchain; }
         const vk::CommandPool& GetCommandPool() const { return this->commandPool; }
+        const vk::CommandPool& GetComputeCommandPool() const { return this->computeCommandPool; }
         DescriptorCache& GetDescriptorCache() { return this->descriptorCache; }
+        ResourceHeap& GetResourceHeap() { return this->resourceHeap; }
         uint32_t GetQueueFamilyIndex() const { return this->queueFamilyIndex; }
+        uint32_t GetComputeQueueFamilyIndex() const { return this->computeQueueFamilyIndex; }
+        bool HasAsyncCompute() const { return this->computeQueue != this->deviceQueue; }
         uint32_t GetPresentImageCount() const { return this->presentImageCount; }
         uint32_t GetAPIVersion() const { return this->apiVersion; }
         const VmaAllocator& GetAllocator() const { return this->allocator; }
+        const vk::DispatchLoaderDynamic& GetDynamicLoader() const { return this->dynamicLoader; }
+        bool IsSynchronization2Enabled() const { return this->synchronization2Enabled; }
+        bool IsDynamicRenderingEnabled() const { return this->dynamicRenderingEnabled; }
         const Image& AcquireSwapchainImage(size_t index, ImageUsage::Bits usage);
         ImageUsage::Bits GetSwapchainImageUsage(size_t index) const;
 
@@ -143,6 +166,9 @@ namespace VulkanAbstractionLayer
         CommandBuffer& GetCurrentCommandBuffer();
         StageBuffer& GetCurrentStageBuffer();
         size_t GetVirtualFrameCount() const { return this->virtualFrames.GetFrameCount(); }
+        size_t GetCurrentVirtualFrameIndex() const { return this->virtualFrames.GetCurrentFrameIndex(); }
+        void SubmitCurrentCommandBuffer(ArrayView<const vk::Semaphore> signalSemaphores);
+        void AddFrameWaitSemaphore(const vk::Semaphore& semaphore, vk::PipelineStageFlags waitStage);
         void SubmitCommandsImmediate(const CommandBuffer& commands);
         CommandBuffer& GetImmediateCommandBuffer();
         void EndFrame();
@@ -85,6 +85,25 @@ namespace VulkanAbstractionLayer
         return allocation;
     }
 
+    VmaAllocation AllocateMemory(const vk::MemoryRequirements& memoryRequirements, MemoryUsage usage)
+    {
+        VmaAllocation allocation = { };
+        VmaAllocationCreateInfo allocationInfo = { };
+        allocationInfo.usage = MemoryUsageToNative(usage);
+        (void)vmaAllocateMemory(GetCurrentVulkanContext().GetAllocator(), (const VkMemoryRequirements*)&memoryRequirements, &allocationInfo, &allocation, nullptr);
+        return allocation;
+    }
+
+    void DeallocateMemory(VmaAllocation allocation)
+    {
+        vmaFreeMemory(GetVulkanAllocator(), allocation);
+    }
+
+    void BindImageMemory(const vk::Image& image, VmaAllocation allocation, size_t offset)
+    {
+        (void)vmaBindImageMemory2(GetVulkanAllocator(), allocation, (VkDeviceSize)offset, image, nullptr);
+    }
+
     uint8_t* MapMemory(VmaAllocation allocation)
     {
         void* memory = nullptr;
@@ -155,6 +155,8 @@ public:
             .Bind(0, "PositionImage", UniformType::STORAGE_IMAGE)
             .Bind(1, "VelocityImage", UniformType::STORAGE_IMAGE)
             .Bind(2, "BallStorageBuffer", UniformType::UNIFORM_BUFFER);
+
+        pipeline.SetQueueType(QueueType::ASYNC_COMPUTE);
     }
 
     virtual void ResolveResources(ResolveState resolve) override
@@ -514,10 +516,10 @@ int main()
 
     Camera camera;
 
-    window.OnResize([&Vulkan, &sharedResources, &renderGraph, &camera](Window& window, Vector2 size) mutable
+    window.OnResize([&Vulkan, &renderGraph, &camera](Window& window, Vector2 size) mutable
     { 
         Vulkan.RecreateSwapchain((uint32_t)size.x, (uint32_t)size.y); 
-        renderGraph = CreateRenderGraph(sharedResources);
+        renderGraph->Resize(Vulkan.GetSurfaceExtent().width, Vulkan.GetSurfaceExtent().height);
         camera.AspectRatio = size.x / size.y;
     });
     
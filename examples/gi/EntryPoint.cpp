@@ -897,10 +897,10 @@ int main()
 
     Camera camera;
 
-    window.OnResize([&Vulkan, &sharedResources, &renderGraph, &camera](Window& window, Vector2 size) mutable
+    window.OnResize([&Vulkan, &renderGraph, &camera](Window& window, Vector2 size) mutable
     { 
         Vulkan.RecreateSwapchain((uint32_t)size.x, (uint32_t)size.y); 
-        renderGraph = CreateRenderGraph(sharedResources);
+        renderGraph->Resize(Vulkan.GetSurfaceExtent().width, Vulkan.GetSurfaceExtent().height);
         camera.AspectRatio = size.x / size.y;
     });
     
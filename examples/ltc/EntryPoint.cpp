@@ -494,10 +494,10 @@ int main()
     lightArray[3].Width = 300.0f;
     lightArray[3].TextureIndex = 1;
 
-    window.OnResize([&Vulkan, &sharedResources, &renderGraph, &camera](Window& window, Vector2 size) mutable
+    window.OnResize([&Vulkan, &renderGraph, &camera](Window& window, Vector2 size) mutable
     { 
         Vulkan.RecreateSwapchain((uint32_t)size.x, (uint32_t)size.y); 
-        renderGraph = CreateRenderGraph(sharedResources);
+        renderGraph->Resize(Vulkan.GetSurfaceExtent().width, Vulkan.GetSurfaceExtent().height);
         camera.AspectRatio = size.x / size.y;
     });
     
@@ -0,0 +1,217 @@
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <new>
+
+#include "VulkanAbstractionLayer/Window.h"
+#include "VulkanAbstractionLayer/VulkanContext.h"
+#include "VulkanAbstractionLayer/RenderGraphBuilder.h"
+#include "VulkanAbstractionLayer/ShaderLoader.h"
+#include "VulkanAbstractionLayer/GraphicShader.h"
+#include "VulkanAbstractionLayer/ComputeShader.h"
+
+using namespace VulkanAbstractionLayer;
+
+// every allocation of the process goes through global operator new, only ones made while counting is enabled are reported
+static std::atomic<bool> IsCountingAllocations{ false };
+static std::atomic<size_t> AllocationCount{ 0 };
+
+void* operator new(std::size_t size)
+{
+    if (IsCountingAllocations.load(std::memory_order_relaxed))
+        AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* memory = std::malloc(size != 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc{ };
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void VulkanInfoCallback(const std::string& message)
+{
+    std::cout << "[INFO Vulkan]: " << message << std::endl;
+}
+
+void VulkanErrorCallback(const std::string& message)
+{
+    std::cout << "[ERROR Vulkan]: " << message << std::endl;
+}
+
+void WindowErrorCallback(const std::string& message)
+{
+    std::cerr << "[ERROR Window]: " << message << std::endl;
+}
+
+constexpr size_t ColorCount = 64;
+constexpr size_t WarmUpFrameCount = 8;
+constexpr size_t MeasuredFrameCount = 64;
+
+class ComputeRenderPass : public RenderPass
+{
+    const Buffer& colorBuffer;
+public:
+
+    ComputeRenderPass(const Buffer& colorBuffer)
+        : colorBuffer(colorBuffer)
+    {
+
+    }
+
+    virtual void SetupPipeline(PipelineState pipeline) override
+    {
+        pipeline.Shader = std::make_unique<ComputeShader>(
+            ShaderLoader::LoadFromSourceFile("main_compute.glsl", ShaderType::COMPUTE, ShaderLanguage::GLSL)
+        );
+
+        pipeline.DescriptorBindings
+            .Bind(0, "ColorBuffer", UniformType::STORAGE_BUFFER);
+
+        pipeline.SetQueueType(QueueType::ASYNC_COMPUTE);
+    }
+
+    virtual void ResolveResources(ResolveState resolve) override
+    {
+        resolve.Resolve("ColorBuffer", this->colorBuffer);
+    }
+
+    virtual void OnRender(RenderPassState state) override
+    {
+        state.Commands.Dispatch(ColorCount / 64, 1, 1);
+    }
+};
+
+class OpaqueRenderPass : public RenderPass
+{
+public:
+    virtual void SetupPipeline(PipelineState pipeline) override
+    {
+        pipeline.Shader = std::make_unique<GraphicShader>(
+            ShaderLoader::LoadFromSourceFile("main_vertex.glsl", ShaderType::VERTEX, ShaderLanguage::GLSL),
+            ShaderLoader::LoadFromSourceFile("main_fragment.glsl", ShaderType::FRAGMENT, ShaderLanguage::GLSL)
+        );
+
+        pipeline.DeclareAttachment("Output", Format::R8G8B8A8_UNORM);
+
+        pipeline.DescriptorBindings
+            .Bind(0, "ColorBuffer", UniformType::STORAGE_BUFFER);
+
+        pipeline.AddOutputAttachment("Output", ClearColor{ 0.0f, 0.0f, 0.0f });
+    }
+
+    virtual void OnRender(RenderPassState state) override
+    {
+        state.Commands.SetRenderArea(state.GetAttachment("Output"));
+        state.Commands.Draw(3, 1);
+    }
+};
+
+auto CreateRenderGraph(const Buffer& colorBuffer)
+{
+    RenderGraphBuilder renderGraphBuilder;
+    renderGraphBuilder
+        .AddRenderPass("ComputePass", std::make_unique<ComputeRenderPass>(colorBuffer))
+        .AddRenderPass("OpaquePass", std::make_unique<OpaqueRenderPass>())
+        .SetOutputName("Output");
+
+    return renderGraphBuilder.Build();
+}
+
+// frames are rendered until every virtual frame has been used, then allocations made by graph execution are counted
+size_t CountSteadyStateAllocations(Window& window, VulkanContext& Vulkan, RenderGraph& renderGraph)
+{
+    AllocationCount = 0;
+    for (size_t frame = 0; frame < WarmUpFrameCount + MeasuredFrameCount && !window.ShouldClose(); frame++)
+    {
+        window.PollEvents();
+        if (!Vulkan.IsRenderingEnabled())
+            continue;
+
+        Vulkan.StartFrame();
+
+        IsCountingAllocations = frame >= WarmUpFrameCount;
+        renderGraph.Execute(Vulkan.GetCurrentCommandBuffer());
+        IsCountingAllocations = false;
+
+        renderGraph.Present(Vulkan.GetCurrentCommandBuffer(), Vulkan.AcquireCurrentSwapchainImage(ImageUsage::TRANSFER_DISTINATION));
+        Vulkan.EndFrame();
+    }
+    return AllocationCount;
+}
+
+int main()
+{
+    if(std::filesystem::exists(APPLICATION_WORKING_DIRECTORY))
+        std::filesystem::current_path(APPLICATION_WORKING_DIRECTORY);
+
+    WindowCreateOptions windowOptions;
+    windowOptions.Size = { 256.0f, 256.0f };
+    windowOptions.Resizeable = false;
+    windowOptions.ErrorCallback = WindowErrorCallback;
+
+    Window window(windowOptions);
+
+    // validation layer allocates inside of recorded commands, so it is not enabled here
+    VulkanContextCreateOptions vulkanOptions;
+    vulkanOptions.VulkanApiMajorVersion = 1;
+    vulkanOptions.VulkanApiMinorVersion = 2;
+    vulkanOptions.Extensions = window.GetRequiredExtensions();
+    vulkanOptions.ErrorCallback = VulkanErrorCallback;
+    vulkanOptions.InfoCallback = VulkanInfoCallback;
+
+    VulkanContext Vulkan(vulkanOptions);
+    SetCurrentVulkanContext(Vulkan);
+
+    ContextInitializeOptions deviceOptions;
+    deviceOptions.ErrorCallback = VulkanErrorCallback;
+    deviceOptions.InfoCallback = VulkanInfoCallback;
+
+    Vulkan.InitializeContext(window.CreateWindowSurface(Vulkan), deviceOptions);
+
+    Buffer colorBuffer{ ColorCount * sizeof(Vector4), BufferUsage::STORAGE_BUFFER, MemoryUsage::GPU_ONLY };
+    std::unique_ptr<RenderGraph> renderGraph = CreateRenderGraph(colorBuffer);
+
+    int result = 0;
+    auto check = [&result](const char* configuration, size_t allocationCount)
+    {
+        std::cout << configuration << ": " << allocationCount << " allocations in " << MeasuredFrameCount << " frames" << std::endl;
+        if (allocationCount != 0) result = 1;
+    };
+
+    check("serial recording", CountSteadyStateAllocations(window, Vulkan, *renderGraph));
+
+    renderGraph->SetRecordingThreadCount(2);
+    check("parallel recording", CountSteadyStateAllocations(window, Vulkan, *renderGraph));
+    renderGraph->SetRecordingThreadCount(0);
+
+    renderGraph->SetProfiling(true);
+    check("profiling", CountSteadyStateAllocations(window, Vulkan, *renderGraph));
+    renderGraph->SetProfiling(false);
+
+    Vulkan.GetDevice().waitIdle();
+    return result;
+}
@@ -0,0 +1,14 @@
+#version 460
+
+layout (local_size_x = 64) in;
+
+layout(set = 0, binding = 0) buffer uColorBuffer
+{
+    vec4 uColors[];
+};
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    uColors[index] = vec4(fract(uColors[index].rgb + vec3(0.01)), 1.0);
+}
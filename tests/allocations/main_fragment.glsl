@@ -0,0 +1,10 @@
+#version 460
+
+layout(location = 0) in vec4 vColor;
+
+layout(location = 0) out vec4 oColor;
+
+void main() 
+{
+    oColor = vColor;
+}
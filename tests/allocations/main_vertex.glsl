@@ -0,0 +1,20 @@
+#version 460
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(location = 0) out vec4 vColor;
+
+layout(set = 0, binding = 0) readonly buffer uColorBuffer
+{
+    vec4 uColors[];
+};
+
+void main()
+{
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+    vColor = uColors[0];
+}